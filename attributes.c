@@ -23,11 +23,31 @@
 
 SQLITE_EXTENSION_INIT1;
 
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+/* snapshots (see attributes_export) are written and mapped with POSIX calls;
+ * elsewhere, exporting or opening one fails */
+#if defined(_WIN32) && ! defined(ATTRIBUTES_NO_SNAPSHOTS)
+#  define ATTRIBUTES_NO_SNAPSHOTS
+#endif
+#ifndef ATTRIBUTES_NO_SNAPSHOTS
+#  include <sys/mman.h>
+#  include <unistd.h>
+#endif
+
+#if defined(ATTRIBUTES_TIMING) && (defined(__x86_64__) || defined(__i386__))
+#  include <x86intrin.h>
+#endif
 
 #define MODULE_NAME "attributes"
-#define MODULE_VERSION 1
+#define STATS_MODULE_NAME "attributes_stats"
+#define MODULE_VERSION 2
 
 #define RECORD_SEPARATOR     '\x1f'
 #define RECORD_SEPARATOR_STR "\x1f"
@@ -36,7 +56,12 @@ SQLITE_EXTENSION_INIT1;
     "CREATE TABLE t ("\
     "  id         INTEGER PRIMARY KEY,"\
     "  attributes TEXT    NOT NULL"\
-    ")"
+    "%s,"\
+    "  sort_key   TEXT    HIDDEN,"\
+    "  sort_value BLOB    HIDDEN)"
+
+#define VIRT_TABLE_PROMOTED_COLUMN_TMPL\
+    ", \"%w\" %s HIDDEN"
 
 #define SEQ_SCHEMA_NAME  "\"%w\".\"%w_Sequence\""
 #define ATTR_SCHEMA_NAME "\"%w\".\"%w_Attributes\""
@@ -45,68 +70,443 @@ SQLITE_EXTENSION_INIT1;
     "CREATE TABLE " SEQ_SCHEMA_NAME " ("\
     "  seq_id     INTEGER PRIMARY KEY, "\
     "  attributes TEXT NOT NULL"\
-    ")"
+    "%s)"
+
+#define SEQ_PROMOTED_COLUMN_TMPL\
+    ", \"%w\" %s"
 
+#define PROMOTED_INDEX_TMPL\
+    "CREATE INDEX \"%w\".\"%w_promoted_%d\" ON \"%w_Sequence\" (\"%w\")"
+
+/* postings are clustered on (attr_name, attr_value), so a key or key-value
+ * lookup is a single range scan with no separate index.  layout version 1
+ * stored postings in a rowid table with an index on (attr_name, seq_id);
+ * see MIGRATE_V1_TMPL */
 #define ATTR_SCHEMA_TMPL\
     "CREATE TABLE " ATTR_SCHEMA_NAME " ("\
-    "  seq_id     INTEGER REFERENCES \"%w_Sequence\" (seq_id) ON DELETE CASCADE, "\
     "  attr_name  TEXT    NOT NULL, "\
-    "  attr_value TEXT    NOT NULL "\
+    "  attr_value %-7s NOT NULL, "\
+    "  seq_id     INTEGER NOT NULL, "\
+    "  PRIMARY KEY (attr_name, attr_value, seq_id)"\
+    ") WITHOUT ROWID"
+
+#define CONFIG_SCHEMA_NAME "\"%w\".\"%w_Config\""
+
+#define CONFIG_SCHEMA_TMPL\
+    "CREATE TABLE " CONFIG_SCHEMA_NAME " ("\
+    "  name  TEXT PRIMARY KEY, "\
+    "  value"\
+    ") WITHOUT ROWID;"\
+    "INSERT INTO " CONFIG_SCHEMA_NAME " (name, value) VALUES ('version', %d)"
+
+#define SELECT_VERSION_TMPL\
+    "SELECT value FROM " CONFIG_SCHEMA_NAME " WHERE name = 'version'"
+
+#define MIGRATE_V1_TMPL\
+    "SAVEPOINT attributes_migrate;"\
+    "CREATE TABLE \"%w\".\"%w_Attributes_v2\" ("\
+    "  attr_name  TEXT    NOT NULL, "\
+    "  attr_value TEXT    NOT NULL, "\
+    "  seq_id     INTEGER NOT NULL, "\
+    "  PRIMARY KEY (attr_name, attr_value, seq_id)"\
+    ") WITHOUT ROWID;"\
+    "INSERT INTO \"%w\".\"%w_Attributes_v2\" (attr_name, attr_value, seq_id) "\
+    "  SELECT attr_name, attr_value, seq_id FROM " ATTR_SCHEMA_NAME " "\
+    "  ORDER BY attr_name, attr_value, seq_id;"\
+    "DROP TABLE " ATTR_SCHEMA_NAME ";"\
+    "ALTER TABLE \"%w\".\"%w_Attributes_v2\" RENAME TO \"%w_Attributes\";"\
+    CONFIG_SCHEMA_TMPL ";"\
+    "RELEASE attributes_migrate"
+
+#define LAYOUT_VERSION 2
+
+/* with intern_values, each distinct value is stored once in the values
+ * table, and attr_value holds its value_id */
+#define VALUES_SCHEMA_NAME "\"%w\".\"%w_Values\""
+
+#define VALUES_SCHEMA_TMPL\
+    "CREATE TABLE " VALUES_SCHEMA_NAME " ("\
+    "  value_id   INTEGER PRIMARY KEY, "\
+    "  attr_value TEXT    NOT NULL UNIQUE"\
     ")"
 
-#define ATTR_INDEX_TMPL\
-    "CREATE UNIQUE INDEX \"%w\".\"%w_attr_index\" ON \"%w_Attributes\" "\
-    " ( attr_name, seq_id ) "
+#define INSERT_VALUE_TMPL\
+    "INSERT OR IGNORE INTO " VALUES_SCHEMA_NAME " (attr_value) VALUES (?)"
+
+#define INTERNED_VALUE_TMPL\
+    "(SELECT value_id FROM " VALUES_SCHEMA_NAME " WHERE attr_value = ?)"
+
+#define BLOOM_SCHEMA_NAME "\"%w\".\"%w_Bloom\""
+
+#define BLOOM_SCHEMA_TMPL\
+    "CREATE TABLE " BLOOM_SCHEMA_NAME " ("\
+    "  attr_name TEXT PRIMARY KEY, "\
+    "  filter    BLOB NOT NULL"\
+    ") WITHOUT ROWID"
+
+#define SELECT_BLOOM_TMPL\
+    "SELECT attr_name, filter FROM " BLOOM_SCHEMA_NAME
+
+#define INSERT_BLOOM_TMPL\
+    "INSERT OR REPLACE INTO " BLOOM_SCHEMA_NAME " (attr_name, filter) VALUES (?, ?)"
+
+#define SELECT_BLOOM_FILTER_TMPL\
+    "SELECT filter FROM " BLOOM_SCHEMA_NAME " WHERE attr_name = ?"
 
 #define INSERT_SEQ_TMPL\
-    "INSERT INTO " SEQ_SCHEMA_NAME " (attributes, seq_id) VALUES (?, ?)"
+    "INSERT INTO " SEQ_SCHEMA_NAME " (attributes, seq_id%s) VALUES (?, ?%s)"
 
 #define INSERT_ATTR_TMPL\
-    "INSERT INTO " ATTR_SCHEMA_NAME " VALUES ( ?, ?, ? )"
+    "INSERT INTO " ATTR_SCHEMA_NAME " (seq_id, attr_name, attr_value) VALUES ( ?, ?, %s )"
 
 #define DELETE_SEQ_TMPL\
     "DELETE FROM " SEQ_SCHEMA_NAME " WHERE seq_id = ?"
 
-#define DELETE_ATTR_TMPL\
-    "DELETE FROM " ATTR_SCHEMA_NAME " WHERE seq_id = ?"
+#define UPDATE_SEQ_TMPL\
+    "UPDATE " SEQ_SCHEMA_NAME " SET attributes = ?%s WHERE seq_id = ?"
+
+#define DELETE_POSTING_TMPL\
+    "DELETE FROM " ATTR_SCHEMA_NAME " "\
+    "WHERE attr_name = ? AND attr_value = %s AND seq_id = ?"
+
+#define SELECT_SEQ_ATTRS_TMPL\
+    "SELECT attributes FROM " SEQ_SCHEMA_NAME " WHERE seq_id = ?"
 
 #define SELECT_CURS_TMPL\
-    "SELECT seq_id, attributes FROM " SEQ_SCHEMA_NAME
+    "SELECT %s FROM " SEQ_SCHEMA_NAME " AS s"
 
 #define SELECT_CURS_WITH_KEY_TMPL\
-    "SELECT s.seq_id, s.attributes FROM " SEQ_SCHEMA_NAME " AS s "\
+    "SELECT %s FROM " SEQ_SCHEMA_NAME " AS s "\
     "INNER JOIN " ATTR_SCHEMA_NAME " AS a ON a.seq_id = s.seq_id "\
     "WHERE a.attr_name = ?"
 
 #define SELECT_CURS_WITH_KEY_VALUE_TMPL\
-    "SELECT s.seq_id, s.attributes FROM " SEQ_SCHEMA_NAME " AS s "\
+    "SELECT %s FROM " SEQ_SCHEMA_NAME " AS s "\
     "INNER JOIN " ATTR_SCHEMA_NAME " AS a ON a.seq_id = s.seq_id "\
-    "WHERE a.attr_name = ? AND a.attr_value = ?"
+    "WHERE a.attr_name = ? AND a.attr_value = %s"
+
+#define SELECT_PARTITIONED_CURS_WITH_KEY_TMPL\
+    "SELECT %s FROM " MATCHES_SCHEMA_NAME " AS s "\
+    "WHERE s.attr_name = ?"
+
+#define SELECT_PARTITIONED_CURS_WITH_KEY_VALUE_TMPL\
+    "SELECT %s FROM " MATCHES_SCHEMA_NAME " AS s "\
+    "WHERE s.attr_name = ? AND s.attr_value = %s"
+
+/* the %s in the subquery is a condition on a.attr_name and a.attr_value
+ * built by _append_glob_condition */
+#define SELECT_CURS_WITH_GLOB_TMPL\
+    "SELECT %s FROM " SEQ_SCHEMA_NAME " AS s "\
+    "WHERE s.seq_id IN (SELECT a.seq_id FROM " ATTR_SCHEMA_NAME " AS a WHERE %s)"
+
+#define INTERNED_GLOB_TMPL\
+    "a.attr_value IN (SELECT value_id FROM " VALUES_SCHEMA_NAME " WHERE %s)"
+
+#define SELECT_CURS_WITH_PROMOTED_KEY_TMPL\
+    "SELECT %s FROM " SEQ_SCHEMA_NAME " AS s "\
+    "WHERE s.\"%w\" IS NOT NULL"
+
+#define SELECT_CURS_WITH_PROMOTED_KEY_VALUE_TMPL\
+    "SELECT %s FROM " SEQ_SCHEMA_NAME " AS s "\
+    "WHERE s.\"%w\" = ?"
+
+/* a column with numeric affinity would take 'k\037010' to match k = 10, so
+ * the index only narrows the rows down, and the value is compared as text
+ * the way MATCH compares it elsewhere */
+#define SELECT_CURS_WITH_NUMERIC_PROMOTED_KEY_VALUE_TMPL\
+    "SELECT %s FROM " SEQ_SCHEMA_NAME " AS s "\
+    "WHERE s.\"%w\" = ?1 AND get_attr(s.attributes, %Q) = ?1"
+
+/* sort_key plans read a key's rows in order of its values, followed by the
+ * value itself; see _allocate_select_sorted_sql */
+#define SELECT_SORTED_CURS_TMPL\
+    "SELECT %s, a.attr_value FROM " ATTR_SCHEMA_NAME " AS a "\
+    "CROSS JOIN " SEQ_SCHEMA_NAME " AS s ON s.seq_id = a.seq_id "\
+    "WHERE a.attr_name = ?"
+
+/* an interned key's postings are ordered by value id rather than by value,
+ * and the values table is shared by every key, so the rows can't be read in
+ * order of their values without walking the whole dictionary; they're read
+ * from the key's postings instead, and SQLite sorts them */
+#define SELECT_INTERNED_SORTED_CURS_TMPL\
+    "SELECT %s, v.attr_value FROM " ATTR_SCHEMA_NAME " AS a "\
+    "INNER JOIN " VALUES_SCHEMA_NAME " AS v ON v.value_id = a.attr_value "\
+    "INNER JOIN " SEQ_SCHEMA_NAME " AS s ON s.seq_id = a.seq_id "\
+    "WHERE a.attr_name = ?"
+
+#define SELECT_PARTITIONED_SORTED_CURS_TMPL\
+    "SELECT %s, s.attr_value FROM " MATCHES_SCHEMA_NAME " AS s "\
+    "WHERE s.attr_name = ?"
+
+#define SELECT_PARTITIONED_INTERNED_SORTED_CURS_TMPL\
+    "SELECT %s, v.attr_value FROM " MATCHES_SCHEMA_NAME " AS s "\
+    "INNER JOIN " VALUES_SCHEMA_NAME " AS v ON v.value_id = s.attr_value "\
+    "WHERE s.attr_name = ?"
+
+#define SELECT_PROMOTED_SORTED_CURS_TMPL\
+    "SELECT %s, s.\"%w\" FROM " SEQ_SCHEMA_NAME " AS s "\
+    "WHERE s.\"%w\" IS NOT NULL"
+
+/* orders by a result column's position, so that it works for any of the
+ * cursor queries */
+#define ORDER_BY_TMPL\
+    " ORDER BY %d%s"
+
+#define PROMOTED_CONSTRAINT_TMPL\
+    " %s s.\"%w\" %s"
+
+#define SORT_VALUE_CONSTRAINT_TMPL\
+    " %s %s %s"
+
+#define SELECT_POSTINGS_WITH_KEY_TMPL\
+    "SELECT seq_id FROM " ATTR_SCHEMA_NAME " "\
+    "WHERE attr_name = ? ORDER BY seq_id"
+
+#define SELECT_POSTINGS_WITH_KEY_VALUE_TMPL\
+    "SELECT seq_id FROM " ATTR_SCHEMA_NAME " "\
+    "WHERE attr_name = ? AND attr_value = %s ORDER BY seq_id"
+
+/* a key's postings in index order (by value), for reading in batches */
+#define SELECT_POSTING_BATCHES_WITH_KEY_TMPL\
+    "SELECT seq_id FROM " ATTR_SCHEMA_NAME " WHERE attr_name = ?"
+
+#define SELECT_POSTINGS_WITH_PROMOTED_KEY_TMPL\
+    "SELECT seq_id FROM " SEQ_SCHEMA_NAME " "\
+    "WHERE \"%w\" IS NOT NULL ORDER BY seq_id"
+
+#define SELECT_POSTINGS_WITH_PROMOTED_KEY_VALUE_TMPL\
+    "SELECT seq_id FROM " SEQ_SCHEMA_NAME " "\
+    "WHERE \"%w\" = ? ORDER BY seq_id"
+
+#define SELECT_POSTINGS_WITH_NUMERIC_PROMOTED_KEY_VALUE_TMPL\
+    "SELECT seq_id FROM " SEQ_SCHEMA_NAME " "\
+    "WHERE \"%w\" = ?1 AND get_attr(attributes, %Q) = ?1 ORDER BY seq_id"
+
+#define SELECT_SEQ_BY_ID_TMPL\
+    "SELECT %s FROM " SEQ_SCHEMA_NAME " AS s WHERE s.seq_id = ?"
+
+#define SELECT_EXPORT_TMPL\
+    "SELECT seq_id, attributes FROM " SEQ_SCHEMA_NAME " ORDER BY seq_id"
+
+/* with partition_size, each range of ids gets its own sequence and attribute
+ * tables (see PARTITION_NAME_TMPL), and the usual shadow table names are
+ * views that UNION ALL the partitions together.  each branch of a view is
+ * limited to its partition's ids, so when SQLite pushes an id constraint
+ * down into the view, partitions outside of it cost a single seek.  joining
+ * two of those views would pair up every partition with every other one, so
+ * MATCH queries read from a third view that joins within each partition */
+#define PARTITION_NAME_TMPL "%s_p%lld"
+
+#define MATCHES_SCHEMA_NAME    "\"%w\".\"%w_Matches\""
+#define PARTITIONS_SCHEMA_NAME "\"%w\".\"%w_Partitions\""
+
+#define PARTITIONS_SCHEMA_TMPL\
+    "CREATE TABLE " PARTITIONS_SCHEMA_NAME " ("\
+    "  partition_id INTEGER PRIMARY KEY"\
+    ")"
+
+#define SELECT_PARTITIONS_TMPL\
+    "SELECT partition_id FROM " PARTITIONS_SCHEMA_NAME " "\
+    "WHERE ?1 IS NULL OR partition_id < ?1 ORDER BY partition_id"
+
+#define SELECT_PARTITION_TMPL\
+    "SELECT 1 FROM " PARTITIONS_SCHEMA_NAME " WHERE partition_id = ?"
+
+#define SELECT_NEWEST_PARTITION_TMPL\
+    "SELECT max(partition_id) FROM " PARTITIONS_SCHEMA_NAME
+
+#define INSERT_PARTITION_TMPL\
+    "INSERT INTO " PARTITIONS_SCHEMA_NAME " (partition_id) VALUES (%lld)"
+
+#define DROP_PARTITION_TMPL\
+    "DROP TABLE " SEQ_SCHEMA_NAME ";"\
+    "DROP TABLE " ATTR_SCHEMA_NAME ";"\
+    "DELETE FROM " PARTITIONS_SCHEMA_NAME " WHERE partition_id = %lld"
+
+#define SELECT_MAX_SEQ_ID_TMPL\
+    "SELECT max(seq_id) FROM " SEQ_SCHEMA_NAME
+
+/* how many rows attributes_best_index assumes a table has: the span of its
+ * ids, or of its partitions' ids, each of which is an index seek away */
+#define ESTIMATE_ROWS_TMPL\
+    "SELECT (SELECT max(seq_id) FROM " SEQ_SCHEMA_NAME ") - "\
+    "(SELECT min(seq_id) FROM " SEQ_SCHEMA_NAME ") + 1"
+
+#define ESTIMATE_PARTITIONED_ROWS_TMPL\
+    "SELECT count(*) * %lld FROM " PARTITIONS_SCHEMA_NAME
+
+/* ...and what it assumes if it can't find out */
+#define DEFAULT_ROW_ESTIMATE 1000000
+
+#define PARTITION_SEQ_BRANCH_TMPL\
+    "SELECT * FROM \"%w_Sequence\" "\
+    "WHERE seq_id >= %lld AND seq_id < %lld"
+
+#define PARTITION_ATTR_BRANCH_TMPL\
+    "SELECT * FROM \"%w_Attributes\" "\
+    "WHERE seq_id >= %lld AND seq_id < %lld"
+
+#define PARTITION_MATCHES_BRANCH_TMPL\
+    "SELECT s.*, a.attr_name, a.attr_value FROM \"%w_Sequence\" AS s "\
+    "INNER JOIN \"%w_Attributes\" AS a ON a.seq_id = s.seq_id "\
+    "WHERE s.seq_id >= %lld AND s.seq_id < %lld"
+
+/* what the views look like when there are no partitions */
+#define EMPTY_SEQ_VIEW_TMPL\
+    "SELECT NULL AS seq_id, NULL AS attributes%s WHERE 0"
+
+#define EMPTY_ATTR_VIEW\
+    "SELECT NULL AS attr_name, NULL AS attr_value, NULL AS seq_id WHERE 0"
+
+#define EMPTY_MATCHES_VIEW_TMPL\
+    "SELECT NULL AS seq_id, NULL AS attributes%s, "\
+    "NULL AS attr_name, NULL AS attr_value WHERE 0"
+
+#define PARTITION_VIEWS_TMPL\
+    "DROP VIEW IF EXISTS " SEQ_SCHEMA_NAME ";"\
+    "DROP VIEW IF EXISTS " ATTR_SCHEMA_NAME ";"\
+    "DROP VIEW IF EXISTS " MATCHES_SCHEMA_NAME ";"\
+    "CREATE VIEW " SEQ_SCHEMA_NAME " AS %s;"\
+    "CREATE VIEW " ATTR_SCHEMA_NAME " AS %s;"\
+    "CREATE VIEW " MATCHES_SCHEMA_NAME " AS %s"
+
+#define DROP_PARTITION_VIEWS_TMPL\
+    "DROP VIEW IF EXISTS " SEQ_SCHEMA_NAME ";"\
+    "DROP VIEW IF EXISTS " ATTR_SCHEMA_NAME ";"\
+    "DROP VIEW IF EXISTS " MATCHES_SCHEMA_NAME ";"\
+    "DROP TABLE IF EXISTS " PARTITIONS_SCHEMA_NAME
+
+/* attributes_optimize rewrites each shadow table a chunk at a time: it reads
+ * the next chunk in key order, deletes it, and inserts it again, which leaves
+ * the chunk packed onto as few pages as it'll fit on.  a chunk is held in
+ * memory while it's rewritten, so it ends after OPTIMIZE_CHUNK_ROWS rows or
+ * once its values add up to OPTIMIZE_CHUNK_BYTES, whichever comes first (a
+ * single row bigger than that is a chunk of its own).  the chunk's table is
+ * "%w_%s", where %s is one of the OPTIMIZE_TABLES */
+#define OPTIMIZE_CHUNK_ROWS  1000
+#define OPTIMIZE_CHUNK_BYTES (4 * 1024 * 1024)
+#define OPTIMIZE_MAX_KEY    3 /* the most key columns of any of them */
+
+#define SELECT_FIRST_CHUNK_TMPL\
+    "SELECT * FROM \"%w\".\"%w_%s\" ORDER BY %s LIMIT %d"
+
+#define SELECT_NEXT_CHUNK_TMPL\
+    "SELECT * FROM \"%w\".\"%w_%s\" WHERE (%s) > (%s) ORDER BY %s LIMIT %d"
+
+#define DELETE_CHUNK_TMPL\
+    "DELETE FROM \"%w\".\"%w_%s\" WHERE (%s) >= (%s) AND (%s) <= (%s)"
+
+#define INSERT_CHUNK_TMPL\
+    "INSERT INTO \"%w\".\"%w_%s\" VALUES (%s)"
+
+#define ANALYZE_TMPL\
+    "ANALYZE \"%w\".\"%w_%s\""
+
+/* how many rows of each index a time-boxed attributes_optimize has ANALYZE
+ * look at (see PRAGMA analysis_limit) */
+#define OPTIMIZE_ANALYSIS_LIMIT 1000
+
+#define DATA_VERSION_TMPL\
+    "PRAGMA \"%w\".data_version"
+
+#define ENCODING_TMPL\
+    "PRAGMA \"%w\".encoding"
+
+#define CONNECT_TABLE_TMPL\
+    "SELECT 1 FROM \"%w\".\"%w\" LIMIT 0"
+
+/* the databases in the order SQLite searches them for an unqualified name */
+#define SELECT_SCHEMAS_SQL\
+    "SELECT name FROM pragma_database_list "\
+    "ORDER BY CASE seq WHEN 1 THEN 0 WHEN 0 THEN 1 ELSE seq END"
 
 #define SCHEMA_PREFIX_SIZE            (sizeof(SCHEMA_PREFIX) - 1)
 #define SCHEMA_SUFFIX_SIZE            (sizeof(SCHEMA_SUFFIX) - 1)
 #define DEFAULT_ATTRIBUTE_COLUMN_SIZE (sizeof(DEFAULT_ATTRIBUTE_COLUMN) - 1)
 
-#define INSERT_SEQ_ATTR_COL 1
-#define INSERT_SEQ_ID_COL   2
+#define INSERT_SEQ_ATTR_COL     1
+#define INSERT_SEQ_ID_COL       2
+#define INSERT_SEQ_PROMOTED_COL 3
 
 #define INSERT_ATTR_SEQ_COL 1
 #define INSERT_ATTR_KEY_COL 2
 #define INSERT_ATTR_VAL_COL 3
 
+#define INSERT_VALUE_COL 1
+
 #define UPDATE_ARG_ROWID 1
 #define UPDATE_ARG_ID    2
 #define UPDATE_ARG_ATTRS 3
 
 #define DELETE_SEQ_ARG_ROWID  1
-#define DELETE_ATTR_ARG_ROWID 1
+
+#define UPDATE_SEQ_ATTR_COL     1
+#define UPDATE_SEQ_PROMOTED_COL 2
+
+#define DELETE_POSTING_KEY_COL 1
+#define DELETE_POSTING_VAL_COL 2
+#define DELETE_POSTING_SEQ_COL 3
 
 #define CURS_SEQ_COL 0
+#define CURS_ATTR_COL 1
+
+#define POSTINGS_SEQ_COL 0
+
+#define INSERT_BLOOM_KEY_COL    1
+#define INSERT_BLOOM_FILTER_COL 2
+
+#define SELECT_BLOOM_KEY_COL    0
+#define SELECT_BLOOM_FILTER_COL 1
 
 #define ATTR_NAME_INDEX 1
+#define PROMOTED_INDEX  2
+#define ID_INDEX        4
+#define GLOB_INDEX      8
+#define SORT_INDEX      16
+#define ORDERED         32
+#define ORDERED_DESC    64
+#define NO_ATTRIBUTES   128 /* the query never reads the attributes column */
+
+/* the column that an ORDERED or ORDERED_DESC plan's rows are ordered by is
+ * stored in idxNum's upper bits */
+#define ORDER_COLUMN_SHIFT 8
+
+/* the constraint op xBestIndex sees for get_attr(attributes, key) in a
+ * WHERE clause */
+#define GET_ATTR_CONSTRAINT SQLITE_INDEX_CONSTRAINT_FUNCTION
+
+/* ...and for glob_attr(attributes, pattern) */
+#define GLOB_ATTR_CONSTRAINT (SQLITE_INDEX_CONSTRAINT_FUNCTION + 1)
+
+#define SCHEMA_ID_COL       0
+#define SCHEMA_ATTR_COL     1
+#define SCHEMA_PROMOTED_COL 2
+
+/* the hidden sort columns follow the promoted columns */
+#define SCHEMA_SORT_KEY_COL(options)   (SCHEMA_PROMOTED_COL + (options)->n_promoted)
+#define SCHEMA_SORT_VALUE_COL(options) (SCHEMA_SORT_KEY_COL(options) + 1)
+
+#define MAX_PROMOTED_COLUMNS 32
+
+#define POSTING_CACHE_BUCKETS 256
+
+/* how many of a key's postings a MATCH cursor reads and sorts at a time */
+#define POSTING_BATCH_SIZE 1024
+
+/* how much of an attribute string is read out of its blob at a time when
+ * it's streamed (see iterate_over_blob_pairs); a key-value pair that doesn't
+ * fit grows the window to fit it */
+#define ATTRIBUTE_WINDOW_SIZE 4096
+
+#define BLOOM_HASHES 4
+
+/* each key's filter is held in memory, so bloom_bits is kept to 2MB a key */
+#define BLOOM_MAX_BITS (1 << 24)
 
-#define SCHEMA_ID_COL   0
-#define SCHEMA_ATTR_COL 1
+#define SNAPSHOT_MAGIC      "ATTRSNAP"
+#define SNAPSHOT_VERSION    1
+#define SNAPSHOT_PAGE_SIZE  4096
+#define SNAPSHOT_BYTE_ORDER 0x01020304
 
 #define UNIMPLD(vtab)\
     __unimplemented(vtab, __FUNCTION__)
@@ -119,19 +519,191 @@ SQLITE_EXTENSION_INIT1;
 static int attributes_disconnect( sqlite3_vtab * );
 static int attributes_destroy( sqlite3_vtab * );
 
+/* the seq_ids of every row matching a single MATCH term, in ascending order.
+ * lists are reference counted so that a cursor may keep iterating over a list
+ * after it has been evicted from the cache */
+struct posting_list {
+    char *term;
+    size_t term_len;
+    sqlite3_int64 *seq_ids;
+    int n_seq_ids;
+    int capacity;
+    int refcount;
+    size_t size;
+    struct posting_list *hash_next;
+    struct posting_list *lru_prev;
+    struct posting_list *lru_next;
+};
+
+/* a size-bounded LRU cache of posting lists, keyed on MATCH term */
+struct posting_cache {
+    size_t budget;
+    size_t used;
+    struct posting_list *buckets[POSTING_CACHE_BUCKETS];
+    struct posting_list *lru_head; /* most recently used */
+    struct posting_list *lru_tail; /* least recently used */
+    sqlite3_int64 hits;
+    sqlite3_int64 misses;
+};
+
+/* counters reported by the attributes_stats table; keep stat_names in sync */
+enum attribute_stat {
+    STAT_FILTERS,
+    STAT_STATEMENTS_PREPARED,
+    STAT_ROWS_READ,
+    STAT_POSTINGS_READ,
+    STAT_MATCH_CALLS,
+    STAT_BLOOM_REJECTS,
+    STAT_ROWS_INSERTED,
+    STAT_ROWS_DELETED,
+    STAT_ROWS_UPDATED,
+    STAT_POSTINGS_WRITTEN,
+    STAT_POSTINGS_DELETED,
+    STAT_FILTER_TIME,
+    STAT_NEXT_TIME,
+    STAT_UPDATE_TIME,
+    N_STATS
+};
+
+static const char * const stat_names[N_STATS] = {
+    "filters",
+    "statements_prepared",
+    "rows_read",
+    "postings_read",
+    "match_calls",
+    "bloom_rejects",
+    "rows_inserted",
+    "rows_deleted",
+    "rows_updated",
+    "postings_written",
+    "postings_deleted",
+    "filter_time",
+    "next_time",
+    "update_time"
+};
+
+/* per-connection state shared by every attribute table on that connection */
+struct attribute_module {
+    struct attribute_vtab *vtabs;
+    sqlite3_int64 stats[N_STATS]; /* totals over every table, past and present */
+};
+
+/* a Bloom filter over the values seen for a single key */
+struct bloom_filter {
+    char *key;
+    size_t key_len;
+    unsigned char *bits;
+    int dirty; /* modified since the last flush to the shadow table */
+    struct bloom_filter *next;
+};
+
+/* every key's Bloom filter; a key that's missing from the set has never been
+ * inserted */
+struct bloom_filter_set {
+    struct bloom_filter **buckets;
+    int n_buckets;
+    int n_filters;
+    size_t n_bits;
+};
+
+/* a key that's stored in its own indexed column of the sequence table */
+struct promoted_column {
+    char *key;
+    size_t key_len;
+    const char *type;
+};
+
+struct attribute_options {
+    size_t cache_size;
+    size_t bloom_bits;
+    int intern_values;
+    int merge; /* duplicate keys resolve to the last value */
+    int large_attributes; /* read attribute strings through blob handles */
+    sqlite3_int64 partition_size; /* ids per partition, or 0 */
+    char *snapshot; /* the snapshot file of a read-only table, or NULL */
+    int n_promoted;
+    struct promoted_column *promoted;
+};
+
+/* what the most recently finished cursor on a table did, for
+ * attributes_explain.  the cursor hands its statement over rather than
+ * finalizing it, so that its SQL and counters are only copied out if
+ * attributes_explain asks for them */
+struct statement_report {
+    char *plan; /* the idxStr from attributes_best_index */
+    sqlite3_stmt *stmt; /* the statement that attributes_filter ran, reset */
+    const char *source; /* where the rows' ids came from */
+};
+
 struct attribute_vtab {
     sqlite3_vtab vtab;
     sqlite3 *db;
     char *database_name;
     char *table_name;
+    struct attribute_module *module;
+    struct attribute_vtab *next;
+    struct attribute_options options;
+    char *select_columns; /* the sequence table columns that make up a row */
+    char *lazy_select_columns; /* the same, with NULL for the attributes */
+    char *value_sql; /* how a value parameter is compared against attr_value */
+    int layout_version;
+    struct posting_cache *cache;
+    struct bloom_filter_set *blooms; /* NULL until loaded */
+    struct snapshot *snapshot; /* read-only tables only */
+    char *snapshot_error; /* why the snapshot couldn't be opened at connect */
+    sqlite3_stmt *data_version_stmt;
+    int data_version;
     sqlite3_stmt *insert_seq_stmt;
     sqlite3_stmt *insert_attr_stmt;
+    sqlite3_stmt *insert_value_stmt;
+    sqlite3_stmt *insert_bloom_stmt;
+    sqlite3_stmt *select_bloom_stmt;
+    sqlite3_stmt *update_seq_stmt;
+    sqlite3_stmt *delete_seq_stmt;
+    sqlite3_stmt *delete_posting_stmt;
+    sqlite3_stmt *select_attrs_stmt;
+    sqlite3_stmt *max_seq_stmt; /* partitioned tables only */
+    sqlite3_stmt *newest_partition_stmt;
+    sqlite3_int64 partition; /* the partition that the statements above use */
+    int has_partition;
+    sqlite3_int64 stats[N_STATS];
+    sqlite3_stmt *row_estimate_stmt;
+    struct statement_report last_statement; /* see attributes_explain */
+    /* where a time-boxed attributes_optimize left off: the partition and
+     * the OPTIMIZE_TABLES entry it was rewriting, and the key of the last row
+     * it rewrote (or NULLs, if it hadn't started on that table) */
+    int optimizing;
+    sqlite3_int64 optimize_partition;
+    int optimize_table;
+    sqlite3_value *optimize_position[OPTIMIZE_MAX_KEY];
 };
 
 struct attribute_cursor {
     sqlite3_vtab_cursor cursor;
     sqlite3_stmt *stmt;
+    char *plan; /* idxStr of the current filter */
+    struct posting_list *postings; /* non-NULL if we're reading from a posting list */
+    int posting_index;
+    sqlite3_stmt *batch_stmt; /* reads the rest of postings' batches, or NULL */
+    int batched; /* postings holds a batch rather than a cached list */
     int eof;
+    char *glob; /* a glob_attr pattern each row is checked against, or NULL */
+    char *sort_key; /* the key given to sort_key in this filter, or NULL */
+    /* stmt selects NULL for the attributes column if lazy_attributes is set,
+     * and each row's attributes are read through blob instead, which is
+     * pointed at the sequence table of blob_partition */
+    int lazy_attributes;
+    sqlite3_blob *blob;
+    sqlite3_int64 blob_partition;
+    /* snapshot tables read rows straight out of the mapping: either every
+     * row in [first_row, last_row), or the rows in a posting list that fall
+     * in that range */
+    const uint32_t *snapshot_postings;
+    sqlite3_int64 snapshot_position;
+    sqlite3_int64 snapshot_end;
+    sqlite3_int64 first_row;
+    sqlite3_int64 last_row;
+    sqlite3_int64 row;
 };
 
 /* Constants for use in iterate_over_kv_pairs */
@@ -140,6 +712,47 @@ struct attribute_cursor {
 
 typedef int (*kv_iter_cb)(const char *, size_t, const char *, size_t, void *);
 
+static void _count(struct attribute_vtab *vtab, enum attribute_stat stat,
+    sqlite3_int64 n)
+{
+    vtab->stats[stat] += n;
+
+    /* the module isn't set until the table is fully connected */
+    if(vtab->module) {
+        vtab->module->stats[stat] += n;
+    }
+}
+
+/* the *_time stats are only collected when built with ATTRIBUTES_TIMING;
+ * they're in TSC cycles on x86 and nanoseconds elsewhere */
+#ifdef ATTRIBUTES_TIMING
+static sqlite3_int64 _timer_now(void)
+{
+#  if defined(__x86_64__) || defined(__i386__)
+    return (sqlite3_int64) __rdtsc();
+#  else
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec * 1000000000ll + ts.tv_nsec;
+#  endif
+}
+
+#  define TIMER_START(start)            sqlite3_int64 start = _timer_now()
+#  define TIMER_STOP(vtab, stat, start) _count( (vtab), (stat), _timer_now() - (start) )
+#else
+#  define TIMER_START(start)
+#  define TIMER_STOP(vtab, stat, start)
+#endif
+
+static int _prepare_statement(struct attribute_vtab *vtab, const char *sql,
+    sqlite3_stmt **stmt)
+{
+    _count( vtab, STAT_STATEMENTS_PREPARED, 1 );
+
+    return sqlite3_prepare_v2( vtab->db, sql, -1, stmt, NULL );
+}
+
 static int ERROR(struct attribute_vtab *vtab, int status)
 {
     vtab->vtab.zErrMsg = sqlite3_mprintf( "%s", sqlite3_errmsg( vtab->db ) );
@@ -158,34 +771,119 @@ static int is_attribute_string(const char *s)
 }
 
 static char *_allocate_sequence_schema_sql(const char *database_name,
-    const char *table_name)
+    const char *table_name, const struct attribute_options *options)
+{
+    char *promoted_columns = sqlite3_mprintf( "%s", "" );
+    char *sql;
+    int i;
+
+    for(i = 0; promoted_columns && i < options->n_promoted; i++) {
+        promoted_columns = sqlite3_mprintf( "%z" SEQ_PROMOTED_COLUMN_TMPL,
+            promoted_columns, options->promoted[i].key,
+            options->promoted[i].type );
+    }
+
+    if(! promoted_columns) {
+        return NULL;
+    }
+
+    sql = sqlite3_mprintf( SEQ_SCHEMA_TMPL, database_name, table_name,
+        promoted_columns );
+    sqlite3_free( promoted_columns );
+
+    return sql;
+}
+
+static char *_allocate_promoted_index_sql(const char *database_name,
+    const char *table_name, int index, const char *key)
 {
-    return sqlite3_mprintf( SEQ_SCHEMA_TMPL, database_name, table_name );
+    return sqlite3_mprintf( PROMOTED_INDEX_TMPL, database_name, table_name,
+        index, table_name, key );
 }
 
 static char *_allocate_attribute_schema_sql(const char *database_name,
+    const char *table_name, const struct attribute_options *options)
+{
+    return sqlite3_mprintf( ATTR_SCHEMA_TMPL, database_name, table_name,
+        options->intern_values ? "INTEGER" : "TEXT" );
+}
+
+static char *_allocate_values_schema_sql(const char *database_name,
     const char *table_name)
 {
-    return sqlite3_mprintf( ATTR_SCHEMA_TMPL, database_name, table_name, table_name );
+    return sqlite3_mprintf( VALUES_SCHEMA_TMPL, database_name, table_name );
 }
 
-static char *_allocate_attribute_index_sql(const char *database_name,
+static char *_allocate_insert_value_sql(const char *database_name,
     const char *table_name)
 {
-    return sqlite3_mprintf( ATTR_INDEX_TMPL, database_name, table_name,
-        table_name );
+    return sqlite3_mprintf( INSERT_VALUE_TMPL, database_name, table_name );
 }
 
-static char *_allocate_insert_sequence_sql(const char *database_name,
+static char *_build_value_sql(const char *database_name,
+    const char *table_name, const struct attribute_options *options)
+{
+    if(options->intern_values) {
+        return sqlite3_mprintf( INTERNED_VALUE_TMPL, database_name, table_name );
+    } else {
+        return sqlite3_mprintf( "%s", "?" );
+    }
+}
+
+static char *_allocate_config_schema_sql(const char *database_name,
     const char *table_name)
 {
-    return sqlite3_mprintf( INSERT_SEQ_TMPL, database_name, table_name );
+    return sqlite3_mprintf( CONFIG_SCHEMA_TMPL, database_name, table_name,
+        database_name, table_name, LAYOUT_VERSION );
 }
 
-static char *_allocate_insert_attribute_sql(const char *database_name,
+static char *_allocate_select_version_sql(const char *database_name,
+    const char *table_name)
+{
+    return sqlite3_mprintf( SELECT_VERSION_TMPL, database_name, table_name );
+}
+
+static char *_allocate_migrate_v1_sql(const char *database_name,
     const char *table_name)
 {
-    return sqlite3_mprintf( INSERT_ATTR_TMPL, database_name, table_name );
+    return sqlite3_mprintf( MIGRATE_V1_TMPL,
+        database_name, table_name,
+        database_name, table_name,
+        database_name, table_name,
+        database_name, table_name,
+        database_name, table_name, table_name,
+        database_name, table_name, database_name, table_name, LAYOUT_VERSION );
+}
+
+static char *_allocate_insert_sequence_sql(const char *database_name,
+    const char *table_name, const struct attribute_options *options)
+{
+    char *promoted_columns = sqlite3_mprintf( "%s", "" );
+    char *placeholders     = sqlite3_mprintf( "%s", "" );
+    char *sql              = NULL;
+    int i;
+
+    for(i = 0; promoted_columns && placeholders && i < options->n_promoted; i++) {
+        promoted_columns = sqlite3_mprintf( "%z, \"%w\"", promoted_columns,
+            options->promoted[i].key );
+        placeholders     = sqlite3_mprintf( "%z, ?", placeholders );
+    }
+
+    if(promoted_columns && placeholders) {
+        sql = sqlite3_mprintf( INSERT_SEQ_TMPL, database_name, table_name,
+            promoted_columns, placeholders );
+    }
+    sqlite3_free( promoted_columns );
+    sqlite3_free( placeholders );
+
+    return sql;
+}
+
+static char *_allocate_insert_attribute_sql(const char *database_name,
+    const char *table_name, const char *value_sql)
+{
+    return sqlite3_mprintf( INSERT_ATTR_TMPL, database_name, table_name,
+        value_sql );
 }
 
 static char *_allocate_delete_sequence_sql(const char *database_name,
@@ -194,30 +892,177 @@ static char *_allocate_delete_sequence_sql(const char *database_name,
     return sqlite3_mprintf( DELETE_SEQ_TMPL, database_name, table_name );
 }
 
-static char *_allocate_delete_attribute_sql(const char *database_name,
+static char *_allocate_update_sequence_sql(const char *database_name,
+    const char *table_name, const struct attribute_options *options)
+{
+    char *assignments = sqlite3_mprintf( "%s", "" );
+    char *sql         = NULL;
+    int i;
+
+    for(i = 0; assignments && i < options->n_promoted; i++) {
+        assignments = sqlite3_mprintf( "%z, \"%w\" = ?", assignments,
+            options->promoted[i].key );
+    }
+
+    if(assignments) {
+        sql = sqlite3_mprintf( UPDATE_SEQ_TMPL, database_name, table_name,
+            assignments );
+    }
+    sqlite3_free( assignments );
+
+    return sql;
+}
+
+static char *_allocate_delete_posting_sql(const char *database_name,
+    const char *table_name, const char *value_sql)
+{
+    return sqlite3_mprintf( DELETE_POSTING_TMPL, database_name, table_name,
+        value_sql );
+}
+
+static char *_allocate_select_sequence_attributes_sql(const char *database_name,
     const char *table_name)
 {
-    return sqlite3_mprintf( DELETE_ATTR_TMPL, database_name, table_name );
+    return sqlite3_mprintf( SELECT_SEQ_ATTRS_TMPL, database_name, table_name );
 }
 
+/* promoted is the promoted column that match's key is stored in, or NULL
+ * if it's stored in the attribute table */
 static char *_allocate_select_cursor_sql(const char *database_name,
-    const char *table_name, const char *match)
+    const char *table_name, const char *columns, const char *value_sql,
+    const char *match, const struct promoted_column *promoted,
+    int partitioned)
 {
-    if(match) {
+    if(match && promoted) {
+        if(is_attribute_string(match) && strcmp( promoted->type, "TEXT" )) {
+            return sqlite3_mprintf( SELECT_CURS_WITH_NUMERIC_PROMOTED_KEY_VALUE_TMPL,
+                columns, database_name, table_name, promoted->key,
+                promoted->key );
+        } else if(is_attribute_string(match)) {
+            return sqlite3_mprintf( SELECT_CURS_WITH_PROMOTED_KEY_VALUE_TMPL,
+                columns, database_name, table_name, promoted->key );
+        } else {
+            return sqlite3_mprintf( SELECT_CURS_WITH_PROMOTED_KEY_TMPL,
+                columns, database_name, table_name, promoted->key );
+        }
+    } else if(match && partitioned) {
+        if(is_attribute_string(match)) {
+            return sqlite3_mprintf( SELECT_PARTITIONED_CURS_WITH_KEY_VALUE_TMPL,
+                columns, database_name, table_name, value_sql );
+        } else {
+            return sqlite3_mprintf( SELECT_PARTITIONED_CURS_WITH_KEY_TMPL,
+                columns, database_name, table_name );
+        }
+    } else if(match) {
         if(is_attribute_string(match)) {
             return sqlite3_mprintf( SELECT_CURS_WITH_KEY_VALUE_TMPL,
-                database_name, table_name,
-                database_name, table_name);
+                columns, database_name, table_name,
+                database_name, table_name, value_sql );
         } else {
             return sqlite3_mprintf( SELECT_CURS_WITH_KEY_TMPL,
-                database_name, table_name,
+                columns, database_name, table_name,
                 database_name, table_name);
         }
     } else {
-        return sqlite3_mprintf( SELECT_CURS_TMPL, database_name, table_name );
+        return sqlite3_mprintf( SELECT_CURS_TMPL, columns, database_name,
+            table_name );
     }
 }
 
+/* the query for a sort_key plan: the rows that have key, each followed by
+ * its value for key.  promoted is the promoted column that key is stored in,
+ * or NULL */
+static char *_allocate_select_sorted_sql(const char *database_name,
+    const char *table_name, const char *columns,
+    const struct promoted_column *promoted, int interned, int partitioned)
+{
+    if(promoted) {
+        return sqlite3_mprintf( SELECT_PROMOTED_SORTED_CURS_TMPL, columns,
+            promoted->key, database_name, table_name, promoted->key );
+    } else if(partitioned && interned) {
+        return sqlite3_mprintf( SELECT_PARTITIONED_INTERNED_SORTED_CURS_TMPL,
+            columns, database_name, table_name, database_name, table_name );
+    } else if(partitioned) {
+        return sqlite3_mprintf( SELECT_PARTITIONED_SORTED_CURS_TMPL,
+            columns, database_name, table_name );
+    } else if(interned) {
+        return sqlite3_mprintf( SELECT_INTERNED_SORTED_CURS_TMPL, columns,
+            database_name, table_name, database_name, table_name,
+            database_name, table_name );
+    } else {
+        return sqlite3_mprintf( SELECT_SORTED_CURS_TMPL, columns,
+            database_name, table_name, database_name, table_name );
+    }
+}
+
+static char *_allocate_select_postings_sql(const char *database_name,
+    const char *table_name, const char *value_sql, const char *match,
+    const struct promoted_column *promoted)
+{
+    if(promoted) {
+        if(is_attribute_string(match) && strcmp( promoted->type, "TEXT" )) {
+            return sqlite3_mprintf( SELECT_POSTINGS_WITH_NUMERIC_PROMOTED_KEY_VALUE_TMPL,
+                database_name, table_name, promoted->key, promoted->key );
+        } else if(is_attribute_string(match)) {
+            return sqlite3_mprintf( SELECT_POSTINGS_WITH_PROMOTED_KEY_VALUE_TMPL,
+                database_name, table_name, promoted->key );
+        } else {
+            return sqlite3_mprintf( SELECT_POSTINGS_WITH_PROMOTED_KEY_TMPL,
+                database_name, table_name, promoted->key );
+        }
+    } else if(is_attribute_string(match)) {
+        return sqlite3_mprintf( SELECT_POSTINGS_WITH_KEY_VALUE_TMPL,
+            database_name, table_name, value_sql );
+    } else {
+        return sqlite3_mprintf( SELECT_POSTINGS_WITH_KEY_TMPL,
+            database_name, table_name );
+    }
+}
+
+static char *_allocate_select_posting_batches_sql(const char *database_name,
+    const char *table_name)
+{
+    return sqlite3_mprintf( SELECT_POSTING_BATCHES_WITH_KEY_TMPL,
+        database_name, table_name );
+}
+
+static char *_allocate_select_sequence_by_id_sql(const char *database_name,
+    const char *table_name, const char *columns)
+{
+    return sqlite3_mprintf( SELECT_SEQ_BY_ID_TMPL, columns, database_name,
+        table_name );
+}
+
+static char *_allocate_select_export_sql(const char *database_name,
+    const char *table_name)
+{
+    return sqlite3_mprintf( SELECT_EXPORT_TMPL, database_name, table_name );
+}
+
+static char *_allocate_bloom_schema_sql(const char *database_name,
+    const char *table_name)
+{
+    return sqlite3_mprintf( BLOOM_SCHEMA_TMPL, database_name, table_name );
+}
+
+static char *_allocate_select_bloom_sql(const char *database_name,
+    const char *table_name)
+{
+    return sqlite3_mprintf( SELECT_BLOOM_TMPL, database_name, table_name );
+}
+
+static char *_allocate_insert_bloom_sql(const char *database_name,
+    const char *table_name)
+{
+    return sqlite3_mprintf( INSERT_BLOOM_TMPL, database_name, table_name );
+}
+
+static char *_allocate_select_bloom_filter_sql(const char *database_name,
+    const char *table_name)
+{
+    return sqlite3_mprintf( SELECT_BLOOM_FILTER_TMPL, database_name, table_name );
+}
+
 static char *_allocate_drop_sequence_schema_sql(const char *database_name,
     const char *table_name)
 {
@@ -232,323 +1077,3495 @@ static char *_allocate_drop_attribute_schema_sql(const char *database_name,
         table_name );
 }
 
-/* key-value pairs are separated by RECORD_SEPARATOR, and each member of the pair
- * is also separated by RECORD_SEPARATOR.  So the layout of attributes looks kind of
- * like this:
- *
- * key1 RS value1 RS key2 RS value2 RS key3 RS value3
- */
-static const char *extract_attribute_value(const char *attributes, const char *key, size_t *value_len)
+static char *_allocate_drop_config_schema_sql(const char *database_name,
+    const char *table_name)
 {
-    char *needle;
-    const char *attr_location = NULL;
-    size_t key_len;
+    return sqlite3_mprintf( "DROP TABLE IF EXISTS " CONFIG_SCHEMA_NAME,
+        database_name, table_name );
+}
 
-    key_len = strlen( key );
-    needle  = sqlite3_malloc( key_len + 3 ); /* one for NULL, one for
-                                                record separator */
+static char *_allocate_drop_values_schema_sql(const char *database_name,
+    const char *table_name)
+{
+    return sqlite3_mprintf( "DROP TABLE IF EXISTS " VALUES_SCHEMA_NAME,
+        database_name, table_name );
+}
 
-    if(! needle) {
-        return NULL;
-    }
+static char *_allocate_drop_bloom_schema_sql(const char *database_name,
+    const char *table_name)
+{
+    return sqlite3_mprintf( "DROP TABLE IF EXISTS " BLOOM_SCHEMA_NAME,
+        database_name, table_name );
+}
 
-    needle[0] = RECORD_SEPARATOR;
-    strcpy(needle + 1, key);
-    needle[key_len + 1] = RECORD_SEPARATOR;
-    needle[key_len + 2] = '\0';
+static char *_allocate_partition_name(const char *table_name,
+    sqlite3_int64 partition)
+{
+    return sqlite3_mprintf( PARTITION_NAME_TMPL, table_name,
+        (long long) partition );
+}
 
-    if(! strncmp( attributes, needle + 1, key_len + 1 )) {
-        attr_location = attributes + key_len + 1;
-    }
+static char *_allocate_partitions_schema_sql(const char *database_name,
+    const char *table_name)
+{
+    return sqlite3_mprintf( PARTITIONS_SCHEMA_TMPL, database_name, table_name );
+}
 
-    if(! attr_location) {
-        attr_location = strstr( attributes, needle );
-        if(attr_location) {
-            attr_location += key_len + 2;
-        }
-    }
+static char *_allocate_select_partitions_sql(const char *database_name,
+    const char *table_name)
+{
+    return sqlite3_mprintf( SELECT_PARTITIONS_TMPL, database_name, table_name );
+}
 
-    if(attr_location) {
-        const char *attr_end;
+static char *_allocate_select_partition_sql(const char *database_name,
+    const char *table_name)
+{
+    return sqlite3_mprintf( SELECT_PARTITION_TMPL, database_name, table_name );
+}
 
-        attr_end = strchr( attr_location, RECORD_SEPARATOR );
-        if(! attr_end) {
-            attr_end = attr_location + strlen( attr_location ); /* end of string */
-        }
-        *value_len = attr_end - attr_location;
-        return attr_location;
-    } else {
+static char *_allocate_select_newest_partition_sql(const char *database_name,
+    const char *table_name)
+{
+    return sqlite3_mprintf( SELECT_NEWEST_PARTITION_TMPL, database_name,
+        table_name );
+}
+
+static char *_allocate_insert_partition_sql(const char *database_name,
+    const char *table_name, sqlite3_int64 partition)
+{
+    return sqlite3_mprintf( INSERT_PARTITION_TMPL, database_name, table_name,
+        (long long) partition );
+}
+
+static char *_allocate_drop_partition_sql(const char *database_name,
+    const char *table_name, sqlite3_int64 partition)
+{
+    char *partition_name = _allocate_partition_name( table_name, partition );
+    char *sql;
+
+    if(! partition_name) {
         return NULL;
     }
+
+    sql = sqlite3_mprintf( DROP_PARTITION_TMPL,
+        database_name, partition_name,
+        database_name, partition_name,
+        database_name, table_name, (long long) partition );
+    sqlite3_free( partition_name );
+
+    return sql;
 }
 
-static void iterate_over_kv_pairs( const char *attributes,
-    kv_iter_cb callback, void *udata )
+static char *_allocate_select_max_seq_id_sql(const char *database_name,
+    const char *table_name)
 {
-    const char *key_endp;
-    int status;
+    return sqlite3_mprintf( SELECT_MAX_SEQ_ID_TMPL, database_name, table_name );
+}
 
-    while(key_endp = strchr( attributes, RECORD_SEPARATOR )) {
-        const char *key;
-        const char *value;
-        const char *value_endp;
-        size_t key_length;
-        size_t value_length;
+/* builds the views over partitions (which must be sorted) */
+static char *_allocate_partition_views_sql(const char *database_name,
+    const char *table_name, const struct attribute_options *options,
+    const sqlite3_int64 *partitions, int n_partitions)
+{
+    char *seq_view     = NULL;
+    char *attr_view    = NULL;
+    char *matches_view = NULL;
+    char *sql          = NULL;
+    int ok             = 1;
+    int i;
 
-        value_endp = strchr( key_endp + 1, RECORD_SEPARATOR );
+    for(i = 0; ok && i < n_partitions; i++) {
+        char *partition_name = _allocate_partition_name( table_name,
+            partitions[i] );
+        long long first = partitions[i] * options->partition_size;
+        long long end   = first + options->partition_size;
 
-        if(! value_endp) {
-            value_endp = key_endp + strlen(key_endp); /* end of string */
+        if(! partition_name) {
+            ok = 0;
+            break;
         }
 
-        key          = attributes;
-        key_length   = key_endp - key;
-        value        = key_endp + 1;
-        value_length = value_endp - value;
+        seq_view     = sqlite3_mprintf( "%z%s" PARTITION_SEQ_BRANCH_TMPL,
+            seq_view, i ? " UNION ALL " : "", partition_name, first, end );
+        attr_view    = sqlite3_mprintf( "%z%s" PARTITION_ATTR_BRANCH_TMPL,
+            attr_view, i ? " UNION ALL " : "", partition_name, first, end );
+        matches_view = sqlite3_mprintf( "%z%s" PARTITION_MATCHES_BRANCH_TMPL,
+            matches_view, i ? " UNION ALL " : "", partition_name,
+            partition_name, first, end );
+        sqlite3_free( partition_name );
 
-        status = callback( key, key_length, value, value_length, udata );
+        ok = seq_view && attr_view && matches_view;
+    }
 
-        if(status == BREAK) {
-            break;
+    if(ok && ! n_partitions) {
+        char *promoted_columns = sqlite3_mprintf( "%s", "" );
+
+        for(i = 0; promoted_columns && i < options->n_promoted; i++) {
+            promoted_columns = sqlite3_mprintf( "%z, NULL AS \"%w\"",
+                promoted_columns, options->promoted[i].key );
         }
 
-        if(*value_endp == RECORD_SEPARATOR) {
-            attributes = value_endp + 1;
-        } else {
-            break;
+        if(promoted_columns) {
+            seq_view     = sqlite3_mprintf( EMPTY_SEQ_VIEW_TMPL, promoted_columns );
+            attr_view    = sqlite3_mprintf( "%s", EMPTY_ATTR_VIEW );
+            matches_view = sqlite3_mprintf( EMPTY_MATCHES_VIEW_TMPL, promoted_columns );
         }
+        sqlite3_free( promoted_columns );
+
+        ok = seq_view && attr_view && matches_view;
+    }
+
+    if(ok) {
+        sql = sqlite3_mprintf( PARTITION_VIEWS_TMPL,
+            database_name, table_name,
+            database_name, table_name,
+            database_name, table_name,
+            database_name, table_name, seq_view,
+            database_name, table_name, attr_view,
+            database_name, table_name, matches_view );
     }
+    sqlite3_free( seq_view );
+    sqlite3_free( attr_view );
+    sqlite3_free( matches_view );
 
+    return sql;
 }
 
-static void sql_get_attr( sqlite3_context *ctx, int nargs,
-    sqlite3_value **values )
+static char *_allocate_drop_partition_views_sql(const char *database_name,
+    const char *table_name)
 {
-    const char *attributes;
-    const char *attr_name;
-    const char *attr_value;
-    size_t value_length;
+    return sqlite3_mprintf( DROP_PARTITION_VIEWS_TMPL,
+        database_name, table_name,
+        database_name, table_name,
+        database_name, table_name,
+        database_name, table_name );
+}
 
-    if(sqlite3_value_type( values[0] ) != SQLITE_TEXT) {
-        sqlite3_result_error( ctx, "attribute operand must be a string", -1 );
-        return;
-    }
+/* the shadow tables that attributes_optimize rewrites, in the order that it
+ * rewrites them, along with the columns that each is clustered on; the key
+ * columns come first in each table, so they lead each row of SELECT * */
+struct optimize_table {
+    const char *suffix;
+    const char *key;
+    int n_key;
+};
 
-    if(sqlite3_value_type( values[1] ) == SQLITE_NULL) {
-        sqlite3_result_error( ctx, "query operand must not be NULL", -1 );
-        return;
-    }
+static const struct optimize_table OPTIMIZE_TABLES[] = {
+    { "Attributes", "attr_name, attr_value, seq_id", 3 },
+    { "Sequence",   "seq_id",                        1 },
+};
 
-    attributes = sqlite3_value_text( values[0] );
-    attr_name  = sqlite3_value_text( values[1] );
-    attr_value = extract_attribute_value( attributes, attr_name,
-        &value_length );
+#define N_OPTIMIZE_TABLES (sizeof(OPTIMIZE_TABLES) / sizeof(OPTIMIZE_TABLES[0]))
 
-    if(attr_value) {
-        sqlite3_result_text( ctx, attr_value, value_length, SQLITE_TRANSIENT );
-    } else {
-        sqlite3_result_null( ctx );
+/* returns "?first, ?first+1, ..." with n parameters */
+static char *_allocate_parameter_list(int first, int n)
+{
+    char *list = sqlite3_mprintf( "?%d", first );
+    int i;
+
+    for(i = 1; list && i < n; i++) {
+        list = sqlite3_mprintf( "%z, ?%d", list, first + i );
     }
-}
 
-static char *_build_schema( int argc, const char * const *argv )
-{
-    return sqlite3_mprintf("%s", VIRT_TABLE_SCHEMA);
+    return list;
 }
 
-/* we don't need to worry about cleanup of vtab in this function;
- * the caller should handle it! */
-static int _initialize_statements( struct attribute_vtab *vtab )
+static char *_allocate_select_chunk_sql(const char *database_name,
+    const char *base_name, const struct optimize_table *table, int resuming)
 {
+    char *parameters;
     char *sql;
-    int status;
-
-    sql = _allocate_insert_sequence_sql( vtab->database_name, vtab->table_name );
 
-    if(! sql) {
-        return SQLITE_NOMEM;
+    if(! resuming) {
+        return sqlite3_mprintf( SELECT_FIRST_CHUNK_TMPL, database_name,
+            base_name, table->suffix, table->key, OPTIMIZE_CHUNK_ROWS );
     }
 
-    status = sqlite3_prepare_v2( vtab->db, sql, -1, &(vtab->insert_seq_stmt), NULL );
+    parameters = _allocate_parameter_list( 1, table->n_key );
+    if(! parameters) {
+        return NULL;
+    }
 
-    sqlite3_free( sql );
+    sql = sqlite3_mprintf( SELECT_NEXT_CHUNK_TMPL, database_name, base_name,
+        table->suffix, table->key, parameters, table->key,
+        OPTIMIZE_CHUNK_ROWS );
+    sqlite3_free( parameters );
 
-    if(status != SQLITE_OK) {
-        return status;
-    }
+    return sql;
+}
 
-    sql = _allocate_insert_attribute_sql( vtab->database_name,
-        vtab->table_name );
+static char *_allocate_delete_chunk_sql(const char *database_name,
+    const char *base_name, const struct optimize_table *table)
+{
+    char *first = _allocate_parameter_list( 1, table->n_key );
+    char *last  = _allocate_parameter_list( table->n_key + 1, table->n_key );
+    char *sql   = NULL;
 
-    if(! sql) {
-        return SQLITE_NOMEM;
+    if(first && last) {
+        sql = sqlite3_mprintf( DELETE_CHUNK_TMPL, database_name, base_name,
+            table->suffix, table->key, first, table->key, last );
     }
+    sqlite3_free( first );
+    sqlite3_free( last );
 
-    status = sqlite3_prepare_v2( vtab->db, sql, -1, &(vtab->insert_attr_stmt), NULL );
+    return sql;
+}
 
-    sqlite3_free( sql );
+static char *_allocate_insert_chunk_sql(const char *database_name,
+    const char *base_name, const struct optimize_table *table, int n_columns)
+{
+    char *parameters = _allocate_parameter_list( 1, n_columns );
+    char *sql;
 
-    if(status != SQLITE_OK) {
-        return status;
+    if(! parameters) {
+        return NULL;
     }
 
-    return SQLITE_OK;
+    sql = sqlite3_mprintf( INSERT_CHUNK_TMPL, database_name, base_name,
+        table->suffix, parameters );
+    sqlite3_free( parameters );
+
+    return sql;
 }
 
-static int _init_vtab( sqlite3 *db, void *udp, int argc,
-    char const * const *argv, sqlite3_vtab **vtab, char **errMsg,
-    int initStmts )
+static char *_allocate_analyze_sql(const char *database_name,
+    const char *base_name, const char *suffix)
 {
-    char *sql;
-    struct attribute_vtab *avtab;
-    int status;
+    return sqlite3_mprintf( ANALYZE_TMPL, database_name, base_name, suffix );
+}
 
-    *vtab   = NULL;
-    *errMsg = NULL;
+static unsigned int _hash_term(const char *term, size_t term_len)
+{
+    unsigned int hash = 2166136261u; /* FNV-1a */
+    size_t i;
 
-    avtab = (struct attribute_vtab *) sqlite3_malloc(sizeof(struct attribute_vtab));
-    if(! avtab) {
-        return SQLITE_NOMEM;
+    for(i = 0; i < term_len; i++) {
+        hash ^= (unsigned char) term[i];
+        hash *= 16777619u;
     }
-    memset(avtab, 0, sizeof(struct attribute_vtab));
-    avtab->db = db;
 
-    avtab->database_name = sqlite3_mprintf( "%s", argv[1] );
-    if(! avtab->database_name) {
-        attributes_disconnect((sqlite3_vtab *) avtab);
-        return SQLITE_NOMEM;
-    }
+    return hash;
+}
 
-    avtab->table_name = sqlite3_mprintf( "%s", argv[2] );
-    if(! avtab->table_name) {
-        attributes_disconnect((sqlite3_vtab *) avtab);
-        return SQLITE_NOMEM;
-    }
+static struct posting_list *posting_list_new(const char *term, size_t term_len)
+{
+    struct posting_list *list;
 
-    sql = _build_schema(argc - 3, argv + 3);
-    if(! sql) {
-        attributes_disconnect((sqlite3_vtab *) avtab);
-        return SQLITE_NOMEM;
+    list = sqlite3_malloc( sizeof(struct posting_list) + term_len + 1 );
+    if(! list) {
+        return NULL;
     }
+    memset( list, 0, sizeof(struct posting_list) );
 
-    status = sqlite3_declare_vtab( db, sql );
-    sqlite3_free(sql);
+    list->term     = (char *) (list + 1);
+    list->term_len = term_len;
+    list->refcount = 1;
+    memcpy( list->term, term, term_len );
+    list->term[term_len] = '\0';
 
-    if(status != SQLITE_OK) {
-        ERROR( avtab, status );
-        *errMsg = avtab->vtab.zErrMsg;
-        attributes_disconnect((sqlite3_vtab *) avtab);
-        return status;
+    return list;
+}
+
+static void posting_list_release(struct posting_list *list)
+{
+    if(list && --list->refcount == 0) {
+        sqlite3_free( list->seq_ids );
+        sqlite3_free( list );
     }
+}
 
-    if(initStmts) {
-        status = _initialize_statements( avtab );
+static size_t posting_list_size(struct posting_list *list)
+{
+    return sizeof(struct posting_list) + list->term_len + 1 +
+        list->capacity * sizeof(sqlite3_int64);
+}
 
-        if(status != SQLITE_OK) {
-            ERROR( avtab, status );
-            *errMsg = avtab->vtab.zErrMsg;
-            attributes_disconnect((sqlite3_vtab *) avtab);
-            return status;
+static int posting_list_append(struct posting_list *list, sqlite3_int64 seq_id)
+{
+    if(list->n_seq_ids == list->capacity) {
+        int new_capacity = list->capacity ? list->capacity * 2 : 16;
+        sqlite3_int64 *seq_ids;
+
+        seq_ids = sqlite3_realloc( list->seq_ids,
+            new_capacity * sizeof(sqlite3_int64) );
+        if(! seq_ids) {
+            return SQLITE_NOMEM;
         }
+        list->seq_ids  = seq_ids;
+        list->capacity = new_capacity;
     }
-
-    *vtab = (sqlite3_vtab *) avtab;
+    list->seq_ids[list->n_seq_ids++] = seq_id;
 
     return SQLITE_OK;
 }
 
-static int attributes_connect( sqlite3 *db, void *udp, int argc,
-    char const * const *argv, sqlite3_vtab **vtab, char **errMsg )
+/* returns the index of the first seq_id in list that is >= seq_id */
+static int posting_list_search(struct posting_list *list, sqlite3_int64 seq_id)
 {
-    return _init_vtab( db, udp, argc, argv, vtab, errMsg, 1 );
+    int low  = 0;
+    int high = list->n_seq_ids;
+
+    while(low < high) {
+        int middle = low + (high - low) / 2;
+
+        if(list->seq_ids[middle] < seq_id) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return low;
 }
 
-static int attributes_create( sqlite3 *db, void *udp, int argc,
-    char const * const *argv, sqlite3_vtab **vtab, char **errMsg )
+static struct posting_cache *posting_cache_new(size_t budget)
 {
-    const char *database_name = argv[1];
-    const char *table_name    = argv[2];
-    char *sql                 = NULL;
+    struct posting_cache *cache;
 
-    int status = _init_vtab( db, udp, argc, argv, vtab, errMsg, 0 );
-
-    if(status != SQLITE_OK) {
-        goto error_handler;
+    cache = sqlite3_malloc( sizeof(struct posting_cache) );
+    if(! cache) {
+        return NULL;
     }
+    memset( cache, 0, sizeof(struct posting_cache) );
+    cache->budget = budget;
 
-    sql = _allocate_sequence_schema_sql( database_name, table_name );
+    return cache;
+}
 
-    if(! sql) {
-        status = SQLITE_NOMEM;
-        goto error_handler;
+static void _posting_cache_unlink(struct posting_cache *cache,
+    struct posting_list *list)
+{
+    struct posting_list **p;
+
+    p = cache->buckets + (_hash_term( list->term, list->term_len ) % POSTING_CACHE_BUCKETS);
+    while(*p != list) {
+        p = &((*p)->hash_next);
     }
+    *p = list->hash_next;
 
-    status = sqlite3_exec( db, sql, NULL, NULL, errMsg );
+    if(list->lru_prev) {
+        list->lru_prev->lru_next = list->lru_next;
+    } else {
+        cache->lru_head = list->lru_next;
+    }
+    if(list->lru_next) {
+        list->lru_next->lru_prev = list->lru_prev;
+    } else {
+        cache->lru_tail = list->lru_prev;
+    }
 
-    if(status != SQLITE_OK) {
-        goto error_handler;
+    cache->used -= list->size;
+    posting_list_release( list );
+}
+
+static void posting_cache_clear(struct posting_cache *cache)
+{
+    if(! cache) {
+        return;
+    }
+    while(cache->lru_head) {
+        _posting_cache_unlink( cache, cache->lru_head );
     }
+}
 
-    sqlite3_free( sql );
+static void posting_cache_free(struct posting_cache *cache)
+{
+    posting_cache_clear( cache );
+    sqlite3_free( cache );
+}
 
-    sql = _allocate_attribute_schema_sql( database_name, table_name );
+static struct posting_list *_posting_cache_find(struct posting_cache *cache,
+    const char *term, size_t term_len)
+{
+    struct posting_list *list;
 
-    if(! sql) {
-        status = SQLITE_NOMEM;
-        goto error_handler;
+    list = cache->buckets[_hash_term( term, term_len ) % POSTING_CACHE_BUCKETS];
+    while(list) {
+        if(list->term_len == term_len && !memcmp( list->term, term, term_len )) {
+            return list;
+        }
+        list = list->hash_next;
     }
 
-    status = sqlite3_exec( db, sql, NULL, NULL, errMsg );
+    return NULL;
+}
 
-    if(status != SQLITE_OK) {
-        goto error_handler;
+/* returns a new reference to the cached list for term, or NULL on a miss */
+static struct posting_list *posting_cache_lookup(struct posting_cache *cache,
+    const char *term, size_t term_len)
+{
+    struct posting_list *list = _posting_cache_find( cache, term, term_len );
+
+    if(! list) {
+        cache->misses++;
+        return NULL;
     }
+    cache->hits++;
 
-    sqlite3_free( sql );
+    if(list != cache->lru_head) { /* move to the front of the LRU list */
+        list->lru_prev->lru_next = list->lru_next;
+        if(list->lru_next) {
+            list->lru_next->lru_prev = list->lru_prev;
+        } else {
+            cache->lru_tail = list->lru_prev;
+        }
+        list->lru_prev = NULL;
+        list->lru_next = cache->lru_head;
+        cache->lru_head->lru_prev = list;
+        cache->lru_head = list;
+    }
+    list->refcount++;
 
-    sql = _allocate_attribute_index_sql( database_name, table_name );
+    return list;
+}
 
-    if(! sql) {
-        status = SQLITE_NOMEM;
-        goto error_handler;
+/* the cache takes its own reference to list; lists that can't fit in the
+ * budget are silently not cached */
+static void posting_cache_insert(struct posting_cache *cache,
+    struct posting_list *list)
+{
+    struct posting_list **bucket;
+
+    list->size = posting_list_size( list );
+    if(list->size > cache->budget) {
+        return;
     }
 
-    status = sqlite3_exec( db, sql, NULL, NULL, errMsg );
+    while(cache->used + list->size > cache->budget) {
+        _posting_cache_unlink( cache, cache->lru_tail );
+    }
 
-    if(status != SQLITE_OK) {
-        goto error_handler;
+    bucket = cache->buckets + (_hash_term( list->term, list->term_len ) % POSTING_CACHE_BUCKETS);
+    list->hash_next = *bucket;
+    *bucket         = list;
+
+    list->lru_prev = NULL;
+    list->lru_next = cache->lru_head;
+    if(cache->lru_head) {
+        cache->lru_head->lru_prev = list;
+    } else {
+        cache->lru_tail = list;
     }
+    cache->lru_head = list;
 
-    sqlite3_free( sql );
+    cache->used += list->size;
+    list->refcount++;
+}
 
-    sql = NULL;
+/* patches the cached list for term (if any) to include a newly written row.
+ * lists that can no longer be patched in place are dropped instead */
+static void posting_cache_add_seq_id(struct posting_cache *cache,
+    const char *term, size_t term_len, sqlite3_int64 seq_id)
+{
+    struct posting_list *list = _posting_cache_find( cache, term, term_len );
+    int index;
 
-    status = _initialize_statements( (struct attribute_vtab *) *vtab );
+    if(! list) {
+        return;
+    }
 
-    if(status != SQLITE_OK) {
-        goto error_handler;
+    if(list->refcount > 1 || posting_list_append( list, seq_id ) != SQLITE_OK) {
+        /* a cursor is iterating over this list; don't move it out from
+         * under it */
+        _posting_cache_unlink( cache, list );
+        return;
     }
 
-    goto done;
+    index = posting_list_search( list, seq_id );
+    memmove( list->seq_ids + index + 1, list->seq_ids + index,
+        (list->n_seq_ids - index - 1) * sizeof(sqlite3_int64) );
+    list->seq_ids[index] = seq_id;
 
-error_handler:
-    if(sql) {
-        sqlite3_free( sql );
-    }
-    if(*vtab) {
-        attributes_destroy( *vtab );
+    cache->used -= list->size;
+    list->size   = posting_list_size( list );
+    cache->used += list->size;
+
+    while(cache->used > cache->budget) {
+        _posting_cache_unlink( cache, cache->lru_tail );
     }
-    *errMsg = sqlite3_mprintf( "%s", sqlite3_errmsg( db ) );
-done:
-    return status;
 }
 
-static int attributes_disconnect( sqlite3_vtab *_vtab )
+/* removes a row from the cached list for term (if any), for when a single
+ * attribute of the row changes */
+static void posting_cache_remove_term_seq_id(struct posting_cache *cache,
+    const char *term, size_t term_len, sqlite3_int64 seq_id)
 {
-    struct attribute_vtab *vtab = (struct attribute_vtab *) _vtab;
+    struct posting_list *list = _posting_cache_find( cache, term, term_len );
+    int index;
 
-    sqlite3_finalize( vtab->insert_attr_stmt );
+    if(! list) {
+        return;
+    }
+
+    index = posting_list_search( list, seq_id );
+
+    if(index < list->n_seq_ids && list->seq_ids[index] == seq_id) {
+        if(list->refcount > 1) {
+            _posting_cache_unlink( cache, list );
+        } else {
+            memmove( list->seq_ids + index, list->seq_ids + index + 1,
+                (list->n_seq_ids - index - 1) * sizeof(sqlite3_int64) );
+            list->n_seq_ids--;
+        }
+    }
+}
+
+static sqlite3_uint64 _bloom_hash(const char *data, size_t len,
+    sqlite3_uint64 seed)
+{
+    sqlite3_uint64 hash = 14695981039346656037ull ^ seed; /* FNV-1a */
+    size_t i;
+
+    for(i = 0; i < len; i++) {
+        hash ^= (unsigned char) data[i];
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+static struct bloom_filter_set *bloom_set_new(size_t n_bits)
+{
+    struct bloom_filter_set *set;
+
+    set = sqlite3_malloc( sizeof(struct bloom_filter_set) );
+    if(! set) {
+        return NULL;
+    }
+    memset( set, 0, sizeof(struct bloom_filter_set) );
+    set->n_bits = n_bits;
+
+    return set;
+}
+
+static void bloom_set_free(struct bloom_filter_set *set)
+{
+    int i;
+
+    if(! set) {
+        return;
+    }
+
+    for(i = 0; i < set->n_buckets; i++) {
+        struct bloom_filter *filter = set->buckets[i];
+
+        while(filter) {
+            struct bloom_filter *next = filter->next;
+
+            sqlite3_free( filter );
+            filter = next;
+        }
+    }
+    sqlite3_free( set->buckets );
+    sqlite3_free( set );
+}
+
+static struct bloom_filter *bloom_set_find(struct bloom_filter_set *set,
+    const char *key, size_t key_len)
+{
+    struct bloom_filter *filter;
+
+    if(! set->n_buckets) {
+        return NULL;
+    }
+
+    filter = set->buckets[_hash_term( key, key_len ) % set->n_buckets];
+    while(filter) {
+        if(filter->key_len == key_len && !memcmp( filter->key, key, key_len )) {
+            return filter;
+        }
+        filter = filter->next;
+    }
+
+    return NULL;
+}
+
+static int _bloom_set_grow(struct bloom_filter_set *set)
+{
+    int n_buckets = set->n_buckets ? set->n_buckets * 2 : 64;
+    struct bloom_filter **buckets;
+    int i;
+
+    buckets = sqlite3_malloc( n_buckets * sizeof(struct bloom_filter *) );
+    if(! buckets) {
+        return SQLITE_NOMEM;
+    }
+    memset( buckets, 0, n_buckets * sizeof(struct bloom_filter *) );
+
+    for(i = 0; i < set->n_buckets; i++) {
+        struct bloom_filter *filter = set->buckets[i];
+
+        while(filter) {
+            struct bloom_filter *next = filter->next;
+            int bucket = _hash_term( filter->key, filter->key_len ) % n_buckets;
+
+            filter->next     = buckets[bucket];
+            buckets[bucket]  = filter;
+            filter           = next;
+        }
+    }
+
+    sqlite3_free( set->buckets );
+    set->buckets   = buckets;
+    set->n_buckets = n_buckets;
+
+    return SQLITE_OK;
+}
+
+/* bits may be NULL, in which case the new filter starts out empty */
+static struct bloom_filter *bloom_set_add_filter(struct bloom_filter_set *set,
+    const char *key, size_t key_len, const unsigned char *bits)
+{
+    struct bloom_filter *filter;
+    size_t n_bytes = set->n_bits / 8;
+    int bucket;
+
+    if(n_bytes > BLOOM_MAX_BITS / 8) {
+        return NULL;
+    }
+
+    if(set->n_filters >= set->n_buckets * 2) {
+        if(_bloom_set_grow( set ) != SQLITE_OK) {
+            return NULL;
+        }
+    }
+
+    filter = sqlite3_malloc64( (sqlite3_uint64) sizeof(struct bloom_filter) +
+        n_bytes + key_len + 1 );
+    if(! filter) {
+        return NULL;
+    }
+
+    filter->bits    = (unsigned char *) (filter + 1);
+    filter->key     = (char *) (filter->bits + n_bytes);
+    filter->key_len = key_len;
+    filter->dirty   = 0;
+    memcpy( filter->key, key, key_len );
+    filter->key[key_len] = '\0';
+
+    if(bits) {
+        memcpy( filter->bits, bits, n_bytes );
+    } else {
+        memset( filter->bits, 0, n_bytes );
+    }
+
+    bucket = _hash_term( key, key_len ) % set->n_buckets;
+    filter->next         = set->buckets[bucket];
+    set->buckets[bucket] = filter;
+    set->n_filters++;
+
+    return filter;
+}
+
+static void bloom_filter_add(struct bloom_filter_set *set,
+    struct bloom_filter *filter, const char *value, size_t value_len)
+{
+    sqlite3_uint64 h1 = _bloom_hash( value, value_len, 0 );
+    sqlite3_uint64 h2 = _bloom_hash( value, value_len, 0x9e3779b97f4a7c15ull ) | 1;
+    int i;
+
+    for(i = 0; i < BLOOM_HASHES; i++) {
+        size_t bit = (h1 + i * h2) % set->n_bits;
+
+        if(! (filter->bits[bit / 8] & (1 << (bit % 8)))) {
+            filter->bits[bit / 8] |= 1 << (bit % 8);
+            filter->dirty = 1;
+        }
+    }
+}
+
+static int bloom_filter_may_contain(struct bloom_filter_set *set,
+    struct bloom_filter *filter, const char *value, size_t value_len)
+{
+    sqlite3_uint64 h1 = _bloom_hash( value, value_len, 0 );
+    sqlite3_uint64 h2 = _bloom_hash( value, value_len, 0x9e3779b97f4a7c15ull ) | 1;
+    int i;
+
+    for(i = 0; i < BLOOM_HASHES; i++) {
+        size_t bit = (h1 + i * h2) % set->n_bits;
+
+        if(! (filter->bits[bit / 8] & (1 << (bit % 8)))) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/* key-value pairs are separated by RECORD_SEPARATOR, and each member of the pair
+ * is also separated by RECORD_SEPARATOR.  So the layout of attributes looks kind of
+ * like this:
+ *
+ * key1 RS value1 RS key2 RS value2 RS key3 RS value3
+ */
+static const char *extract_attribute_value(const char *attributes, const char *key, size_t *value_len)
+{
+    char *needle;
+    const char *attr_location = NULL;
+    size_t key_len;
+
+    key_len = strlen( key );
+    needle  = sqlite3_malloc( key_len + 3 ); /* one for NULL, one for
+                                                record separator */
+
+    if(! needle) {
+        return NULL;
+    }
+
+    needle[0] = RECORD_SEPARATOR;
+    strcpy(needle + 1, key);
+    needle[key_len + 1] = RECORD_SEPARATOR;
+    needle[key_len + 2] = '\0';
+
+    if(! strncmp( attributes, needle + 1, key_len + 1 )) {
+        attr_location = attributes + key_len + 1;
+    }
+
+    if(! attr_location) {
+        attr_location = strstr( attributes, needle );
+        if(attr_location) {
+            attr_location += key_len + 2;
+        }
+    }
+
+    sqlite3_free( needle );
+
+    if(attr_location) {
+        const char *attr_end;
+
+        attr_end = strchr( attr_location, RECORD_SEPARATOR );
+        if(! attr_end) {
+            attr_end = attr_location + strlen( attr_location ); /* end of string */
+        }
+        *value_len = attr_end - attr_location;
+        return attr_location;
+    } else {
+        return NULL;
+    }
+}
+
+static void iterate_over_kv_pairs( const char *attributes,
+    kv_iter_cb callback, void *udata )
+{
+    const char *key_endp;
+    int status;
+
+    while(key_endp = strchr( attributes, RECORD_SEPARATOR )) {
+        const char *key;
+        const char *value;
+        const char *value_endp;
+        size_t key_length;
+        size_t value_length;
+
+        value_endp = strchr( key_endp + 1, RECORD_SEPARATOR );
+
+        if(! value_endp) {
+            value_endp = key_endp + strlen(key_endp); /* end of string */
+        }
+
+        key          = attributes;
+        key_length   = key_endp - key;
+        value        = key_endp + 1;
+        value_length = value_endp - value;
+
+        status = callback( key, key_length, value, value_length, udata );
+
+        if(status == BREAK) {
+            break;
+        }
+
+        if(*value_endp == RECORD_SEPARATOR) {
+            attributes = value_endp + 1;
+        } else {
+            break;
+        }
+    }
+
+}
+
+/* like iterate_over_kv_pairs, but reads the attribute string out of blob
+ * ATTRIBUTE_WINDOW_SIZE bytes at a time, so that it never holds more of the
+ * string than its largest key-value pair.  returns an SQLite status */
+static int iterate_over_blob_pairs( sqlite3_blob *blob,
+    kv_iter_cb callback, void *udata )
+{
+    int size        = sqlite3_blob_bytes( blob );
+    int window_size = ATTRIBUTE_WINDOW_SIZE;
+    int window_len  = 0; /* how much of the window has been read into */
+    int offset      = 0; /* where the window starts in the blob */
+    int start       = 0; /* where the next pair starts in the window */
+    int status      = SQLITE_OK;
+    char *window;
+
+    window = sqlite3_malloc( window_size );
+    if(! window) {
+        return SQLITE_NOMEM;
+    }
+
+    for(;;) {
+        const char *key        = window + start;
+        const char *window_end = window + window_len;
+        const char *key_endp   = memchr( key, RECORD_SEPARATOR, window_end - key );
+        const char *value_endp = NULL;
+        int at_end             = offset + window_len == size;
+        int n;
+
+        if(key_endp) {
+            value_endp = memchr( key_endp + 1, RECORD_SEPARATOR,
+                window_end - (key_endp + 1) );
+
+            if(! value_endp && at_end) {
+                value_endp = window_end; /* end of string */
+            }
+        }
+
+        if(value_endp) {
+            if(callback( key, key_endp - key, key_endp + 1,
+                value_endp - (key_endp + 1), udata ) == BREAK ||
+                value_endp == window_end) {
+                break;
+            }
+            start = value_endp + 1 - window;
+            continue;
+        }
+
+        if(at_end) {
+            break;
+        }
+
+        /* move the pair we're in the middle of to the front of the window,
+         * and make room for the rest of it if it fills the window */
+        memmove( window, window + start, window_len - start );
+        offset     += start;
+        window_len -= start;
+        start       = 0;
+
+        if(window_len == window_size) {
+            char *resized = sqlite3_realloc( window, window_size * 2 );
+
+            if(! resized) {
+                status = SQLITE_NOMEM;
+                break;
+            }
+            window       = resized;
+            window_size *= 2;
+        }
+
+        n = window_size - window_len;
+        if(n > size - offset - window_len) {
+            n = size - offset - window_len;
+        }
+
+        status = sqlite3_blob_read( blob, window + window_len, n,
+            offset + window_len );
+        if(status != SQLITE_OK) {
+            break;
+        }
+        window_len += n;
+    }
+    sqlite3_free( window );
+
+    return status;
+}
+
+static void sql_get_attr( sqlite3_context *ctx, int nargs,
+    sqlite3_value **values )
+{
+    const char *attributes;
+    const char *attr_name;
+    const char *attr_value;
+    size_t value_length;
+
+    if(sqlite3_value_type( values[0] ) != SQLITE_TEXT) {
+        sqlite3_result_error( ctx, "attribute operand must be a string", -1 );
+        return;
+    }
+
+    if(sqlite3_value_type( values[1] ) == SQLITE_NULL) {
+        sqlite3_result_error( ctx, "query operand must not be NULL", -1 );
+        return;
+    }
+
+    attributes = sqlite3_value_text( values[0] );
+    attr_name  = sqlite3_value_text( values[1] );
+    attr_value = extract_attribute_value( attributes, attr_name,
+        &value_length );
+
+    if(attr_value) {
+        sqlite3_result_text( ctx, attr_value, value_length, SQLITE_TRANSIENT );
+    } else {
+        sqlite3_result_null( ctx );
+    }
+}
+
+/* glob_attr patterns are either a GLOB pattern for keys, or a key pattern
+ * and a value pattern separated by RECORD_SEPARATOR; a row matches if one of
+ * its key-value pairs matches both */
+struct glob_match {
+    char *key_pattern;
+    char *value_pattern; /* NULL to match any value */
+    int matched;
+    int error_code;
+};
+
+static int _glob_match_pair( const char *key, size_t key_len,
+    const char *value, size_t value_len, void *udata )
+{
+    struct glob_match *match = udata;
+    char *text;
+
+    text = sqlite3_mprintf( "%.*s", (int) key_len, key );
+    if(! text) {
+        match->error_code = SQLITE_NOMEM;
+        return BREAK;
+    }
+    match->matched = ! sqlite3_strglob( match->key_pattern, text );
+    sqlite3_free( text );
+
+    if(match->matched && match->value_pattern) {
+        text = sqlite3_mprintf( "%.*s", (int) value_len, value );
+        if(! text) {
+            match->error_code = SQLITE_NOMEM;
+            return BREAK;
+        }
+        match->matched = ! sqlite3_strglob( match->value_pattern, text );
+        sqlite3_free( text );
+    }
+
+    return match->matched ? BREAK : CONTINUE;
+}
+
+/* splits a glob_attr pattern into match's key and value patterns */
+static int _start_glob_match( struct glob_match *match, const char *pattern )
+{
+    const char *value = strchr( pattern, RECORD_SEPARATOR );
+
+    memset( match, 0, sizeof(struct glob_match) );
+
+    match->key_pattern = sqlite3_mprintf( "%.*s",
+        (int) (value ? value - pattern : strlen( pattern )), pattern );
+    if(value) {
+        match->value_pattern = sqlite3_mprintf( "%s", value + 1 );
+    }
+
+    if(! match->key_pattern || (value && ! match->value_pattern)) {
+        sqlite3_free( match->key_pattern );
+        sqlite3_free( match->value_pattern );
+        return SQLITE_NOMEM;
+    }
+
+    return SQLITE_OK;
+}
+
+/* returns 1 if attributes matches a glob_attr pattern, 0 if it doesn't, or
+ * -1 if we ran out of memory */
+static int glob_attr_matches( const char *attributes, const char *pattern )
+{
+    struct glob_match match;
+
+    if(_start_glob_match( &match, pattern ) != SQLITE_OK) {
+        return -1;
+    }
+
+    iterate_over_kv_pairs( attributes, _glob_match_pair, &match );
+
+    sqlite3_free( match.key_pattern );
+    sqlite3_free( match.value_pattern );
+
+    return match.error_code ? -1 : match.matched;
+}
+
+/* sets *matched if the attribute string in blob matches a glob_attr
+ * pattern, streaming through it rather than reading it all at once */
+static int glob_attr_blob_matches( sqlite3_blob *blob, const char *pattern,
+    int *matched )
+{
+    struct glob_match match;
+    int status;
+
+    status = _start_glob_match( &match, pattern );
+    if(status != SQLITE_OK) {
+        return status;
+    }
+
+    status = iterate_over_blob_pairs( blob, _glob_match_pair, &match );
+
+    sqlite3_free( match.key_pattern );
+    sqlite3_free( match.value_pattern );
+
+    *matched = match.matched;
+
+    return status != SQLITE_OK ? status : match.error_code;
+}
+
+static void sql_glob_attr( sqlite3_context *ctx, int nargs,
+    sqlite3_value **values )
+{
+    const char *attributes;
+    const char *pattern;
+    int matched;
+
+    if(sqlite3_value_type( values[0] ) != SQLITE_TEXT) {
+        sqlite3_result_error( ctx, "attribute operand must be a string", -1 );
+        return;
+    }
+
+    if(sqlite3_value_type( values[1] ) == SQLITE_NULL) {
+        sqlite3_result_error( ctx, "pattern operand must not be NULL", -1 );
+        return;
+    }
+
+    attributes = sqlite3_value_text( values[0] );
+    pattern    = sqlite3_value_text( values[1] );
+    matched    = glob_attr_matches( attributes, pattern );
+
+    if(matched < 0) {
+        sqlite3_result_error_nomem( ctx );
+    } else {
+        sqlite3_result_int( ctx, matched );
+    }
+}
+
+/* returns the length of the literal prefix of a GLOB pattern (everything
+ * before its first wildcard), which is all of it if it has no wildcards */
+static size_t _glob_prefix_length( const char *pattern, size_t pattern_len )
+{
+    size_t i;
+
+    for(i = 0; i < pattern_len; i++) {
+        if(pattern[i] == '*' || pattern[i] == '?' || pattern[i] == '[') {
+            break;
+        }
+    }
+
+    return i;
+}
+
+/* every string starting with prefix sorts before the prefix's successor:
+ * its first successor_len bytes with the last of them incremented.  returns
+ * successor_len, or 0 if the prefix has no successor */
+static size_t _glob_successor_length( const char *prefix, size_t prefix_len )
+{
+    while(prefix_len && (unsigned char) prefix[prefix_len - 1] == 0xff) {
+        prefix_len--;
+    }
+
+    return prefix_len;
+}
+
+/* snapshot files are a read-only, memory-mapped copy of an attribute table
+ * (see attributes_export).  the first page holds a snapshot_header, and
+ * every section after it starts on a page boundary; offsets in the header
+ * are in bytes from the start of the file.  integers are stored in the byte
+ * order of the machine that wrote the snapshot */
+struct snapshot_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t file_size;
+    uint64_t checksum; /* of everything after the header page */
+    uint64_t n_rows;
+    uint64_t n_keys;
+    uint64_t n_values;
+    uint64_t n_postings;
+    uint64_t rows;     /* struct snapshot_row[n_rows], ordered by id */
+    uint64_t keys;     /* struct snapshot_key[n_keys], ordered by name */
+    uint64_t values;   /* struct snapshot_value[n_values], grouped by key */
+    uint64_t postings; /* uint32_t[n_postings], indexes into rows */
+    uint64_t strings;  /* the rows' attribute strings, NUL-terminated */
+    uint64_t strings_size;
+};
+
+/* key names and values point into the attribute strings of rows that
+ * contain them, so the dictionaries cost no extra string storage.  string
+ * offsets are relative to the strings section, and posting offsets are
+ * indexes into the postings section */
+struct snapshot_row {
+    int64_t id;
+    uint64_t attributes;
+    uint32_t attributes_len;
+    uint32_t reserved;
+};
+
+struct snapshot_key {
+    uint64_t name;
+    uint32_t name_len;
+    uint32_t n_values;
+    uint64_t first_value; /* this key's values, ordered by text */
+    uint64_t postings;    /* every row that has this key, in row order */
+    uint64_t n_postings;
+};
+
+struct snapshot_value {
+    uint64_t text;
+    uint32_t text_len;
+    uint32_t reserved;
+    uint64_t postings; /* every row that has this key-value pair */
+    uint64_t n_postings;
+};
+
+struct snapshot {
+    const unsigned char *map;
+    size_t size;
+    const struct snapshot_header *header;
+    const struct snapshot_row *rows;
+    const struct snapshot_key *keys;
+    const struct snapshot_value *values;
+    const uint32_t *postings;
+    const char *strings;
+};
+
+/* rows are added in id order by attributes_export; snapshot_builder_write
+ * builds the dictionaries and postings from them */
+struct snapshot_builder {
+    struct snapshot_row *rows;
+    size_t n_rows;
+    size_t rows_capacity;
+    char *strings;
+    size_t strings_size;
+    size_t strings_capacity;
+};
+
+/* a single key-value pair of a row, while the postings are being built */
+struct snapshot_entry {
+    const char *key;
+    const char *value;
+    uint32_t key_len;
+    uint32_t value_len;
+    uint32_t row;
+};
+
+struct snapshot_entries {
+    struct snapshot_entry *entries;
+    size_t n_entries;
+    size_t capacity;
+    const char *strings;
+    uint32_t row;
+    int error_code;
+};
+
+static uint64_t _snapshot_align( uint64_t offset )
+{
+    return (offset + SNAPSHOT_PAGE_SIZE - 1) & ~((uint64_t) SNAPSHOT_PAGE_SIZE - 1);
+}
+
+/* FNV-1a over 64-bit words, continuing from hash (start with
+ * SNAPSHOT_CHECKSUM_BASIS); every section is padded out to a whole page, so
+ * the file's len is always a multiple of 8 */
+#define SNAPSHOT_CHECKSUM_BASIS 14695981039346656037ull
+
+static uint64_t _snapshot_checksum( uint64_t hash, const unsigned char *data,
+    size_t len )
+{
+    size_t i;
+
+    for(i = 0; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        uint64_t word;
+
+        memcpy( &word, data + i, sizeof(uint64_t) );
+        hash ^= word;
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+static int _snapshot_compare_text( const char *a, size_t a_len,
+    const char *b, size_t b_len )
+{
+    int cmp = memcmp( a, b, a_len < b_len ? a_len : b_len );
+
+    if(cmp) {
+        return cmp;
+    }
+
+    return a_len < b_len ? -1 : a_len > b_len ? 1 : 0;
+}
+
+static int _snapshot_compare_entries( const void *a, const void *b )
+{
+    const struct snapshot_entry *left  = a;
+    const struct snapshot_entry *right = b;
+    int cmp;
+
+    cmp = _snapshot_compare_text( left->key, left->key_len, right->key,
+        right->key_len );
+    if(cmp) {
+        return cmp;
+    }
+
+    cmp = _snapshot_compare_text( left->value, left->value_len, right->value,
+        right->value_len );
+    if(cmp) {
+        return cmp;
+    }
+
+    return left->row < right->row ? -1 : left->row > right->row;
+}
+
+static int _snapshot_compare_postings( const void *a, const void *b )
+{
+    uint32_t left  = *((const uint32_t *) a);
+    uint32_t right = *((const uint32_t *) b);
+
+    return left < right ? -1 : left > right;
+}
+
+static void snapshot_builder_free( struct snapshot_builder *builder )
+{
+    sqlite3_free( builder->rows );
+    sqlite3_free( builder->strings );
+    memset( builder, 0, sizeof(struct snapshot_builder) );
+}
+
+static int snapshot_builder_add( struct snapshot_builder *builder,
+    sqlite3_int64 id, const char *attributes, size_t attributes_len )
+{
+    struct snapshot_row *row;
+
+    if(builder->n_rows == UINT32_MAX || attributes_len > UINT32_MAX) {
+        return SQLITE_TOOBIG;
+    }
+
+    if(builder->n_rows == builder->rows_capacity) {
+        size_t capacity = builder->rows_capacity ? builder->rows_capacity * 2 : 64;
+        struct snapshot_row *rows = sqlite3_realloc64( builder->rows,
+            capacity * sizeof(struct snapshot_row) );
+
+        if(! rows) {
+            return SQLITE_NOMEM;
+        }
+        builder->rows          = rows;
+        builder->rows_capacity = capacity;
+    }
+
+    while(builder->strings_size + attributes_len + 1 > builder->strings_capacity) {
+        size_t capacity = builder->strings_capacity ? builder->strings_capacity * 2 : 4096;
+        char *strings = sqlite3_realloc64( builder->strings, capacity );
+
+        if(! strings) {
+            return SQLITE_NOMEM;
+        }
+        builder->strings          = strings;
+        builder->strings_capacity = capacity;
+    }
+
+    row = builder->rows + builder->n_rows++;
+    memset( row, 0, sizeof(struct snapshot_row) );
+    row->id             = id;
+    row->attributes     = builder->strings_size;
+    row->attributes_len = attributes_len;
+
+    memcpy( builder->strings + builder->strings_size, attributes, attributes_len );
+    builder->strings[builder->strings_size + attributes_len] = '\0';
+    builder->strings_size += attributes_len + 1;
+
+    return SQLITE_OK;
+}
+
+static int _snapshot_collect_entries( const char *key, size_t key_len,
+    const char *value, size_t value_len, void *udata )
+{
+    struct snapshot_entries *entries = udata;
+    struct snapshot_entry *entry;
+
+    if(entries->n_entries == entries->capacity) {
+        size_t capacity = entries->capacity ? entries->capacity * 2 : 256;
+        struct snapshot_entry *grown = sqlite3_realloc64( entries->entries,
+            capacity * sizeof(struct snapshot_entry) );
+
+        if(! grown) {
+            entries->error_code = SQLITE_NOMEM;
+            return BREAK;
+        }
+        entries->entries  = grown;
+        entries->capacity = capacity;
+    }
+
+    entry = entries->entries + entries->n_entries++;
+    entry->key       = key;
+    entry->key_len   = key_len;
+    entry->value     = value;
+    entry->value_len = value_len;
+    entry->row       = entries->row;
+
+    return CONTINUE;
+}
+
+#ifndef ATTRIBUTES_NO_SNAPSHOTS
+
+/* a snapshot file being written, one section at a time */
+struct snapshot_writer {
+    int fd;
+    uint64_t offset;
+    uint64_t checksum;
+};
+
+static int _snapshot_write( struct snapshot_writer *writer, const void *data,
+    size_t len )
+{
+    const unsigned char *p = data;
+
+    while(len) {
+        ssize_t written = write( writer->fd, p, len );
+
+        if(written < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return SQLITE_IOERR;
+        }
+        p              += written;
+        len            -= written;
+        writer->offset += written;
+    }
+
+    return SQLITE_OK;
+}
+
+/* writes len bytes of data and pads them out to the next page boundary,
+ * adding both to the checksum */
+static int _snapshot_write_section( struct snapshot_writer *writer,
+    const void *data, size_t len )
+{
+    static const unsigned char zeros[SNAPSHOT_PAGE_SIZE];
+    size_t whole   = len - len % sizeof(uint64_t);
+    size_t padding = _snapshot_align( writer->offset + len ) - writer->offset - len;
+    int status;
+
+    writer->checksum = _snapshot_checksum( writer->checksum, data, whole );
+
+    if(whole < len) {
+        unsigned char tail[sizeof(uint64_t)];
+
+        memset( tail, 0, sizeof(tail) );
+        memcpy( tail, (const unsigned char *) data + whole, len - whole );
+        writer->checksum = _snapshot_checksum( writer->checksum, tail, sizeof(tail) );
+        writer->checksum = _snapshot_checksum( writer->checksum, zeros,
+            padding - (sizeof(tail) - (len - whole)) );
+    } else {
+        writer->checksum = _snapshot_checksum( writer->checksum, zeros, padding );
+    }
+
+    status = _snapshot_write( writer, data, len );
+    if(status == SQLITE_OK) {
+        status = _snapshot_write( writer, zeros, padding );
+    }
+
+    return status;
+}
+
+/* makes a rename into filename's directory durable; this is best effort, since
+ * not every filesystem allows syncing a directory */
+static void _snapshot_sync_directory( const char *filename )
+{
+    const char *slash = strrchr( filename, '/' );
+    char *directory   = slash ?
+        sqlite3_mprintf( "%.*s", (int) (slash - filename + 1), filename ) :
+        sqlite3_mprintf( "." );
+    int fd;
+
+    if(! directory) {
+        return;
+    }
+
+    fd = open( directory, O_RDONLY );
+    if(fd >= 0) {
+        fsync( fd );
+        close( fd );
+    }
+    sqlite3_free( directory );
+}
+
+/* opens a new file next to filename for the snapshot to be written to, and
+ * sets *temp_filename to its name */
+static int _snapshot_open_temp( const char *filename, char **temp_filename )
+{
+    int attempts;
+    int fd = -1;
+
+    for(attempts = 0; fd < 0 && attempts < 10; attempts++) {
+        sqlite3_uint64 suffix;
+
+        sqlite3_randomness( sizeof(suffix), &suffix );
+        *temp_filename = sqlite3_mprintf( "%s-%016llx.tmp", filename,
+            (unsigned long long) suffix );
+        if(! *temp_filename) {
+            errno = ENOMEM;
+            return -1;
+        }
+
+        fd = open( *temp_filename, O_WRONLY | O_CREAT | O_EXCL, 0666 );
+        if(fd < 0) {
+            sqlite3_free( *temp_filename );
+            *temp_filename = NULL;
+
+            if(errno != EEXIST) {
+                break;
+            }
+        }
+    }
+
+    return fd;
+}
+
+/* writes the builder's rows to a snapshot at filename.  the sections are
+ * written straight out of the builder (and the dictionaries built alongside
+ * it), so the builder's strings are the only copy of the rows in memory.
+ * the snapshot is written to a temporary file that replaces filename once
+ * it's complete and synced, so connections that have the old snapshot mapped
+ * keep seeing it intact */
+static int snapshot_builder_write( struct snapshot_builder *builder,
+    const char *filename, char **errMsg )
+{
+    struct snapshot_entries entries;
+    struct snapshot_writer writer;
+    unsigned char header_page[SNAPSHOT_PAGE_SIZE];
+    struct snapshot_header *header = (struct snapshot_header *) header_page;
+    struct snapshot_key *keys      = NULL;
+    struct snapshot_value *values  = NULL;
+    uint32_t *postings             = NULL;
+    char *temp_filename            = NULL;
+    uint64_t n_keys     = 0;
+    uint64_t n_values   = 0;
+    uint64_t n_postings = 0;
+    uint64_t n_value_postings = 0;
+    uint64_t n_key_postings   = 0;
+    size_t i;
+    int status = SQLITE_OK;
+
+    memset( &entries, 0, sizeof(struct snapshot_entries) );
+
+    for(i = 0; i < builder->n_rows && ! entries.error_code; i++) {
+        entries.row = i;
+        iterate_over_kv_pairs( builder->strings + builder->rows[i].attributes,
+            _snapshot_collect_entries, &entries );
+    }
+
+    if(entries.error_code) {
+        sqlite3_free( entries.entries );
+        return entries.error_code;
+    }
+
+    qsort( entries.entries, entries.n_entries, sizeof(struct snapshot_entry),
+        _snapshot_compare_entries );
+
+    /* every entry is in its value's postings and its key's postings */
+    if(entries.n_entries > UINT32_MAX / 2) {
+        sqlite3_free( entries.entries );
+        return SQLITE_TOOBIG;
+    }
+
+    for(i = 0; i < entries.n_entries; i++) {
+        const struct snapshot_entry *entry = entries.entries + i;
+        const struct snapshot_entry *prev  = i ? entry - 1 : NULL;
+
+        if(! prev || _snapshot_compare_text( prev->key, prev->key_len,
+            entry->key, entry->key_len )) {
+            n_keys++;
+            n_values++;
+        } else if(_snapshot_compare_text( prev->value, prev->value_len,
+            entry->value, entry->value_len )) {
+            n_values++;
+        }
+    }
+    n_postings = entries.n_entries * 2;
+
+    keys     = sqlite3_malloc64( n_keys * sizeof(struct snapshot_key) + 1 );
+    values   = sqlite3_malloc64( n_values * sizeof(struct snapshot_value) + 1 );
+    postings = sqlite3_malloc64( n_postings * sizeof(uint32_t) + 1 );
+
+    if(! keys || ! values || ! postings) {
+        sqlite3_free( entries.entries );
+        sqlite3_free( keys );
+        sqlite3_free( values );
+        sqlite3_free( postings );
+        return SQLITE_NOMEM;
+    }
+    memset( keys, 0, n_keys * sizeof(struct snapshot_key) );
+    memset( values, 0, n_values * sizeof(struct snapshot_value) );
+    memset( postings, 0, n_postings * sizeof(uint32_t) );
+
+    memset( header_page, 0, sizeof(header_page) );
+    memcpy( header->magic, SNAPSHOT_MAGIC, sizeof(header->magic) );
+    header->version      = SNAPSHOT_VERSION;
+    header->byte_order   = SNAPSHOT_BYTE_ORDER;
+    header->n_rows       = builder->n_rows;
+    header->n_keys       = n_keys;
+    header->n_values     = n_values;
+    header->n_postings   = n_postings;
+    header->rows         = SNAPSHOT_PAGE_SIZE;
+    header->keys         = _snapshot_align( header->rows + builder->n_rows * sizeof(struct snapshot_row) );
+    header->values       = _snapshot_align( header->keys + n_keys * sizeof(struct snapshot_key) );
+    header->postings     = _snapshot_align( header->values + n_values * sizeof(struct snapshot_value) );
+    header->strings      = _snapshot_align( header->postings + n_postings * sizeof(uint32_t) );
+    header->strings_size = builder->strings_size;
+    header->file_size    = _snapshot_align( header->strings + builder->strings_size );
+
+    /* value postings take up the first half of the postings section, in the
+     * same order as the sorted entries; key postings take up the second */
+    n_keys   = 0;
+    n_values = 0;
+    for(i = 0; i < entries.n_entries; i++) {
+        const struct snapshot_entry *entry = entries.entries + i;
+        const struct snapshot_entry *prev  = i ? entry - 1 : NULL;
+        struct snapshot_key *key;
+
+        if(prev && ! _snapshot_compare_entries( prev, entry )) {
+            continue; /* a pair that's repeated within a row */
+        }
+
+        if(! prev || _snapshot_compare_text( prev->key, prev->key_len,
+            entry->key, entry->key_len )) {
+            key = keys + n_keys++;
+            key->name        = entry->key - builder->strings;
+            key->name_len    = entry->key_len;
+            key->first_value = n_values;
+            key->postings    = entries.n_entries + n_key_postings;
+            prev             = NULL;
+        } else {
+            key = keys + n_keys - 1;
+        }
+
+        if(! prev || _snapshot_compare_text( prev->value, prev->value_len,
+            entry->value, entry->value_len )) {
+            struct snapshot_value *value = values + n_values++;
+
+            value->text     = entry->value - builder->strings;
+            value->text_len = entry->value_len;
+            value->postings = n_value_postings;
+            key->n_values++;
+        }
+
+        values[n_values - 1].n_postings++;
+        postings[n_value_postings++] = entry->row;
+        postings[entries.n_entries + n_key_postings++] = entry->row;
+        key->n_postings++;
+    }
+    sqlite3_free( entries.entries );
+
+    /* a row is in its key's postings once, however many values it has
+     * under that key */
+    for(i = 0; i < n_keys; i++) {
+        uint32_t *list = postings + keys[i].postings;
+        uint64_t n     = 0;
+        uint64_t j;
+
+        qsort( list, keys[i].n_postings, sizeof(uint32_t),
+            _snapshot_compare_postings );
+
+        for(j = 0; j < keys[i].n_postings; j++) {
+            if(! n || list[n - 1] != list[j]) {
+                list[n++] = list[j];
+            }
+        }
+        keys[i].n_postings = n;
+    }
+
+    memset( &writer, 0, sizeof(struct snapshot_writer) );
+    writer.checksum = SNAPSHOT_CHECKSUM_BASIS;
+    writer.fd       = _snapshot_open_temp( filename, &temp_filename );
+
+    if(writer.fd < 0) {
+        status = SQLITE_IOERR;
+    }
+
+    /* the header page is rewritten with the checksum once the rest is out */
+    if(status == SQLITE_OK) {
+        status = _snapshot_write( &writer, header_page, sizeof(header_page) );
+    }
+    if(status == SQLITE_OK) {
+        status = _snapshot_write_section( &writer, builder->rows,
+            builder->n_rows * sizeof(struct snapshot_row) );
+    }
+    if(status == SQLITE_OK) {
+        status = _snapshot_write_section( &writer, keys,
+            n_keys * sizeof(struct snapshot_key) );
+    }
+    if(status == SQLITE_OK) {
+        status = _snapshot_write_section( &writer, values,
+            n_values * sizeof(struct snapshot_value) );
+    }
+    if(status == SQLITE_OK) {
+        status = _snapshot_write_section( &writer, postings,
+            n_postings * sizeof(uint32_t) );
+    }
+    if(status == SQLITE_OK) {
+        status = _snapshot_write_section( &writer, builder->strings,
+            builder->strings_size );
+    }
+    if(status == SQLITE_OK) {
+        header->checksum = writer.checksum;
+
+        if(pwrite( writer.fd, header_page, sizeof(header_page), 0 ) != sizeof(header_page) ||
+            fsync( writer.fd )) {
+            status = SQLITE_IOERR;
+        }
+    }
+    if(status == SQLITE_OK && rename( temp_filename, filename )) {
+        status = SQLITE_IOERR;
+    }
+
+    if(status != SQLITE_OK) {
+        *errMsg = sqlite3_mprintf( "unable to write snapshot '%s': %s",
+            filename, strerror( errno ) );
+    }
+
+    if(writer.fd >= 0) {
+        close( writer.fd );
+    }
+
+    if(status == SQLITE_OK) {
+        _snapshot_sync_directory( filename );
+    } else if(temp_filename) {
+        unlink( temp_filename );
+    }
+
+    sqlite3_free( temp_filename );
+    sqlite3_free( keys );
+    sqlite3_free( values );
+    sqlite3_free( postings );
+
+    return status;
+}
+
+/* returns an error message describing what's wrong with a mapped snapshot,
+ * or NULL if it looks sound.  every offset in the file is checked here so
+ * that reads from the mapping never need to be; the checksum, which means
+ * reading the whole file, is only checked if verify is set */
+static const char *_snapshot_check( struct snapshot *snapshot, int verify )
+{
+    const struct snapshot_header *header = snapshot->header;
+    uint64_t i;
+
+    if(snapshot->size < SNAPSHOT_PAGE_SIZE ||
+        memcmp( header->magic, SNAPSHOT_MAGIC, sizeof(header->magic) )) {
+        return "not an attribute snapshot";
+    }
+
+    if(header->byte_order != SNAPSHOT_BYTE_ORDER) {
+        return "snapshot was written with a different byte order";
+    }
+
+    if(header->version != SNAPSHOT_VERSION) {
+        return "unsupported snapshot version";
+    }
+
+    if(header->file_size != snapshot->size ||
+        header->rows < SNAPSHOT_PAGE_SIZE ||
+        header->rows % SNAPSHOT_PAGE_SIZE || header->keys % SNAPSHOT_PAGE_SIZE ||
+        header->values % SNAPSHOT_PAGE_SIZE || header->postings % SNAPSHOT_PAGE_SIZE ||
+        header->strings % SNAPSHOT_PAGE_SIZE ||
+        header->rows > header->keys || header->keys > header->values ||
+        header->values > header->postings || header->postings > header->strings ||
+        header->strings > header->file_size ||
+        header->n_rows > (header->keys - header->rows) / sizeof(struct snapshot_row) ||
+        header->n_keys > (header->values - header->keys) / sizeof(struct snapshot_key) ||
+        header->n_values > (header->postings - header->values) / sizeof(struct snapshot_value) ||
+        header->n_postings > (header->strings - header->postings) / sizeof(uint32_t) ||
+        header->strings_size > header->file_size - header->strings) {
+        return "snapshot is truncated or corrupt";
+    }
+
+    if(verify && _snapshot_checksum( SNAPSHOT_CHECKSUM_BASIS,
+        snapshot->map + SNAPSHOT_PAGE_SIZE,
+        snapshot->size - SNAPSHOT_PAGE_SIZE ) != header->checksum) {
+        return "snapshot checksum mismatch";
+    }
+
+    snapshot->rows     = (const struct snapshot_row *) (snapshot->map + header->rows);
+    snapshot->keys     = (const struct snapshot_key *) (snapshot->map + header->keys);
+    snapshot->values   = (const struct snapshot_value *) (snapshot->map + header->values);
+    snapshot->postings = (const uint32_t *) (snapshot->map + header->postings);
+    snapshot->strings  = (const char *) (snapshot->map + header->strings);
+
+    for(i = 0; i < header->n_rows; i++) {
+        const struct snapshot_row *row = snapshot->rows + i;
+
+        if(row->attributes >= header->strings_size ||
+            row->attributes_len >= header->strings_size - row->attributes ||
+            snapshot->strings[row->attributes + row->attributes_len] != '\0' ||
+            (i && row->id <= row[-1].id)) {
+            return "snapshot is corrupt";
+        }
+    }
+
+    for(i = 0; i < header->n_keys; i++) {
+        const struct snapshot_key *key = snapshot->keys + i;
+
+        if(key->name > header->strings_size ||
+            key->name_len > header->strings_size - key->name ||
+            key->first_value > header->n_values ||
+            key->n_values > header->n_values - key->first_value ||
+            key->postings > header->n_postings ||
+            key->n_postings > header->n_postings - key->postings) {
+            return "snapshot is corrupt";
+        }
+    }
+
+    for(i = 0; i < header->n_values; i++) {
+        const struct snapshot_value *value = snapshot->values + i;
+
+        if(value->text > header->strings_size ||
+            value->text_len > header->strings_size - value->text ||
+            value->postings > header->n_postings ||
+            value->n_postings > header->n_postings - value->postings) {
+            return "snapshot is corrupt";
+        }
+    }
+
+    for(i = 0; i < header->n_postings; i++) {
+        if(snapshot->postings[i] >= header->n_rows) {
+            return "snapshot is corrupt";
+        }
+    }
+
+    return NULL;
+}
+
+static void snapshot_close( struct snapshot *snapshot )
+{
+    if(snapshot) {
+        munmap( (void *) snapshot->map, snapshot->size );
+        sqlite3_free( snapshot );
+    }
+}
+
+/* maps the snapshot at filename; see _snapshot_check for verify */
+static int snapshot_open( const char *filename, int verify,
+    struct snapshot **snapshot, char **errMsg )
+{
+    struct stat st;
+    const char *problem;
+    void *map;
+    int fd;
+
+    *snapshot = NULL;
+
+    fd = open( filename, O_RDONLY );
+    if(fd < 0 || fstat( fd, &st )) {
+        *errMsg = sqlite3_mprintf( "unable to open snapshot '%s': %s",
+            filename, strerror( errno ) );
+        if(fd >= 0) {
+            close( fd );
+        }
+        return SQLITE_CANTOPEN;
+    }
+
+    if(st.st_size < SNAPSHOT_PAGE_SIZE) {
+        close( fd );
+        *errMsg = sqlite3_mprintf( "%s: not an attribute snapshot", filename );
+        return SQLITE_CORRUPT;
+    }
+
+    map = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    close( fd );
+
+    if(map == MAP_FAILED) {
+        *errMsg = sqlite3_mprintf( "unable to map snapshot '%s': %s",
+            filename, strerror( errno ) );
+        return SQLITE_IOERR;
+    }
+
+    *snapshot = sqlite3_malloc( sizeof(struct snapshot) );
+    if(! *snapshot) {
+        munmap( map, st.st_size );
+        return SQLITE_NOMEM;
+    }
+    memset( *snapshot, 0, sizeof(struct snapshot) );
+
+    (*snapshot)->map    = map;
+    (*snapshot)->size   = st.st_size;
+    (*snapshot)->header = map;
+
+    problem = _snapshot_check( *snapshot, verify );
+    if(problem) {
+        *errMsg = sqlite3_mprintf( "%s: %s", filename, problem );
+        snapshot_close( *snapshot );
+        *snapshot = NULL;
+        return SQLITE_CORRUPT;
+    }
+
+    return SQLITE_OK;
+}
+
+#else
+
+static int snapshot_builder_write( struct snapshot_builder *builder,
+    const char *filename, char **errMsg )
+{
+    *errMsg = sqlite3_mprintf( "%s", "snapshots aren't supported on this platform" );
+    return SQLITE_ERROR;
+}
+
+static void snapshot_close( struct snapshot *snapshot )
+{
+    sqlite3_free( snapshot );
+}
+
+static int snapshot_open( const char *filename, int verify,
+    struct snapshot **snapshot, char **errMsg )
+{
+    *snapshot = NULL;
+    *errMsg   = sqlite3_mprintf( "%s", "snapshots aren't supported on this platform" );
+    return SQLITE_ERROR;
+}
+
+#endif
+
+static const struct snapshot_key *snapshot_find_key(
+    const struct snapshot *snapshot, const char *name, size_t name_len )
+{
+    uint64_t low  = 0;
+    uint64_t high = snapshot->header->n_keys;
+
+    while(low < high) {
+        uint64_t mid = low + (high - low) / 2;
+        const struct snapshot_key *key = snapshot->keys + mid;
+        int cmp = _snapshot_compare_text( snapshot->strings + key->name,
+            key->name_len, name, name_len );
+
+        if(! cmp) {
+            return key;
+        }
+        if(cmp < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return NULL;
+}
+
+static const struct snapshot_value *snapshot_find_value(
+    const struct snapshot *snapshot, const struct snapshot_key *key,
+    const char *text, size_t text_len )
+{
+    uint64_t low  = key->first_value;
+    uint64_t high = key->first_value + key->n_values;
+
+    while(low < high) {
+        uint64_t mid = low + (high - low) / 2;
+        const struct snapshot_value *value = snapshot->values + mid;
+        int cmp = _snapshot_compare_text( snapshot->strings + value->text,
+            value->text_len, text, text_len );
+
+        if(! cmp) {
+            return value;
+        }
+        if(cmp < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return NULL;
+}
+
+/* returns the index of the first row whose id is at least id (or, if after
+ * is set, greater than id) */
+static sqlite3_int64 snapshot_find_row( const struct snapshot *snapshot,
+    sqlite3_int64 id, int after )
+{
+    uint64_t low  = 0;
+    uint64_t high = snapshot->header->n_rows;
+
+    while(low < high) {
+        uint64_t mid = low + (high - low) / 2;
+
+        if(snapshot->rows[mid].id < id || (after && snapshot->rows[mid].id == id)) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+static char *_build_schema( const struct attribute_options *options )
+{
+    char *promoted_columns = sqlite3_mprintf( "%s", "" );
+    char *sql;
+    int i;
+
+    for(i = 0; promoted_columns && i < options->n_promoted; i++) {
+        promoted_columns = sqlite3_mprintf( "%z" VIRT_TABLE_PROMOTED_COLUMN_TMPL,
+            promoted_columns, options->promoted[i].key,
+            options->promoted[i].type );
+    }
+
+    if(! promoted_columns) {
+        return NULL;
+    }
+
+    sql = sqlite3_mprintf( VIRT_TABLE_SCHEMA, promoted_columns );
+    sqlite3_free( promoted_columns );
+
+    return sql;
+}
+
+static char *_build_select_columns( const struct attribute_options *options,
+    int with_attributes )
+{
+    char *columns = sqlite3_mprintf( "%s", with_attributes ?
+        "s.seq_id, s.attributes" : "s.seq_id, NULL" );
+    int i;
+
+    for(i = 0; columns && i < options->n_promoted; i++) {
+        columns = sqlite3_mprintf( "%z, s.\"%w\"", columns,
+            options->promoted[i].key );
+    }
+
+    return columns;
+}
+
+static void _clear_statement_report( struct statement_report *report )
+{
+    sqlite3_free( report->plan );
+    sqlite3_finalize( report->stmt );
+    memset( report, 0, sizeof(struct statement_report) );
+}
+
+static void _free_options( struct attribute_options *options )
+{
+    int i;
+
+    for(i = 0; i < options->n_promoted; i++) {
+        sqlite3_free( options->promoted[i].key );
+    }
+    sqlite3_free( options->promoted );
+    sqlite3_free( options->snapshot );
+    options->promoted   = NULL;
+    options->n_promoted = 0;
+    options->snapshot   = NULL;
+}
+
+/* returns the index of the promoted column that key is stored in, or -1 */
+static int _promoted_index( const struct attribute_options *options,
+    const char *key, size_t key_len )
+{
+    int i;
+
+    for(i = 0; i < options->n_promoted; i++) {
+        if(options->promoted[i].key_len == key_len &&
+            !memcmp( options->promoted[i].key, key, key_len )) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/* returns the promoted column that the key part of a MATCH term is stored
+ * in, or NULL */
+static const struct promoted_column *_promoted_column_for_term(
+    const struct attribute_options *options, const char *match )
+{
+    const char *value = strchr( match, RECORD_SEPARATOR );
+    int index;
+
+    index = _promoted_index( options, match,
+        value ? value - match : strlen( match ) );
+
+    return index >= 0 ? options->promoted + index : NULL;
+}
+
+static const char *_promoted_column_type( const char *type, size_t type_len )
+{
+    static const char * const types[] = { "TEXT", "INTEGER", "REAL", "NUMERIC", NULL };
+    int i;
+
+    if(type_len == 0) {
+        return types[0];
+    }
+
+    for(i = 0; types[i]; i++) {
+        if(strlen( types[i] ) == type_len && !sqlite3_strnicmp( types[i], type, type_len )) {
+            return types[i];
+        }
+    }
+
+    return NULL;
+}
+
+/* column names are case-insensitive, so a key can't be promoted if its name
+ * matches (in any case) one of the table's other columns, a name SQLite
+ * reserves for the rowid, or a key that's already been promoted */
+static int _promoted_column_taken( const struct attribute_options *options,
+    const char *key, size_t key_len )
+{
+    static const char * const reserved[] = { "id", "seq_id", "attributes",
+        "sort_key", "sort_value", "rowid", "oid", "_rowid_", NULL };
+    int i;
+
+    for(i = 0; reserved[i]; i++) {
+        if(strlen( reserved[i] ) == key_len && !sqlite3_strnicmp( reserved[i], key, key_len )) {
+            return 1;
+        }
+    }
+
+    for(i = 0; i < options->n_promoted; i++) {
+        if(options->promoted[i].key_len == key_len &&
+            !sqlite3_strnicmp( options->promoted[i].key, key, key_len )) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* value is a list of keys separated by commas or whitespace, optionally
+ * quoted and each optionally followed by a colon and a column type, ex.
+ * promote='status,score:INTEGER' */
+static int _parse_promoted_columns( struct attribute_options *options,
+    const char *value, char **errMsg )
+{
+    size_t value_len = strlen( value );
+    const char *end;
+
+    if(value_len >= 2 && (*value == '\'' || *value == '"') && value[value_len - 1] == *value) {
+        value++;
+        value_len -= 2;
+    }
+    end = value + value_len;
+
+    options->promoted = sqlite3_malloc( MAX_PROMOTED_COLUMNS * sizeof(struct promoted_column) );
+    if(! options->promoted) {
+        return SQLITE_NOMEM;
+    }
+
+    while(value < end) {
+        const char *key = value;
+        const char *key_end;
+        const char *type;
+        struct promoted_column *column;
+
+        if(*value == ',' || *value == ' ' || *value == '\t') {
+            value++;
+            continue;
+        }
+
+        while(value < end && *value != ',' && *value != ' ' && *value != '\t') {
+            value++;
+        }
+
+        key_end = memchr( key, ':', value - key );
+        if(! key_end) {
+            key_end = value;
+        }
+
+        type = _promoted_column_type( key_end + 1,
+            key_end == value ? 0 : value - key_end - 1 );
+
+        if(! type) {
+            *errMsg = sqlite3_mprintf( "unknown type for promoted key '%.*s'",
+                (int) (key_end - key), key );
+            return SQLITE_ERROR;
+        }
+
+        if(key_end == key) {
+            *errMsg = sqlite3_mprintf( "promoted keys must not be empty" );
+            return SQLITE_ERROR;
+        }
+
+        if(options->n_promoted == MAX_PROMOTED_COLUMNS) {
+            *errMsg = sqlite3_mprintf( "at most %d keys may be promoted",
+                MAX_PROMOTED_COLUMNS );
+            return SQLITE_ERROR;
+        }
+
+        if(_promoted_column_taken( options, key, key_end - key )) {
+            *errMsg = sqlite3_mprintf( "can't promote key '%.*s'",
+                (int) (key_end - key), key );
+            return SQLITE_ERROR;
+        }
+
+        column          = options->promoted + options->n_promoted;
+        column->key     = sqlite3_mprintf( "%.*s", (int) (key_end - key), key );
+        column->key_len = key_end - key;
+        column->type    = type;
+
+        if(! column->key) {
+            return SQLITE_NOMEM;
+        }
+        options->n_promoted++;
+    }
+
+    return SQLITE_OK;
+}
+
+/* options are passed as name=value pairs in the CREATE VIRTUAL TABLE
+ * statement, ex. CREATE VIRTUAL TABLE t USING attributes(cache_size=1048576);
+ * since SQLite stores that statement, options persist across connections */
+static int _parse_options( struct attribute_options *options, int argc,
+    const char * const *argv, char **errMsg )
+{
+    int i;
+
+    memset( options, 0, sizeof(struct attribute_options) );
+
+    for(i = 0; i < argc; i++) {
+        const char *value = strchr( argv[i], '=' );
+        size_t name_len;
+
+        if(! value) {
+            *errMsg = sqlite3_mprintf( "malformed option '%s'", argv[i] );
+            return SQLITE_ERROR;
+        }
+        name_len = value - argv[i];
+        value++;
+
+        if(name_len == 10 && !strncmp( argv[i], "cache_size", name_len )) {
+            char *endp;
+            long long cache_size = strtoll( value, &endp, 10 );
+
+            if(*value == '\0' || *endp != '\0' || cache_size < 0) {
+                *errMsg = sqlite3_mprintf( "cache_size must be a non-negative integer" );
+                return SQLITE_ERROR;
+            }
+            options->cache_size = cache_size;
+        } else if(name_len == 10 && !strncmp( argv[i], "bloom_bits", name_len )) {
+            char *endp;
+            long long bloom_bits = strtoll( value, &endp, 10 );
+
+            if(*value == '\0' || *endp != '\0' || bloom_bits < 0) {
+                *errMsg = sqlite3_mprintf( "bloom_bits must be a non-negative integer" );
+                return SQLITE_ERROR;
+            }
+            if(bloom_bits > BLOOM_MAX_BITS) {
+                *errMsg = sqlite3_mprintf( "bloom_bits must be at most %d", BLOOM_MAX_BITS );
+                return SQLITE_ERROR;
+            }
+            options->bloom_bits = (bloom_bits + 7) & ~7ll; /* whole bytes */
+        } else if(name_len == 13 && !strncmp( argv[i], "intern_values", name_len )) {
+            if(strcmp( value, "0" ) && strcmp( value, "1" )) {
+                *errMsg = sqlite3_mprintf( "intern_values must be 0 or 1" );
+                return SQLITE_ERROR;
+            }
+            options->intern_values = *value == '1';
+        } else if(name_len == 16 && !strncmp( argv[i], "large_attributes", name_len )) {
+            if(strcmp( value, "0" ) && strcmp( value, "1" )) {
+                *errMsg = sqlite3_mprintf( "large_attributes must be 0 or 1" );
+                return SQLITE_ERROR;
+            }
+            options->large_attributes = *value == '1';
+        } else if(name_len == 5 && !strncmp( argv[i], "merge", name_len )) {
+            if(strcmp( value, "0" ) && strcmp( value, "1" )) {
+                *errMsg = sqlite3_mprintf( "merge must be 0 or 1" );
+                return SQLITE_ERROR;
+            }
+            options->merge = *value == '1';
+        } else if(name_len == 14 && !strncmp( argv[i], "partition_size", name_len )) {
+            char *endp;
+            long long partition_size = strtoll( value, &endp, 10 );
+
+            if(*value == '\0' || *endp != '\0' || partition_size < 0) {
+                *errMsg = sqlite3_mprintf( "partition_size must be a non-negative integer" );
+                return SQLITE_ERROR;
+            }
+            options->partition_size = partition_size;
+        } else if(name_len == 8 && !strncmp( argv[i], "snapshot", name_len )) {
+            size_t value_len = strlen( value );
+
+            if(value_len >= 2 && (*value == '\'' || *value == '"') && value[value_len - 1] == *value) {
+                value++;
+                value_len -= 2;
+            }
+
+            if(value_len == 0 || options->snapshot) {
+                *errMsg = sqlite3_mprintf( "snapshot must be given a single file name" );
+                return SQLITE_ERROR;
+            }
+
+            options->snapshot = sqlite3_mprintf( "%.*s", (int) value_len, value );
+            if(! options->snapshot) {
+                return SQLITE_NOMEM;
+            }
+        } else if(name_len == 7 && !strncmp( argv[i], "promote", name_len )) {
+            int status;
+
+            if(options->promoted) {
+                *errMsg = sqlite3_mprintf( "promote may only be given once" );
+                return SQLITE_ERROR;
+            }
+
+            status = _parse_promoted_columns( options, value, errMsg );
+            if(status != SQLITE_OK) {
+                return status;
+            }
+        } else {
+            *errMsg = sqlite3_mprintf( "unknown option '%.*s'", (int) name_len, argv[i] );
+            return SQLITE_ERROR;
+        }
+    }
+
+    /* a snapshot carries its own rows and index, so none of the other
+     * options apply to it */
+    if(options->snapshot && argc > 1) {
+        *errMsg = sqlite3_mprintf( "snapshot can't be combined with other options" );
+        return SQLITE_ERROR;
+    }
+
+    return SQLITE_OK;
+}
+
+/* blob handles read a string's bytes as they're stored, so large_attributes
+ * needs a UTF-8 database */
+static int _check_large_attributes_encoding( struct attribute_vtab *vtab,
+    char **errMsg )
+{
+    sqlite3_stmt *stmt;
+    char *sql;
+    int status;
+
+    sql = sqlite3_mprintf( ENCODING_TMPL, vtab->database_name );
+    if(! sql) {
+        return SQLITE_NOMEM;
+    }
+
+    status = _prepare_statement( vtab, sql, &stmt );
+    sqlite3_free( sql );
+
+    if(status != SQLITE_OK) {
+        *errMsg = sqlite3_mprintf( "%s", sqlite3_errmsg( vtab->db ) );
+        return status;
+    }
+
+    status = sqlite3_step( stmt );
+    if(status == SQLITE_ROW) {
+        if(sqlite3_stricmp( (const char *) sqlite3_column_text( stmt, 0 ), "UTF-8" )) {
+            *errMsg = sqlite3_mprintf( "large_attributes requires a UTF-8 database" );
+            status  = SQLITE_ERROR;
+        } else {
+            status = SQLITE_OK;
+        }
+    } else {
+        *errMsg = sqlite3_mprintf( "%s", sqlite3_errmsg( vtab->db ) );
+    }
+    sqlite3_finalize( stmt );
+
+    return status;
+}
+
+/* returns non-zero if another connection has committed changes to the
+ * database since the last time we checked */
+static int _database_changed( struct attribute_vtab *vtab )
+{
+    int status;
+    int data_version;
+
+    if(! vtab->data_version_stmt) {
+        char *sql = sqlite3_mprintf( DATA_VERSION_TMPL, vtab->database_name );
+
+        if(! sql) {
+            return 1;
+        }
+        status = _prepare_statement( vtab, sql, &(vtab->data_version_stmt) );
+        sqlite3_free( sql );
+
+        if(status != SQLITE_OK) {
+            return 1;
+        }
+    }
+
+    if(sqlite3_step( vtab->data_version_stmt ) != SQLITE_ROW) {
+        sqlite3_reset( vtab->data_version_stmt );
+        return 1;
+    }
+    data_version = sqlite3_column_int( vtab->data_version_stmt, 0 );
+    sqlite3_reset( vtab->data_version_stmt );
+
+    if(data_version != vtab->data_version) {
+        vtab->data_version = data_version;
+        return 1;
+    }
+    return 0;
+}
+
+/* throws away any in-memory state that may have been invalidated by another
+ * connection */
+static void _discard_stale_state( struct attribute_vtab *vtab )
+{
+    if(! vtab->cache && ! vtab->options.bloom_bits) {
+        return;
+    }
+
+    if(_database_changed( vtab )) {
+        posting_cache_clear( vtab->cache );
+        bloom_set_free( vtab->blooms );
+        vtab->blooms = NULL;
+    }
+}
+
+static int _load_bloom_filters( struct attribute_vtab *vtab )
+{
+    struct bloom_filter_set *set;
+    sqlite3_stmt *stmt;
+    char *sql;
+    int status;
+
+    set = bloom_set_new( vtab->options.bloom_bits );
+    if(! set) {
+        return SQLITE_NOMEM;
+    }
+
+    sql = _allocate_select_bloom_sql( vtab->database_name, vtab->table_name );
+    if(! sql) {
+        bloom_set_free( set );
+        return SQLITE_NOMEM;
+    }
+
+    status = _prepare_statement( vtab, sql, &stmt );
+    sqlite3_free( sql );
+
+    if(status != SQLITE_OK) {
+        bloom_set_free( set );
+        return ERROR( vtab, status );
+    }
+
+    while((status = sqlite3_step( stmt )) == SQLITE_ROW) {
+        const char *key      = (const char *) sqlite3_column_text( stmt, SELECT_BLOOM_KEY_COL );
+        size_t key_len       = sqlite3_column_bytes( stmt, SELECT_BLOOM_KEY_COL );
+        const void *bits     = sqlite3_column_blob( stmt, SELECT_BLOOM_FILTER_COL );
+        size_t n_bytes       = sqlite3_column_bytes( stmt, SELECT_BLOOM_FILTER_COL );
+        struct bloom_filter *filter;
+
+        if(n_bytes == set->n_bits / 8) {
+            filter = bloom_set_add_filter( set, key, key_len, bits );
+        } else {
+            /* a filter we can't make sense of has to match everything */
+            filter = bloom_set_add_filter( set, key, key_len, NULL );
+            if(filter) {
+                memset( filter->bits, 0xff, set->n_bits / 8 );
+            }
+        }
+
+        if(! filter) {
+            status = SQLITE_NOMEM;
+            break;
+        }
+    }
+    sqlite3_finalize( stmt );
+
+    if(status != SQLITE_DONE) {
+        bloom_set_free( set );
+        return status == SQLITE_NOMEM ? status : ERROR( vtab, status );
+    }
+
+    vtab->blooms = set;
+
+    return SQLITE_OK;
+}
+
+/* returns zero if no row can possibly match the MATCH term match */
+static int _bloom_may_match( struct attribute_vtab *vtab, const char *match )
+{
+    struct bloom_filter *filter;
+    const char *value;
+
+    if(! vtab->options.bloom_bits) {
+        return 1;
+    }
+
+    if(! vtab->blooms && _load_bloom_filters( vtab ) != SQLITE_OK) {
+        return 1;
+    }
+
+    value = strchr( match, RECORD_SEPARATOR );
+
+    if(! value) {
+        return bloom_set_find( vtab->blooms, match, strlen( match ) ) != NULL;
+    }
+
+    filter = bloom_set_find( vtab->blooms, match, value - match );
+    if(! filter) {
+        return 0;
+    }
+    value++;
+
+    return bloom_filter_may_contain( vtab->blooms, filter, value, strlen( value ) );
+}
+
+/* ORs the stored bits of filter's key into filter, so that writing it back
+ * doesn't erase bits that another connection set after we loaded it */
+static int _merge_stored_bloom_filter( struct attribute_vtab *vtab,
+    struct bloom_filter *filter )
+{
+    size_t n_bytes = vtab->blooms->n_bits / 8;
+    int status;
+
+    status = sqlite3_bind_text( vtab->select_bloom_stmt, 1, filter->key,
+        filter->key_len, SQLITE_STATIC );
+    if(status != SQLITE_OK) {
+        return status;
+    }
+
+    status = sqlite3_step( vtab->select_bloom_stmt );
+
+    if(status == SQLITE_ROW) {
+        const unsigned char *bits = sqlite3_column_blob( vtab->select_bloom_stmt, 0 );
+        size_t i;
+
+        if(sqlite3_column_bytes( vtab->select_bloom_stmt, 0 ) != n_bytes) {
+            bits = NULL; /* see _load_bloom_filters */
+        }
+
+        for(i = 0; i < n_bytes; i++) {
+            filter->bits[i] |= bits ? bits[i] : 0xff;
+        }
+        status = SQLITE_DONE;
+    }
+    sqlite3_reset( vtab->select_bloom_stmt );
+
+    return status == SQLITE_DONE ? SQLITE_OK : status;
+}
+
+static int _flush_bloom_filters( struct attribute_vtab *vtab )
+{
+    int i;
+    int status;
+
+    if(! vtab->blooms) {
+        return SQLITE_OK;
+    }
+
+    for(i = 0; i < vtab->blooms->n_buckets; i++) {
+        struct bloom_filter *filter;
+
+        for(filter = vtab->blooms->buckets[i]; filter; filter = filter->next) {
+            if(! filter->dirty) {
+                continue;
+            }
+
+            status = _merge_stored_bloom_filter( vtab, filter );
+            if(status != SQLITE_OK) {
+                return ERROR( vtab, status );
+            }
+
+            status = sqlite3_bind_text( vtab->insert_bloom_stmt,
+                INSERT_BLOOM_KEY_COL, filter->key, filter->key_len,
+                SQLITE_STATIC );
+            if(status != SQLITE_OK) {
+                return ERROR( vtab, status );
+            }
+            status = sqlite3_bind_blob( vtab->insert_bloom_stmt,
+                INSERT_BLOOM_FILTER_COL, filter->bits,
+                vtab->blooms->n_bits / 8, SQLITE_STATIC );
+            if(status != SQLITE_OK) {
+                return ERROR( vtab, status );
+            }
+
+            status = sqlite3_step( vtab->insert_bloom_stmt );
+            sqlite3_reset( vtab->insert_bloom_stmt );
+
+            if(status != SQLITE_DONE) {
+                return ERROR( vtab, status );
+            }
+            filter->dirty = 0;
+        }
+    }
+
+    return SQLITE_OK;
+}
+
+/* prepares sql (if it could be allocated) and frees it */
+static int _prepare_allocated_statement( struct attribute_vtab *vtab,
+    char *sql, sqlite3_stmt **stmt )
+{
+    int status;
+
+    if(! sql) {
+        return SQLITE_NOMEM;
+    }
+
+    status = _prepare_statement( vtab, sql, stmt );
+
+    sqlite3_free( sql );
+
+    return status;
+}
+
+/* prepares the statements that read and write single rows, against
+ * table_name's sequence and attribute tables (for a partitioned table,
+ * table_name is the partition's name) */
+static int _prepare_row_statements( struct attribute_vtab *vtab,
+    const char *table_name )
+{
+    int status;
+
+    status = _prepare_allocated_statement( vtab,
+        _allocate_update_sequence_sql( vtab->database_name, table_name,
+            &(vtab->options) ),
+        &(vtab->update_seq_stmt) );
+
+    if(status != SQLITE_OK) {
+        return status;
+    }
+
+    status = _prepare_allocated_statement( vtab,
+        _allocate_delete_sequence_sql( vtab->database_name, table_name ),
+        &(vtab->delete_seq_stmt) );
+
+    if(status != SQLITE_OK) {
+        return status;
+    }
+
+    status = _prepare_allocated_statement( vtab,
+        _allocate_delete_posting_sql( vtab->database_name, table_name,
+            vtab->value_sql ),
+        &(vtab->delete_posting_stmt) );
+
+    if(status != SQLITE_OK) {
+        return status;
+    }
+
+    status = _prepare_allocated_statement( vtab,
+        _allocate_select_sequence_attributes_sql( vtab->database_name,
+            table_name ),
+        &(vtab->select_attrs_stmt) );
+
+    if(status != SQLITE_OK) {
+        return status;
+    }
+
+    status = _prepare_allocated_statement( vtab,
+        _allocate_insert_sequence_sql( vtab->database_name, table_name,
+            &(vtab->options) ),
+        &(vtab->insert_seq_stmt) );
+
+    if(status != SQLITE_OK) {
+        return status;
+    }
+
+    status = _prepare_allocated_statement( vtab,
+        _allocate_insert_attribute_sql( vtab->database_name, table_name,
+            vtab->value_sql ),
+        &(vtab->insert_attr_stmt) );
+
+    if(status != SQLITE_OK) {
+        return status;
+    }
+
+    if(vtab->options.partition_size) {
+        status = _prepare_allocated_statement( vtab,
+            _allocate_select_max_seq_id_sql( vtab->database_name,
+                table_name ),
+            &(vtab->max_seq_stmt) );
+    }
+
+    return status;
+}
+
+static void _finalize_row_statements( struct attribute_vtab *vtab )
+{
+    sqlite3_finalize( vtab->update_seq_stmt );
+    sqlite3_finalize( vtab->delete_seq_stmt );
+    sqlite3_finalize( vtab->delete_posting_stmt );
+    sqlite3_finalize( vtab->select_attrs_stmt );
     sqlite3_finalize( vtab->insert_seq_stmt );
+    sqlite3_finalize( vtab->insert_attr_stmt );
+    sqlite3_finalize( vtab->max_seq_stmt );
+
+    vtab->update_seq_stmt     = NULL;
+    vtab->delete_seq_stmt     = NULL;
+    vtab->delete_posting_stmt = NULL;
+    vtab->select_attrs_stmt   = NULL;
+    vtab->insert_seq_stmt     = NULL;
+    vtab->insert_attr_stmt    = NULL;
+    vtab->max_seq_stmt        = NULL;
+    vtab->has_partition       = 0;
+}
+
+/* prepares the statements that write to the table, the first time the
+ * table is written to; connecting to a table prepares nothing, so that
+ * opening a database with many tables (or only reading from them) doesn't
+ * pay for statements it never runs */
+static int _initialize_statements( struct attribute_vtab *vtab )
+{
+    char *sql;
+    int status = SQLITE_OK;
+
+    /* a partitioned table prepares its row statements for a partition as
+     * rows in it are written; see _use_partition */
+    if(vtab->options.partition_size) {
+        if(! vtab->newest_partition_stmt) {
+            status = _prepare_allocated_statement( vtab,
+                _allocate_select_newest_partition_sql( vtab->database_name,
+                    vtab->table_name ),
+                &(vtab->newest_partition_stmt) );
+        }
+    } else if(! vtab->update_seq_stmt) {
+        status = _prepare_row_statements( vtab, vtab->table_name );
+
+        if(status != SQLITE_OK) {
+            _finalize_row_statements( vtab );
+        }
+    }
+
+    if(status != SQLITE_OK) {
+        return status;
+    }
+
+    if(vtab->options.intern_values && ! vtab->insert_value_stmt) {
+        sql = _allocate_insert_value_sql( vtab->database_name,
+            vtab->table_name );
+
+        if(! sql) {
+            return SQLITE_NOMEM;
+        }
+
+        status = _prepare_statement( vtab, sql, &(vtab->insert_value_stmt) );
+
+        sqlite3_free( sql );
+
+        if(status != SQLITE_OK) {
+            return status;
+        }
+    }
+
+    if(vtab->options.bloom_bits && ! vtab->insert_bloom_stmt) {
+        sql = _allocate_insert_bloom_sql( vtab->database_name,
+            vtab->table_name );
+
+        if(! sql) {
+            return SQLITE_NOMEM;
+        }
+
+        status = _prepare_statement( vtab, sql, &(vtab->insert_bloom_stmt) );
+
+        sqlite3_free( sql );
+
+        if(status != SQLITE_OK) {
+            return status;
+        }
+
+        status = _prepare_allocated_statement( vtab,
+            _allocate_select_bloom_filter_sql( vtab->database_name,
+                vtab->table_name ),
+            &(vtab->select_bloom_stmt) );
+
+        if(status != SQLITE_OK) {
+            return status;
+        }
+    }
+
+    return SQLITE_OK;
+}
+
+static int _init_vtab( sqlite3 *db, void *udp, int argc,
+    char const * const *argv, int creating, sqlite3_vtab **vtab,
+    char **errMsg )
+{
+    char *sql;
+    struct attribute_vtab *avtab;
+    int status;
+
+    *vtab   = NULL;
+    *errMsg = NULL;
+
+    avtab = (struct attribute_vtab *) sqlite3_malloc(sizeof(struct attribute_vtab));
+    if(! avtab) {
+        return SQLITE_NOMEM;
+    }
+    memset(avtab, 0, sizeof(struct attribute_vtab));
+    avtab->db = db;
+
+    avtab->database_name = sqlite3_mprintf( "%s", argv[1] );
+    if(! avtab->database_name) {
+        attributes_disconnect((sqlite3_vtab *) avtab);
+        return SQLITE_NOMEM;
+    }
+
+    avtab->table_name = sqlite3_mprintf( "%s", argv[2] );
+    if(! avtab->table_name) {
+        attributes_disconnect((sqlite3_vtab *) avtab);
+        return SQLITE_NOMEM;
+    }
+
+    status = _parse_options( &(avtab->options), argc - 3, argv + 3, errMsg );
+    if(status != SQLITE_OK) {
+        attributes_disconnect((sqlite3_vtab *) avtab);
+        return status;
+    }
+
+    if(avtab->options.large_attributes) {
+        status = _check_large_attributes_encoding( avtab, errMsg );
+
+        if(status != SQLITE_OK) {
+            attributes_disconnect((sqlite3_vtab *) avtab);
+            return status;
+        }
+    }
+
+    avtab->select_columns      = _build_select_columns( &(avtab->options), 1 );
+    avtab->lazy_select_columns = _build_select_columns( &(avtab->options), 0 );
+    if(! avtab->select_columns || ! avtab->lazy_select_columns) {
+        attributes_disconnect((sqlite3_vtab *) avtab);
+        return SQLITE_NOMEM;
+    }
+
+    avtab->value_sql = _build_value_sql( avtab->database_name,
+        avtab->table_name, &(avtab->options) );
+    if(! avtab->value_sql) {
+        attributes_disconnect((sqlite3_vtab *) avtab);
+        return SQLITE_NOMEM;
+    }
+
+    if(avtab->options.cache_size) {
+        avtab->cache = posting_cache_new( avtab->options.cache_size );
+        if(! avtab->cache) {
+            attributes_disconnect((sqlite3_vtab *) avtab);
+            return SQLITE_NOMEM;
+        }
+    }
+
+    sql = _build_schema( &(avtab->options) );
+    if(! sql) {
+        attributes_disconnect((sqlite3_vtab *) avtab);
+        return SQLITE_NOMEM;
+    }
+
+    status = sqlite3_declare_vtab( db, sql );
+    sqlite3_free(sql);
+
+    if(status != SQLITE_OK) {
+        ERROR( avtab, status );
+        *errMsg = avtab->vtab.zErrMsg;
+        attributes_disconnect((sqlite3_vtab *) avtab);
+        return status;
+    }
+
+    /* attributes_update resolves its own conflicts; see _perform_insert */
+    sqlite3_vtab_config( db, SQLITE_VTAB_CONSTRAINT_SUPPORT, 1 );
+
+    /* the snapshot is checksummed when the table is created; after that,
+     * only its header and offsets are checked.  a snapshot that's gone
+     * missing or bad since doesn't stop the table from being connected (so
+     * it can still be dropped); querying it reports the problem instead */
+    if(avtab->options.snapshot) {
+        status = snapshot_open( avtab->options.snapshot, creating,
+            &(avtab->snapshot), errMsg );
+
+        if(status != SQLITE_OK && (creating || status == SQLITE_NOMEM)) {
+            attributes_disconnect((sqlite3_vtab *) avtab);
+            return status;
+        }
+
+        if(status != SQLITE_OK) {
+            avtab->snapshot_error = *errMsg;
+            *errMsg               = NULL;
+        }
+    }
+
+    avtab->module = (struct attribute_module *) udp;
+    avtab->next   = avtab->module->vtabs;
+    avtab->module->vtabs = avtab;
+
+    *vtab = (sqlite3_vtab *) avtab;
+
+    return SQLITE_OK;
+}
+
+static int _read_layout_version( struct attribute_vtab *vtab )
+{
+    sqlite3_stmt *stmt;
+    char *sql;
+    int version = 1; /* version 1 tables have no config table */
+
+    sql = _allocate_select_version_sql( vtab->database_name, vtab->table_name );
+    if(! sql) {
+        return version;
+    }
+
+    if(_prepare_statement( vtab, sql, &stmt ) == SQLITE_OK) {
+        if(sqlite3_step( stmt ) == SQLITE_ROW) {
+            version = sqlite3_column_int( stmt, 0 );
+        }
+        sqlite3_finalize( stmt );
+    }
+    sqlite3_free( sql );
+
+    return version;
+}
+
+/* upgrades an older table's shadow tables to the current layout.  a
+ * read-only database keeps the old layout, which reads and writes like the
+ * new one (if more slowly), as does a connection that can't get the lock
+ * because another connection is writing; the upgrade is tried again the next
+ * time the table is connected.  if the upgrade fails for any other reason,
+ * the table can't be used until it succeeds */
+static int _upgrade_layout( struct attribute_vtab *vtab, char **errMsg )
+{
+    char *sql;
+    int status;
+    int busy;
+
+    if(vtab->layout_version >= LAYOUT_VERSION ||
+        sqlite3_db_readonly( vtab->db, vtab->database_name )) {
+        return SQLITE_OK;
+    }
+
+    sql = _allocate_migrate_v1_sql( vtab->database_name, vtab->table_name );
+    if(! sql) {
+        return SQLITE_NOMEM;
+    }
+
+    status = sqlite3_exec( vtab->db, sql, NULL, NULL, NULL );
+    sqlite3_free( sql );
+
+    if(status == SQLITE_OK) {
+        vtab->layout_version = LAYOUT_VERSION;
+        return SQLITE_OK;
+    }
+
+    busy = (status & 0xff) == SQLITE_BUSY || (status & 0xff) == SQLITE_LOCKED;
+    if(! busy) {
+        *errMsg = sqlite3_mprintf( "unable to upgrade the layout of %s: %s",
+            vtab->table_name, sqlite3_errmsg( vtab->db ) );
+    }
+    sqlite3_exec( vtab->db, "ROLLBACK TO attributes_migrate; RELEASE attributes_migrate",
+        NULL, NULL, NULL );
+
+    return busy ? SQLITE_OK : status;
+}
+
+/* attributes_optimize rewrites postings in primary key order, which they only
+ * have from layout version 2 on, so it (and attributes_rebuild, which calls
+ * it) refuses tables that haven't been upgraded.  a connection only reads the
+ * layout version if it can write (see attributes_connect) */
+static const char *_old_layout_error( struct attribute_vtab *vtab )
+{
+    return sqlite3_db_readonly( vtab->db, vtab->database_name ) ?
+        "attribute table is in a read-only database" :
+        "attribute table's layout hasn't been upgraded";
+}
+
+static int attributes_connect( sqlite3 *db, void *udp, int argc,
+    char const * const *argv, sqlite3_vtab **vtab, char **errMsg )
+{
+    struct attribute_vtab *avtab;
+    int status;
+
+    status = _init_vtab( db, udp, argc, argv, 0, vtab, errMsg );
+    if(status != SQLITE_OK) {
+        return status;
+    }
+
+    avtab = (struct attribute_vtab *) *vtab;
+    if(avtab->options.snapshot) {
+        return SQLITE_OK;
+    }
+
+    /* only a connection that can write upgrades the layout, so others don't
+     * need to know what it is */
+    if(! sqlite3_db_readonly( db, avtab->database_name )) {
+        avtab->layout_version = _read_layout_version( avtab );
+        status = _upgrade_layout( avtab, errMsg );
+
+        if(status != SQLITE_OK) {
+            attributes_disconnect((sqlite3_vtab *) avtab);
+            *vtab = NULL;
+            return status;
+        }
+    }
+
+    return SQLITE_OK;
+}
+
+/* creates the sequence table (and its promoted column indexes) and the
+ * attribute table for table_name; for a partitioned table, that's the name
+ * of one of its partitions */
+static int _create_row_tables( sqlite3 *db, const char *database_name,
+    const char *table_name, const struct attribute_options *options,
+    char **errMsg )
+{
+    char *sql;
+    int status;
+    int i;
+
+    sql = _allocate_sequence_schema_sql( database_name, table_name, options );
+
+    if(! sql) {
+        return SQLITE_NOMEM;
+    }
+
+    status = sqlite3_exec( db, sql, NULL, NULL, errMsg );
+    sqlite3_free( sql );
+
+    if(status != SQLITE_OK) {
+        return status;
+    }
+
+    for(i = 0; i < options->n_promoted; i++) {
+        sql = _allocate_promoted_index_sql( database_name, table_name, i,
+            options->promoted[i].key );
+
+        if(! sql) {
+            return SQLITE_NOMEM;
+        }
+
+        status = sqlite3_exec( db, sql, NULL, NULL, errMsg );
+        sqlite3_free( sql );
+
+        if(status != SQLITE_OK) {
+            return status;
+        }
+    }
+
+    sql = _allocate_attribute_schema_sql( database_name, table_name, options );
+
+    if(! sql) {
+        return SQLITE_NOMEM;
+    }
+
+    status = sqlite3_exec( db, sql, NULL, NULL, errMsg );
+    sqlite3_free( sql );
+
+    return status;
+}
+
+static int attributes_create( sqlite3 *db, void *udp, int argc,
+    char const * const *argv, sqlite3_vtab **vtab, char **errMsg )
+{
+    const char *database_name = argv[1];
+    const char *table_name    = argv[2];
+    char *sql                 = NULL;
+    struct attribute_options *options;
+
+    int status = _init_vtab( db, udp, argc, argv, 1, vtab, errMsg );
+
+    if(status != SQLITE_OK) {
+        goto error_handler;
+    }
+
+    options = &(((struct attribute_vtab *) *vtab)->options);
+    ((struct attribute_vtab *) *vtab)->layout_version = LAYOUT_VERSION;
+
+    /* a snapshot's rows and index live in the snapshot file */
+    if(options->snapshot) {
+        goto done;
+    }
+
+    if(options->partition_size) {
+        sql = _allocate_partitions_schema_sql( database_name, table_name );
+
+        if(! sql) {
+            status = SQLITE_NOMEM;
+            goto error_handler;
+        }
+
+        status = sqlite3_exec( db, sql, NULL, NULL, errMsg );
+
+        if(status != SQLITE_OK) {
+            goto error_handler;
+        }
+
+        sqlite3_free( sql );
+
+        sql = _allocate_partition_views_sql( database_name, table_name,
+            options, NULL, 0 );
+
+        if(! sql) {
+            status = SQLITE_NOMEM;
+            goto error_handler;
+        }
+
+        status = sqlite3_exec( db, sql, NULL, NULL, errMsg );
+
+        if(status != SQLITE_OK) {
+            goto error_handler;
+        }
+
+        sqlite3_free( sql );
+        sql = NULL;
+    } else {
+        status = _create_row_tables( db, database_name, table_name, options,
+            errMsg );
+
+        if(status != SQLITE_OK) {
+            goto error_handler;
+        }
+    }
+
+    if(options->intern_values) {
+        sql = _allocate_values_schema_sql( database_name, table_name );
+
+        if(! sql) {
+            status = SQLITE_NOMEM;
+            goto error_handler;
+        }
+
+        status = sqlite3_exec( db, sql, NULL, NULL, errMsg );
+
+        if(status != SQLITE_OK) {
+            goto error_handler;
+        }
+
+        sqlite3_free( sql );
+    }
+
+    sql = _allocate_config_schema_sql( database_name, table_name );
+
+    if(! sql) {
+        status = SQLITE_NOMEM;
+        goto error_handler;
+    }
+
+    status = sqlite3_exec( db, sql, NULL, NULL, errMsg );
+
+    if(status != SQLITE_OK) {
+        goto error_handler;
+    }
+
+    sqlite3_free( sql );
+
+    sql = NULL;
+
+    if(options->bloom_bits) {
+        sql = _allocate_bloom_schema_sql( database_name, table_name );
+
+        if(! sql) {
+            status = SQLITE_NOMEM;
+            goto error_handler;
+        }
+
+        status = sqlite3_exec( db, sql, NULL, NULL, errMsg );
+
+        if(status != SQLITE_OK) {
+            goto error_handler;
+        }
+
+        sqlite3_free( sql );
+
+        sql = NULL;
+    }
+
+    goto done;
+
+error_handler:
+    if(sql) {
+        sqlite3_free( sql );
+    }
+    if(*vtab) {
+        attributes_destroy( *vtab );
+    }
+    if(! *errMsg) {
+        *errMsg = sqlite3_mprintf( "%s", sqlite3_errmsg( db ) );
+    }
+done:
+    return status;
+}
+
+static int _execute_allocated_sql( struct attribute_vtab *vtab, char *sql )
+{
+    int status;
+
+    if(! sql) {
+        return SQLITE_NOMEM;
+    }
+
+    status = sqlite3_exec( vtab->db, sql, NULL, NULL, NULL );
+    sqlite3_free( sql );
+
+    return status;
+}
+
+/* returns the partition of a partitioned table that rowid belongs in */
+static sqlite3_int64 _partition_for( const struct attribute_vtab *vtab,
+    sqlite3_int64 rowid )
+{
+    sqlite3_int64 size = vtab->options.partition_size;
+
+    /* round towards negative infinity, so that every partition has the
+     * same number of ids */
+    return rowid >= 0 ? rowid / size : -((-(rowid + 1)) / size) - 1;
+}
+
+/* reads the ids of the partitions below limit (or of every partition, if
+ * all is set) into *partitions, in ascending order */
+static int _read_partitions( struct attribute_vtab *vtab, int all,
+    sqlite3_int64 limit, sqlite3_int64 **partitions, int *n_partitions )
+{
+    sqlite3_stmt *stmt;
+    int capacity = 0;
+    int status;
+
+    *partitions   = NULL;
+    *n_partitions = 0;
+
+    status = _prepare_allocated_statement( vtab,
+        _allocate_select_partitions_sql( vtab->database_name,
+            vtab->table_name ),
+        &stmt );
+
+    if(status != SQLITE_OK) {
+        return status;
+    }
+
+    if(! all) {
+        status = sqlite3_bind_int64( stmt, 1, limit );
+    }
+
+    while(status == SQLITE_OK && (status = sqlite3_step( stmt )) == SQLITE_ROW) {
+        if(*n_partitions == capacity) {
+            sqlite3_int64 *resized;
+
+            capacity = capacity ? capacity * 2 : 16;
+            resized  = sqlite3_realloc( *partitions, capacity * sizeof(sqlite3_int64) );
+            if(! resized) {
+                status = SQLITE_NOMEM;
+                break;
+            }
+            *partitions = resized;
+        }
+        (*partitions)[(*n_partitions)++] = sqlite3_column_int64( stmt, 0 );
+        status = SQLITE_OK;
+    }
+    sqlite3_finalize( stmt );
+
+    if(status != SQLITE_DONE) {
+        sqlite3_free( *partitions );
+        *partitions   = NULL;
+        *n_partitions = 0;
+        return status;
+    }
+
+    return SQLITE_OK;
+}
+
+/* recreates the views over a partitioned table's partitions */
+static int _rebuild_partition_views( struct attribute_vtab *vtab )
+{
+    sqlite3_int64 *partitions;
+    int n_partitions;
+    int status;
+
+    status = _read_partitions( vtab, 1, 0, &partitions, &n_partitions );
+
+    if(status != SQLITE_OK) {
+        return status;
+    }
+
+    status = _execute_allocated_sql( vtab,
+        _allocate_partition_views_sql( vtab->database_name, vtab->table_name,
+            &(vtab->options), partitions, n_partitions ) );
+    sqlite3_free( partitions );
+
+    return status;
+}
+
+static int _create_partition( struct attribute_vtab *vtab,
+    sqlite3_int64 partition )
+{
+    char *partition_name;
+    int status;
+
+    partition_name = _allocate_partition_name( vtab->table_name, partition );
+
+    if(! partition_name) {
+        return SQLITE_NOMEM;
+    }
+
+    status = _create_row_tables( vtab->db, vtab->database_name,
+        partition_name, &(vtab->options), NULL );
+    sqlite3_free( partition_name );
+
+    if(status == SQLITE_OK) {
+        status = _execute_allocated_sql( vtab,
+            _allocate_insert_partition_sql( vtab->database_name,
+                vtab->table_name, partition ) );
+    }
+
+    if(status == SQLITE_OK) {
+        status = _rebuild_partition_views( vtab );
+    }
+
+    return status;
+}
+
+/* points the row statements at the partition that rowid belongs in (for a
+ * table that isn't partitioned, they're always ready).  a partition that
+ * doesn't exist yet is created if create is set; otherwise SQLITE_NOTFOUND
+ * is returned, since there can't be a row with that id */
+static int _use_partition( struct attribute_vtab *vtab, sqlite3_int64 rowid,
+    int create )
+{
+    sqlite3_int64 partition;
+    sqlite3_stmt *stmt;
+    char *partition_name;
+    int status;
+
+    if(! vtab->options.partition_size) {
+        return SQLITE_OK;
+    }
+
+    partition = _partition_for( vtab, rowid );
+
+    if(vtab->has_partition && vtab->partition == partition) {
+        return SQLITE_OK;
+    }
+
+    _finalize_row_statements( vtab );
+
+    status = _prepare_allocated_statement( vtab,
+        _allocate_select_partition_sql( vtab->database_name,
+            vtab->table_name ),
+        &stmt );
+
+    if(status != SQLITE_OK) {
+        return status;
+    }
+
+    status = sqlite3_bind_int64( stmt, 1, partition );
+    if(status == SQLITE_OK) {
+        status = sqlite3_step( stmt );
+    }
+    sqlite3_finalize( stmt );
+
+    if(status == SQLITE_DONE) {
+        if(! create) {
+            return SQLITE_NOTFOUND;
+        }
+        status = _create_partition( vtab, partition );
+    } else if(status == SQLITE_ROW) {
+        status = SQLITE_OK;
+    }
+
+    if(status != SQLITE_OK) {
+        return status;
+    }
+
+    partition_name = _allocate_partition_name( vtab->table_name, partition );
+
+    if(! partition_name) {
+        return SQLITE_NOMEM;
+    }
+
+    status = _prepare_row_statements( vtab, partition_name );
+    sqlite3_free( partition_name );
+
+    if(status != SQLITE_OK) {
+        _finalize_row_statements( vtab );
+        return status;
+    }
+
+    vtab->partition     = partition;
+    vtab->has_partition = 1;
+
+    return SQLITE_OK;
+}
+
+/* points *blob at the attribute string of row rowid, by moving the handle
+ * that's already open if it's on the right sequence table (for partitioned
+ * tables, *partition's) or opening a new one.  a handle that's been expired
+ * by a write to its row can't be moved, so it's replaced */
+static int _open_attributes_blob( struct attribute_vtab *vtab,
+    sqlite3_blob **blob, sqlite3_int64 *partition, sqlite3_int64 rowid )
+{
+    sqlite3_int64 row_partition = vtab->options.partition_size ?
+        _partition_for( vtab, rowid ) : 0;
+    char *sequence_name;
+    int status;
+
+    if(*blob && *partition == row_partition &&
+        sqlite3_blob_reopen( *blob, rowid ) == SQLITE_OK) {
+        return SQLITE_OK;
+    }
+
+    sqlite3_blob_close( *blob );
+    *blob = NULL;
+
+    if(vtab->options.partition_size) {
+        sequence_name = _allocate_partition_name( vtab->table_name, row_partition );
+        if(sequence_name) {
+            sequence_name = sqlite3_mprintf( "%z_Sequence", sequence_name );
+        }
+    } else {
+        sequence_name = sqlite3_mprintf( "%s_Sequence", vtab->table_name );
+    }
+
+    if(! sequence_name) {
+        return SQLITE_NOMEM;
+    }
+
+    status = sqlite3_blob_open( vtab->db, vtab->database_name, sequence_name,
+        "attributes", rowid, 0, blob );
+    sqlite3_free( sequence_name );
+
+    if(status == SQLITE_OK) {
+        *partition = row_partition;
+    }
+
+    return status;
+}
+
+/* reads the attribute string of row rowid through *blob (see
+ * _open_attributes_blob) into a buffer from sqlite3_malloc, which the caller
+ * takes ownership of */
+static int _read_attributes_blob( struct attribute_vtab *vtab,
+    sqlite3_blob **blob, sqlite3_int64 *partition, sqlite3_int64 rowid,
+    char **attributes, int *n_bytes )
+{
+    char *buffer;
+    int status;
+    int size;
+
+    status = _open_attributes_blob( vtab, blob, partition, rowid );
+    if(status != SQLITE_OK) {
+        return status;
+    }
+
+    size   = sqlite3_blob_bytes( *blob );
+    buffer = sqlite3_malloc64( (sqlite3_uint64) size + 1 );
+    if(! buffer) {
+        return SQLITE_NOMEM;
+    }
+
+    status = sqlite3_blob_read( *blob, buffer, size, 0 );
+    if(status != SQLITE_OK) {
+        sqlite3_free( buffer );
+        return status;
+    }
+    buffer[size] = '\0';
+
+    *attributes = buffer;
+    *n_bytes    = size;
+
+    return SQLITE_OK;
+}
+
+/* picks the id of a new row in a partitioned table: one past the largest id
+ * in the newest partition, since older partitions only hold smaller ids */
+static int _next_partitioned_rowid( struct attribute_vtab *vtab,
+    sqlite_int64 *rowid )
+{
+    sqlite3_int64 partition;
+    sqlite3_int64 first;
+    int status;
+
+    status = sqlite3_step( vtab->newest_partition_stmt );
+
+    if(status != SQLITE_ROW) {
+        sqlite3_reset( vtab->newest_partition_stmt );
+        return status;
+    }
+
+    if(sqlite3_column_type( vtab->newest_partition_stmt, 0 ) == SQLITE_NULL) {
+        sqlite3_reset( vtab->newest_partition_stmt );
+        *rowid = 1;
+        return SQLITE_OK;
+    }
+
+    partition = sqlite3_column_int64( vtab->newest_partition_stmt, 0 );
+    first     = partition * vtab->options.partition_size;
+    sqlite3_reset( vtab->newest_partition_stmt );
+
+    status = _use_partition( vtab, first, 0 );
+
+    if(status != SQLITE_OK) {
+        return status;
+    }
+
+    status = sqlite3_step( vtab->max_seq_stmt );
+
+    if(status != SQLITE_ROW) {
+        sqlite3_reset( vtab->max_seq_stmt );
+        return status;
+    }
+
+    if(sqlite3_column_type( vtab->max_seq_stmt, 0 ) == SQLITE_NULL) {
+        *rowid = first > 0 ? first : 1;
+    } else {
+        *rowid = sqlite3_column_int64( vtab->max_seq_stmt, 0 ) + 1;
+    }
+    sqlite3_reset( vtab->max_seq_stmt );
+
+    return SQLITE_OK;
+}
+
+/* drops the partitions below limit (or every partition, if all is set) and
+ * sets *n_dropped to how many there were */
+static int _drop_partitions( struct attribute_vtab *vtab, int all,
+    sqlite3_int64 limit, int *n_dropped )
+{
+    sqlite3_int64 *partitions;
+    int n_partitions;
+    int status;
+    int i;
+
+    /* the row statements may refer to a partition that's about to go away */
+    _finalize_row_statements( vtab );
+
+    status = _read_partitions( vtab, all, limit, &partitions, &n_partitions );
+
+    if(status != SQLITE_OK) {
+        return status;
+    }
+
+    for(i = 0; status == SQLITE_OK && i < n_partitions; i++) {
+        status = _execute_allocated_sql( vtab,
+            _allocate_drop_partition_sql( vtab->database_name,
+                vtab->table_name, partitions[i] ) );
+    }
+    sqlite3_free( partitions );
+
+    if(status == SQLITE_OK && n_partitions && ! all) {
+        status = _rebuild_partition_views( vtab );
+    }
+
+    if(status != SQLITE_OK) {
+        return status;
+    }
+
+    posting_cache_clear( vtab->cache );
+    *n_dropped = n_partitions;
+
+    return SQLITE_OK;
+}
+
+static void _clear_optimize_position( struct attribute_vtab *vtab )
+{
+    int i;
+
+    for(i = 0; i < OPTIMIZE_MAX_KEY; i++) {
+        sqlite3_value_free( vtab->optimize_position[i] );
+        vtab->optimize_position[i] = NULL;
+    }
+}
+
+static int attributes_disconnect( sqlite3_vtab *_vtab )
+{
+    struct attribute_vtab *vtab = (struct attribute_vtab *) _vtab;
+
+    if(vtab->module) {
+        struct attribute_vtab **p = &(vtab->module->vtabs);
+
+        while(*p != vtab) {
+            p = &((*p)->next);
+        }
+        *p = vtab->next;
+    }
+
+    posting_cache_free( vtab->cache );
+    bloom_set_free( vtab->blooms );
+    snapshot_close( vtab->snapshot );
+    sqlite3_free( vtab->snapshot_error );
+    sqlite3_finalize( vtab->data_version_stmt );
+    sqlite3_finalize( vtab->insert_bloom_stmt );
+    sqlite3_finalize( vtab->select_bloom_stmt );
+    sqlite3_finalize( vtab->insert_value_stmt );
+    sqlite3_finalize( vtab->newest_partition_stmt );
+    _finalize_row_statements( vtab );
+    _free_options( &(vtab->options) );
+    sqlite3_free( vtab->select_columns );
+    sqlite3_free( vtab->lazy_select_columns );
+    sqlite3_free( vtab->value_sql );
+    sqlite3_finalize( vtab->row_estimate_stmt );
+    _clear_statement_report( &(vtab->last_statement) );
+    _clear_optimize_position( vtab );
     sqlite3_free( vtab->database_name );
     sqlite3_free( vtab->table_name );
     sqlite3_free( vtab );
@@ -556,481 +4573,3721 @@ static int attributes_disconnect( sqlite3_vtab *_vtab )
     return SQLITE_OK;
 }
 
-static int attributes_destroy( sqlite3_vtab *_vtab )
+static int attributes_destroy( sqlite3_vtab *_vtab )
+{
+    char *sql;
+    struct attribute_vtab *vtab;
+    sqlite3 *db;
+    char *database_name;
+    char *table_name;
+    int status;
+    int return_status = SQLITE_OK;
+
+    vtab          = (struct attribute_vtab *) _vtab;
+    db            = vtab->db;
+    database_name = vtab->database_name;
+    table_name    = vtab->table_name;
+
+    /* dropping a snapshot table leaves the snapshot file alone */
+    if(vtab->options.snapshot) {
+        return attributes_disconnect( _vtab );
+    }
+
+    if(vtab->options.partition_size) {
+        int n_dropped;
+
+        status = _drop_partitions( vtab, 1, 0, &n_dropped );
+        if(status != SQLITE_OK) {
+            return_status = status;
+        }
+
+        sql = _allocate_drop_partition_views_sql( database_name, table_name );
+    } else {
+        sql = _allocate_drop_sequence_schema_sql( database_name, table_name );
+    }
+
+    if(! sql ) {
+        return_status = SQLITE_NOMEM;
+    } else {
+        status = sqlite3_exec( db, sql, NULL, NULL, NULL );
+        if(status != SQLITE_OK) {
+            return_status = status;
+        }
+
+        sqlite3_free( sql );
+
+        /* a partitioned table's attribute tables went with its partitions */
+        if(! vtab->options.partition_size) {
+            sql = _allocate_drop_attribute_schema_sql( database_name, table_name );
+
+            if(! sql) {
+                return_status = SQLITE_NOMEM;
+            } else {
+                status = sqlite3_exec( db, sql, NULL, NULL, NULL );
+                if(status != SQLITE_OK) {
+                    return_status = status;
+                }
+
+                sqlite3_free( sql );
+            }
+        }
+
+        sql = _allocate_drop_config_schema_sql( database_name, table_name );
+
+        if(! sql) {
+            return_status = SQLITE_NOMEM;
+        } else {
+            status = sqlite3_exec( db, sql, NULL, NULL, NULL );
+            if(status != SQLITE_OK) {
+                return_status = status;
+            }
+
+            sqlite3_free( sql );
+        }
+
+        sql = _allocate_drop_values_schema_sql( database_name, table_name );
+
+        if(! sql) {
+            return_status = SQLITE_NOMEM;
+        } else {
+            status = sqlite3_exec( db, sql, NULL, NULL, NULL );
+            if(status != SQLITE_OK) {
+                return_status = status;
+            }
+
+            sqlite3_free( sql );
+        }
+
+        sql = _allocate_drop_bloom_schema_sql( database_name, table_name );
+
+        if(! sql) {
+            return_status = SQLITE_NOMEM;
+        } else {
+            status = sqlite3_exec( db, sql, NULL, NULL, NULL );
+            if(status != SQLITE_OK) {
+                return_status = status;
+            }
+
+            sqlite3_free( sql );
+        }
+    }
+
+    status = attributes_disconnect( _vtab );
+    if(status != SQLITE_OK) {
+        return_status = status;
+    }
+
+    return return_status;
+}
+
+/* a key-value pair of an attribute string; key and value point into the
+ * string */
+struct attribute_pair {
+    const char *key;
+    size_t key_len;
+    const char *value;
+    size_t value_len;
+    int order; /* position of the pair in the attribute string */
+};
+
+/* the pairs of an attribute string, sorted by key */
+struct attribute_set {
+    struct attribute_pair *pairs;
+    int n_pairs;
+    int capacity;
+    int error_code;
+};
+
+static int _collect_pairs( const char *key, size_t key_len,
+    const char *value, size_t value_len, void *udata )
+{
+    struct attribute_set *set = (struct attribute_set *) udata;
+    struct attribute_pair *pair;
+
+    if(set->n_pairs == set->capacity) {
+        int new_capacity = set->capacity ? set->capacity * 2 : 16;
+        struct attribute_pair *pairs;
+
+        pairs = sqlite3_realloc( set->pairs, new_capacity * sizeof(struct attribute_pair) );
+        if(! pairs) {
+            set->error_code = SQLITE_NOMEM;
+            return BREAK;
+        }
+        set->pairs    = pairs;
+        set->capacity = new_capacity;
+    }
+
+    pair = set->pairs + set->n_pairs;
+
+    pair->key       = key;
+    pair->key_len   = key_len;
+    pair->value     = value;
+    pair->value_len = value_len;
+    pair->order     = set->n_pairs;
+    set->n_pairs++;
+
+    return CONTINUE;
+}
+
+static int _compare_keys( const void *a, const void *b )
+{
+    const struct attribute_pair *pair_a = (const struct attribute_pair *) a;
+    const struct attribute_pair *pair_b = (const struct attribute_pair *) b;
+    int cmp;
+
+    cmp = memcmp( pair_a->key, pair_b->key,
+        pair_a->key_len < pair_b->key_len ? pair_a->key_len : pair_b->key_len );
+
+    if(cmp) {
+        return cmp;
+    }
+    return (pair_a->key_len > pair_b->key_len) - (pair_a->key_len < pair_b->key_len);
+}
+
+static int _compare_pairs( const void *a, const void *b )
+{
+    int cmp = _compare_keys( a, b );
+
+    if(cmp) {
+        return cmp;
+    }
+    return ((const struct attribute_pair *) a)->order - ((const struct attribute_pair *) b)->order;
+}
+
+static int _compare_pair_order( const void *a, const void *b )
+{
+    return ((const struct attribute_pair *) a)->order - ((const struct attribute_pair *) b)->order;
+}
+
+static void attribute_set_free( struct attribute_set *set )
+{
+    sqlite3_free( set->pairs );
+    memset( set, 0, sizeof(struct attribute_set) );
+}
+
+/* splits attributes into set.  a key that appears more than once is a
+ * constraint violation (the attribute table's primary key doesn't catch this,
+ * since two values for the same key are two distinct postings), unless
+ * last_wins is set, in which case the key keeps its first position and its
+ * last value, and *merged is set */
+static int attribute_set_parse( struct attribute_set *set, const char *attributes,
+    int last_wins, int *merged )
+{
+    int i, j;
+
+    memset( set, 0, sizeof(struct attribute_set) );
+    set->error_code = SQLITE_OK;
+    *merged         = 0;
+
+    iterate_over_kv_pairs( attributes, _collect_pairs, set );
+
+    if(set->error_code != SQLITE_OK) {
+        int status = set->error_code;
+
+        attribute_set_free( set );
+        return status;
+    }
+
+    if(set->n_pairs > 1) {
+        qsort( set->pairs, set->n_pairs, sizeof(struct attribute_pair), _compare_pairs );
+    }
+
+    for(i = 0, j = 0; i < set->n_pairs; i++) {
+        if(j > 0 && ! _compare_keys( set->pairs + j - 1, set->pairs + i )) {
+            if(! last_wins) {
+                attribute_set_free( set );
+                return SQLITE_CONSTRAINT;
+            }
+            set->pairs[j - 1].value     = set->pairs[i].value;
+            set->pairs[j - 1].value_len = set->pairs[i].value_len;
+            *merged = 1;
+        } else {
+            set->pairs[j++] = set->pairs[i];
+        }
+    }
+    set->n_pairs = j;
+
+    return SQLITE_OK;
+}
+
+static const struct attribute_pair *attribute_set_find( const struct attribute_set *set,
+    const char *key, size_t key_len )
+{
+    struct attribute_pair needle;
+
+    if(! set->n_pairs) {
+        return NULL;
+    }
+
+    needle.key     = key;
+    needle.key_len = key_len;
+
+    return bsearch( &needle, set->pairs, set->n_pairs,
+        sizeof(struct attribute_pair), _compare_keys );
+}
+
+/* fills merged with base's pairs, overridden by overrides' pairs; keys that
+ * only overrides has go after all of base's */
+static int attribute_set_merge( struct attribute_set *merged,
+    const struct attribute_set *base, const struct attribute_set *overrides )
+{
+    int base_end = 0;
+    int i = 0, j = 0;
+
+    memset( merged, 0, sizeof(struct attribute_set) );
+    merged->capacity = base->n_pairs + overrides->n_pairs;
+    merged->pairs    = sqlite3_malloc( merged->capacity * sizeof(struct attribute_pair) );
+
+    if(! merged->pairs) {
+        return SQLITE_NOMEM;
+    }
+
+    for(i = 0; i < base->n_pairs; i++) {
+        if(base->pairs[i].order >= base_end) {
+            base_end = base->pairs[i].order + 1;
+        }
+    }
+
+    i = 0;
+    while(i < base->n_pairs || j < overrides->n_pairs) {
+        struct attribute_pair *pair = merged->pairs + merged->n_pairs++;
+        int cmp;
+
+        if(i == base->n_pairs) {
+            cmp = 1;
+        } else if(j == overrides->n_pairs) {
+            cmp = -1;
+        } else {
+            cmp = _compare_keys( base->pairs + i, overrides->pairs + j );
+        }
+
+        if(cmp < 0) {
+            *pair = base->pairs[i++];
+        } else {
+            *pair = overrides->pairs[j++];
+
+            if(cmp == 0) {
+                pair->order = base->pairs[i++].order;
+            } else {
+                pair->order += base_end;
+            }
+        }
+    }
+
+    return SQLITE_OK;
+}
+
+/* joins set's pairs back into an attribute string, in their original order */
+static char *attribute_set_to_string( const struct attribute_set *set )
+{
+    struct attribute_pair *pairs;
+    char *attributes;
+    char *p;
+    size_t length = 0;
+    int i;
+
+    pairs = sqlite3_malloc( set->n_pairs * sizeof(struct attribute_pair) );
+    if(! pairs) {
+        return NULL;
+    }
+    memcpy( pairs, set->pairs, set->n_pairs * sizeof(struct attribute_pair) );
+    qsort( pairs, set->n_pairs, sizeof(struct attribute_pair), _compare_pair_order );
+
+    for(i = 0; i < set->n_pairs; i++) {
+        length += pairs[i].key_len + 1 + pairs[i].value_len + 1;
+    }
+
+    /* the last pair's trailing separator makes room for the NUL */
+    attributes = sqlite3_malloc( length );
+    if(! attributes) {
+        sqlite3_free( pairs );
+        return NULL;
+    }
+
+    p = attributes;
+    for(i = 0; i < set->n_pairs; i++) {
+        memcpy( p, pairs[i].key, pairs[i].key_len );
+        p += pairs[i].key_len;
+        *p++ = RECORD_SEPARATOR;
+        memcpy( p, pairs[i].value, pairs[i].value_len );
+        p += pairs[i].value_len;
+        *p++ = RECORD_SEPARATOR;
+    }
+    p[-1] = '\0';
+
+    sqlite3_free( pairs );
+
+    return attributes;
+}
+
+/* adds rowid to (or removes it from) the cached list for pair's key-value
+ * term, and for its key term if with_key is set */
+static void _patch_posting_cache( struct posting_cache *cache,
+    const struct attribute_pair *pair, int with_key, sqlite3_int64 rowid,
+    int add )
+{
+    size_t term_len = pair->key_len + 1 + pair->value_len;
+    char *term;
+
+    if(with_key) {
+        if(add) {
+            posting_cache_add_seq_id( cache, pair->key, pair->key_len, rowid );
+        } else {
+            posting_cache_remove_term_seq_id( cache, pair->key, pair->key_len, rowid );
+        }
+    }
+
+    term = sqlite3_malloc( term_len );
+    if(! term) {
+        /* we can't build the key-value term, so we have to assume that it's
+         * stale */
+        posting_cache_clear( cache );
+        return;
+    }
+    memcpy( term, pair->key, pair->key_len );
+    term[pair->key_len] = RECORD_SEPARATOR;
+    memcpy( term + pair->key_len + 1, pair->value, pair->value_len );
+
+    if(add) {
+        posting_cache_add_seq_id( cache, term, term_len, rowid );
+    } else {
+        posting_cache_remove_term_seq_id( cache, term, term_len, rowid );
+    }
+
+    sqlite3_free( term );
+}
+
+/* writes pair's posting for rowid (promoted keys live in the sequence table,
+ * so they don't get one) and adds its value to the Bloom filters */
+static int _write_posting( struct attribute_vtab *vtab,
+    const struct attribute_pair *pair, sqlite3_int64 rowid )
+{
+    int status;
+
+    if(_promoted_index( &(vtab->options), pair->key, pair->key_len ) < 0) {
+        if(vtab->insert_value_stmt) {
+            status = sqlite3_bind_text( vtab->insert_value_stmt, INSERT_VALUE_COL,
+                pair->value, pair->value_len, SQLITE_STATIC );
+            if(status != SQLITE_OK) {
+                return status;
+            }
+
+            status = sqlite3_step( vtab->insert_value_stmt );
+            sqlite3_reset( vtab->insert_value_stmt );
+
+            if(status != SQLITE_DONE) {
+                return status;
+            }
+        }
+
+        status = sqlite3_bind_int64( vtab->insert_attr_stmt, INSERT_ATTR_SEQ_COL, rowid );
+        if(status != SQLITE_OK) {
+            return status;
+        }
+        status = sqlite3_bind_text(  vtab->insert_attr_stmt, INSERT_ATTR_KEY_COL, pair->key,   pair->key_len,   SQLITE_STATIC );
+        if(status != SQLITE_OK) {
+            return status;
+        }
+        status = sqlite3_bind_text(  vtab->insert_attr_stmt, INSERT_ATTR_VAL_COL, pair->value, pair->value_len, SQLITE_STATIC );
+        if(status != SQLITE_OK) {
+            return status;
+        }
+
+        status = sqlite3_step( vtab->insert_attr_stmt );
+        sqlite3_reset( vtab->insert_attr_stmt );
+
+        if(status != SQLITE_DONE) {
+            return status;
+        }
+        _count( vtab, STAT_POSTINGS_WRITTEN, 1 );
+    }
+
+    if(vtab->blooms) {
+        struct bloom_filter *filter = bloom_set_find( vtab->blooms, pair->key, pair->key_len );
+
+        if(! filter) {
+            filter = bloom_set_add_filter( vtab->blooms, pair->key, pair->key_len, NULL );
+        }
+        if(! filter) {
+            return SQLITE_NOMEM;
+        }
+        bloom_filter_add( vtab->blooms, filter, pair->value, pair->value_len );
+    }
+
+    return SQLITE_OK;
+}
+
+/* the attribute table is clustered on (attr_name, attr_value), so rather
+ * than scanning it for a row's postings, we delete each one by primary key */
+static int _remove_posting( struct attribute_vtab *vtab,
+    const struct attribute_pair *pair, sqlite3_int64 rowid )
+{
+    int status;
+
+    if(_promoted_index( &(vtab->options), pair->key, pair->key_len ) >= 0) {
+        return SQLITE_OK;
+    }
+
+    status = sqlite3_bind_text( vtab->delete_posting_stmt, DELETE_POSTING_KEY_COL, pair->key, pair->key_len, SQLITE_STATIC );
+    if(status != SQLITE_OK) {
+        return status;
+    }
+    status = sqlite3_bind_text( vtab->delete_posting_stmt, DELETE_POSTING_VAL_COL, pair->value, pair->value_len, SQLITE_STATIC );
+    if(status != SQLITE_OK) {
+        return status;
+    }
+    status = sqlite3_bind_int64( vtab->delete_posting_stmt, DELETE_POSTING_SEQ_COL, rowid );
+    if(status != SQLITE_OK) {
+        return status;
+    }
+
+    status = sqlite3_step( vtab->delete_posting_stmt );
+    sqlite3_reset( vtab->delete_posting_stmt );
+
+    if(status != SQLITE_DONE) {
+        return status;
+    }
+    _count( vtab, STAT_POSTINGS_DELETED, 1 );
+
+    return SQLITE_OK;
+}
+
+/* brings rowid's postings from old_set (NULL for a new row) to new_set
+ * (NULL for a deleted row), writing only the pairs that differ.  both sets
+ * are sorted by key, so this is a single merge pass */
+static int _update_postings( struct attribute_vtab *vtab, sqlite3_int64 rowid,
+    const struct attribute_set *old_set, const struct attribute_set *new_set )
+{
+    int n_old  = old_set ? old_set->n_pairs : 0;
+    int n_new  = new_set ? new_set->n_pairs : 0;
+    int status = SQLITE_OK;
+    int i = 0, j = 0;
+
+    while(status == SQLITE_OK && (i < n_old || j < n_new)) {
+        const struct attribute_pair *old_pair = i < n_old ? old_set->pairs + i : NULL;
+        const struct attribute_pair *new_pair = j < n_new ? new_set->pairs + j : NULL;
+        int cmp;
+
+        if(! old_pair) {
+            cmp = 1;
+        } else if(! new_pair) {
+            cmp = -1;
+        } else {
+            cmp = _compare_keys( old_pair, new_pair );
+        }
+
+        if(cmp < 0) { /* the key is gone */
+            status = _remove_posting( vtab, old_pair, rowid );
+            if(vtab->cache) {
+                _patch_posting_cache( vtab->cache, old_pair, 1, rowid, 0 );
+            }
+            i++;
+        } else if(cmp > 0) { /* the key is new */
+            status = _write_posting( vtab, new_pair, rowid );
+            if(vtab->cache) {
+                _patch_posting_cache( vtab->cache, new_pair, 1, rowid, 1 );
+            }
+            j++;
+        } else {
+            if(old_pair->value_len != new_pair->value_len ||
+                memcmp( old_pair->value, new_pair->value, new_pair->value_len )) {
+
+                status = _remove_posting( vtab, old_pair, rowid );
+                if(status == SQLITE_OK) {
+                    status = _write_posting( vtab, new_pair, rowid );
+                }
+                if(vtab->cache) {
+                    _patch_posting_cache( vtab->cache, old_pair, 0, rowid, 0 );
+                    _patch_posting_cache( vtab->cache, new_pair, 0, rowid, 1 );
+                }
+            }
+            i++;
+            j++;
+        }
+    }
+
+    if(status != SQLITE_OK) {
+        /* we don't know how much of the row made it, so don't trust the
+         * cache */
+        posting_cache_clear( vtab->cache );
+    }
+
+    return status;
+}
+
+static int _bind_promoted_values( struct attribute_vtab *vtab, sqlite3_stmt *stmt,
+    int first_param, const struct attribute_set *set )
+{
+    int status;
+    int i;
+
+    for(i = 0; i < vtab->options.n_promoted; i++) {
+        const char *key = vtab->options.promoted[i].key;
+        const struct attribute_pair *pair;
+
+        pair = attribute_set_find( set, key, strlen( key ) );
+
+        if(pair) {
+            status = sqlite3_bind_text( stmt, first_param + i, pair->value,
+                pair->value_len, SQLITE_STATIC );
+        } else {
+            status = sqlite3_bind_null( stmt, first_param + i );
+        }
+
+        if(status != SQLITE_OK) {
+            return status;
+        }
+    }
+
+    return SQLITE_OK;
+}
+
+/* sets *attributes to a copy of rowid's attribute string, or NULL if there's
+ * no such row */
+static int _load_row( struct attribute_vtab *vtab, sqlite3_int64 rowid, char **attributes )
+{
+    int status;
+
+    *attributes = NULL;
+
+    /* reading a large string through a blob copies it once, rather than
+     * into the statement and then out of it; a row that can't be opened
+     * (ex. because it doesn't exist) is left to the statement */
+    if(vtab->options.large_attributes) {
+        sqlite3_blob *blob = NULL;
+        sqlite3_int64 partition;
+        int n_bytes;
+
+        status = _read_attributes_blob( vtab, &blob, &partition, rowid,
+            attributes, &n_bytes );
+        sqlite3_blob_close( blob );
+
+        if(status == SQLITE_OK || status == SQLITE_NOMEM) {
+            return status;
+        }
+    }
+
+    status = sqlite3_bind_int64( vtab->select_attrs_stmt, DELETE_SEQ_ARG_ROWID, rowid );
+    if(status != SQLITE_OK) {
+        return status;
+    }
+
+    status = sqlite3_step( vtab->select_attrs_stmt );
+
+    if(status == SQLITE_ROW) {
+        *attributes = sqlite3_mprintf( "%s", sqlite3_column_text( vtab->select_attrs_stmt, 0 ) );
+        status      = *attributes ? SQLITE_OK : SQLITE_NOMEM;
+    } else if(status == SQLITE_DONE) {
+        status = SQLITE_OK;
+    }
+    sqlite3_reset( vtab->select_attrs_stmt );
+
+    return status;
+}
+
+/* stores attributes (whose pairs are new_set) as row *rowid, and brings its
+ * postings up to date.  old_set holds the row's current pairs, or is NULL if
+ * the row is new, in which case *rowid may be 0 to have an id picked for it */
+static int _write_row( struct attribute_vtab *vtab, sqlite_int64 *rowid,
+    const char *attributes, const struct attribute_set *old_set,
+    const struct attribute_set *new_set )
+{
+    sqlite3_stmt *stmt;
+    int status;
+
+    if(old_set) {
+        stmt   = vtab->update_seq_stmt;
+        status = sqlite3_bind_int64( stmt,
+            UPDATE_SEQ_PROMOTED_COL + vtab->options.n_promoted, *rowid );
+        if(status == SQLITE_OK) {
+            status = _bind_promoted_values( vtab, stmt, UPDATE_SEQ_PROMOTED_COL, new_set );
+        }
+        if(status == SQLITE_OK) {
+            status = sqlite3_bind_text( stmt, UPDATE_SEQ_ATTR_COL, attributes,
+                -1, SQLITE_STATIC );
+        }
+    } else {
+        stmt = vtab->insert_seq_stmt;
+        if(*rowid == 0) { /* we provide our own ROWID */
+            status = sqlite3_bind_null( stmt, INSERT_SEQ_ID_COL );
+        } else {
+            status = sqlite3_bind_int64( stmt, INSERT_SEQ_ID_COL, *rowid );
+        }
+        if(status == SQLITE_OK) {
+            status = _bind_promoted_values( vtab, stmt, INSERT_SEQ_PROMOTED_COL, new_set );
+        }
+        if(status == SQLITE_OK) {
+            status = sqlite3_bind_text( stmt, INSERT_SEQ_ATTR_COL, attributes,
+                -1, SQLITE_STATIC );
+        }
+    }
+
+    if(status != SQLITE_OK) {
+        return ERROR( vtab, status );
+    }
+
+    status = sqlite3_step( stmt );
+
+    if(status != SQLITE_DONE) {
+        sqlite3_reset( stmt );
+        return ERROR( vtab, status );
+    }
+    if(! old_set) {
+        *rowid = sqlite3_last_insert_rowid( vtab->db );
+    }
+    sqlite3_reset( stmt );
+
+    if(vtab->options.bloom_bits && !vtab->blooms) {
+        status = _load_bloom_filters( vtab );
+
+        if(status != SQLITE_OK) {
+            return status;
+        }
+    }
+
+    status = _update_postings( vtab, *rowid, old_set, new_set );
+
+    if(status != SQLITE_OK) {
+        return status == SQLITE_NOMEM ? status : ERROR( vtab, status );
+    }
+
+    return SQLITE_OK;
+}
+
+/* writes the attribute string in argv to row *rowid.  an INSERT whose id is
+ * already taken fails, unless the statement is INSERT OR REPLACE; with the
+ * merge option, REPLACE merges the new attributes into the row's existing
+ * ones rather than replacing them outright (INSERT OR IGNORE is taken care of
+ * by SQLite once we report the conflict).  an UPDATE rewrites the row in
+ * place */
+static int _store_row( struct attribute_vtab *vtab, sqlite3_value **argv,
+    sqlite_int64 *rowid, int is_insert )
+{
+    const char *attributes;
+    char *canonical      = NULL;
+    char *old_attributes = NULL;
+    struct attribute_set new_set, old_set, merged_set;
+    int merged;
+    int status;
+
+    memset( &old_set,    0, sizeof(struct attribute_set) );
+    memset( &merged_set, 0, sizeof(struct attribute_set) );
+
+    if(sqlite3_value_type( argv[UPDATE_ARG_ATTRS] ) != SQLITE_TEXT) {
+        vtab->vtab.zErrMsg = sqlite3_mprintf( "%s", "attributes must be an attribute string" );
+        return SQLITE_ERROR;
+    }
+
+    attributes = sqlite3_value_text( argv[UPDATE_ARG_ATTRS] );
+
+    if(! is_attribute_string( attributes )) {
+        vtab->vtab.zErrMsg = sqlite3_mprintf( "%s", "attributes must be an attribute string" );
+        return SQLITE_ERROR;
+    }
+
+    status = attribute_set_parse( &new_set, attributes, vtab->options.merge, &merged );
+    if(status != SQLITE_OK) {
+        if(status == SQLITE_CONSTRAINT) {
+            vtab->vtab.zErrMsg = sqlite3_mprintf( "%s", "duplicate attributes are forbidden" );
+        }
+        return status;
+    }
+
+    if(merged) { /* store the string without the overridden values */
+        canonical  = attribute_set_to_string( &new_set );
+        attributes = canonical;
+        if(! canonical) {
+            status = SQLITE_NOMEM;
+            goto done;
+        }
+    }
+
+    if(*rowid == 0 && vtab->options.partition_size) {
+        status = _next_partitioned_rowid( vtab, rowid );
+        if(status != SQLITE_OK) {
+            status = status == SQLITE_NOMEM ? status : ERROR( vtab, status );
+            goto done;
+        }
+    }
+
+    if(*rowid != 0) {
+        status = _use_partition( vtab, *rowid, 1 );
+        if(status != SQLITE_OK) {
+            status = status == SQLITE_NOMEM ? status : ERROR( vtab, status );
+            goto done;
+        }
+
+        status = _load_row( vtab, *rowid, &old_attributes );
+        if(status != SQLITE_OK) {
+            status = status == SQLITE_NOMEM ? status : ERROR( vtab, status );
+            goto done;
+        }
+    }
+
+    if(! old_attributes) {
+        status = _write_row( vtab, rowid, attributes, NULL, &new_set );
+        if(status == SQLITE_OK) {
+            _count( vtab, STAT_ROWS_INSERTED, 1 );
+        }
+        goto done;
+    }
+
+    if(is_insert && sqlite3_vtab_on_conflict( vtab->db ) != SQLITE_REPLACE) {
+        vtab->vtab.zErrMsg = sqlite3_mprintf( "UNIQUE constraint failed: %s.id", vtab->table_name );
+        status = SQLITE_CONSTRAINT;
+        goto done;
+    }
+
+    status = attribute_set_parse( &old_set, old_attributes, 1, &merged );
+    if(status != SQLITE_OK) {
+        goto done;
+    }
+
+    if(is_insert && vtab->options.merge) {
+        status = attribute_set_merge( &merged_set, &old_set, &new_set );
+        if(status != SQLITE_OK) {
+            goto done;
+        }
+
+        sqlite3_free( canonical );
+        canonical = attribute_set_to_string( &merged_set );
+        if(! canonical) {
+            status = SQLITE_NOMEM;
+            goto done;
+        }
+
+        status = _write_row( vtab, rowid, canonical, &old_set, &merged_set );
+    } else {
+        status = _write_row( vtab, rowid, attributes, &old_set, &new_set );
+    }
+
+    if(status == SQLITE_OK) {
+        _count( vtab, STAT_ROWS_UPDATED, 1 );
+    }
+
+done:
+    attribute_set_free( &merged_set );
+    attribute_set_free( &old_set );
+    attribute_set_free( &new_set );
+    sqlite3_free( old_attributes );
+    sqlite3_free( canonical );
+
+    return status;
+}
+
+struct streamed_removal {
+    struct attribute_vtab *vtab;
+    sqlite3_int64 rowid;
+    int status;
+};
+
+static int _remove_streamed_posting( const char *key, size_t key_len,
+    const char *value, size_t value_len, void *udata )
+{
+    struct streamed_removal *removal = (struct streamed_removal *) udata;
+    struct attribute_pair pair;
+
+    pair.key       = key;
+    pair.key_len   = key_len;
+    pair.value     = value;
+    pair.value_len = value_len;
+    pair.order     = 0;
+
+    removal->status = _remove_posting( removal->vtab, &pair, removal->rowid );
+    if(removal->vtab->cache) {
+        _patch_posting_cache( removal->vtab->cache, &pair, 1, removal->rowid, 0 );
+    }
+
+    return removal->status == SQLITE_OK ? CONTINUE : BREAK;
+}
+
+/* removes row rowid's postings as its attribute string streams by, rather
+ * than reading the whole string in first.  returns SQLITE_NOTFOUND if the
+ * row can't be opened */
+static int _remove_streamed_postings( struct attribute_vtab *vtab,
+    sqlite3_int64 rowid )
+{
+    struct streamed_removal removal;
+    sqlite3_blob *blob = NULL;
+    sqlite3_int64 partition;
+    int status;
+
+    status = _open_attributes_blob( vtab, &blob, &partition, rowid );
+    if(status != SQLITE_OK) {
+        return status == SQLITE_NOMEM ? status : SQLITE_NOTFOUND;
+    }
+
+    removal.vtab   = vtab;
+    removal.rowid  = rowid;
+    removal.status = SQLITE_OK;
+
+    status = iterate_over_blob_pairs( blob, _remove_streamed_posting, &removal );
+    sqlite3_blob_close( blob );
+
+    if(status == SQLITE_OK) {
+        status = removal.status;
+    }
+
+    if(status != SQLITE_OK) {
+        posting_cache_clear( vtab->cache );
+    }
+
+    return status;
+}
+
+static int _perform_delete( struct attribute_vtab *vtab, sqlite3_int64 rowid )
+{
+    char *attributes = NULL;
+    struct attribute_set old_set;
+    int streamed = 0;
+    int merged;
+    int status;
+
+    status = _use_partition( vtab, rowid, 0 );
+
+    if(status == SQLITE_NOTFOUND) { /* there's no such partition */
+        return SQLITE_OK;
+    }
+
+    if(status == SQLITE_OK && vtab->options.large_attributes) {
+        status   = _remove_streamed_postings( vtab, rowid );
+        streamed = status != SQLITE_NOTFOUND;
+
+        if(! streamed) {
+            status = SQLITE_OK;
+        }
+    }
+
+    if(status == SQLITE_OK && ! streamed) {
+        status = _load_row( vtab, rowid, &attributes );
+
+        if(status == SQLITE_OK && ! attributes) {
+            return SQLITE_OK;
+        }
+    }
+
+    if(status != SQLITE_OK) {
+        return status == SQLITE_NOMEM ? status : ERROR( vtab, status );
+    }
+
+    if(attributes) {
+        status = attribute_set_parse( &old_set, attributes, 1, &merged );
+
+        if(status == SQLITE_OK) {
+            status = _update_postings( vtab, rowid, &old_set, NULL );
+            attribute_set_free( &old_set );
+        }
+        sqlite3_free( attributes );
+    }
+
+    if(status == SQLITE_OK) {
+        status = sqlite3_bind_int64( vtab->delete_seq_stmt, DELETE_SEQ_ARG_ROWID, rowid );
+    }
+    if(status == SQLITE_OK) {
+        status = sqlite3_step( vtab->delete_seq_stmt );
+        sqlite3_reset( vtab->delete_seq_stmt );
+
+        if(status == SQLITE_DONE) {
+            status = SQLITE_OK;
+        }
+    }
+
+    if(status != SQLITE_OK) {
+        return status == SQLITE_NOMEM ? status : ERROR( vtab, status );
+    }
+    _count( vtab, STAT_ROWS_DELETED, 1 );
+
+    return SQLITE_OK;
+}
+
+/* the promoted and sort columns are derived from the attributes column, so
+ * a value written to one would be lost; an INSERT has to leave them NULL,
+ * and an UPDATE mustn't assign them (see attributes_column) */
+static int _check_derived_columns( struct attribute_vtab *vtab, int argc,
+    sqlite3_value **argv, int is_insert )
+{
+    const struct attribute_options *options = &(vtab->options);
+    int i;
+
+    for(i = UPDATE_ARG_ID + SCHEMA_PROMOTED_COL; i < argc; i++) {
+        int column = i - UPDATE_ARG_ID;
+        const char *name;
+
+        if(is_insert ? sqlite3_value_type( argv[i] ) == SQLITE_NULL :
+            sqlite3_value_nochange( argv[i] )) {
+            continue;
+        }
+
+        if(column < SCHEMA_SORT_KEY_COL( options )) {
+            name = options->promoted[column - SCHEMA_PROMOTED_COL].key;
+        } else if(column == SCHEMA_SORT_KEY_COL( options )) {
+            name = "sort_key";
+        } else {
+            name = "sort_value";
+        }
+
+        vtab->vtab.zErrMsg = sqlite3_mprintf( "%s.%s can't be written; "
+            "write the attributes column instead", vtab->table_name, name );
+        return SQLITE_CONSTRAINT;
+    }
+
+    return SQLITE_OK;
+}
+
+static int _update( struct attribute_vtab *vtab, int argc, sqlite3_value **argv, sqlite_int64 *rowid )
+{
+    int status;
+
+    if(vtab->options.snapshot) {
+        vtab->vtab.zErrMsg = sqlite3_mprintf( "%s is a read-only snapshot",
+            vtab->table_name );
+        return SQLITE_READONLY;
+    }
+
+    status = _initialize_statements( vtab );
+    if(status != SQLITE_OK) {
+        return status == SQLITE_NOMEM ? status : ERROR( vtab, status );
+    }
+
+    if(argc == 1) { /* DELETE */
+        return _perform_delete( vtab, sqlite3_value_int64( argv[0] ) );
+    }
+
+    status = _check_derived_columns( vtab, argc, argv,
+        sqlite3_value_type(argv[0]) == SQLITE_NULL );
+    if(status != SQLITE_OK) {
+        return status;
+    }
+
+    if(sqlite3_value_type(argv[0]) == SQLITE_NULL) { /* INSERT */
+        int type_rowid;
+        int type_id;
+
+        type_rowid = sqlite3_value_type(argv[UPDATE_ARG_ROWID]);
+        type_id    = sqlite3_value_type(argv[UPDATE_ARG_ID]);
+
+        if(type_rowid == SQLITE_NULL && type_id == SQLITE_NULL) {
+            *rowid = 0;
+        } else if(type_rowid != SQLITE_NULL) {
+            *rowid = sqlite3_value_int64( argv[UPDATE_ARG_ROWID] );
+            if(*rowid == 0) { /* uh-oh */
+                return SQLITE_MISMATCH;
+            }
+        } else { /* type_id != SQLITE_NULL */
+            *rowid = sqlite3_value_int64( argv[UPDATE_ARG_ID] );
+            if(*rowid == 0) { /* uh-oh */
+                return SQLITE_MISMATCH;
+            }
+        }
+
+        return _store_row( vtab, argv, rowid, 1 );
+    } else { /* UPDATE; the row keeps its id */
+        *rowid = sqlite3_value_int64( argv[0] );
+        return _store_row( vtab, argv, rowid, 0 );
+    }
+
+    return SQLITE_ERROR;
+}
+
+static int attributes_update( sqlite3_vtab *_vtab, int argc, sqlite3_value **argv, sqlite_int64 *rowid )
+{
+    struct attribute_vtab *vtab = (struct attribute_vtab *) _vtab;
+    int status;
+    TIMER_START( start );
+
+    status = _update( vtab, argc, argv, rowid );
+
+    TIMER_STOP( vtab, STAT_UPDATE_TIME, start );
+
+    return status;
+}
+
+/* milliseconds on a clock that only moves forward, for time-boxing
+ * attributes_optimize */
+static sqlite3_int64 _clock_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec * 1000ll + ts.tv_nsec / 1000000;
+}
+
+/* rewrites the chunk of table (in the shadow tables named after base_name)
+ * that follows vtab->optimize_position, and moves the position to the end
+ * of it; *done is set if that was the table's last chunk */
+static int _optimize_chunk( struct attribute_vtab *vtab, const char *base_name,
+    const struct optimize_table *table, int *done )
+{
+    sqlite3_stmt *stmt      = NULL;
+    sqlite3_value **rows    = NULL;
+    sqlite3_value **last    = NULL;
+    int resuming            = vtab->optimize_position[0] != NULL;
+    int n_columns           = 0;
+    int n_rows              = 0;
+    int full                = 0;
+    sqlite3_int64 n_bytes   = 0;
+    int status;
+    int i;
+
+    status = _prepare_allocated_statement( vtab,
+        _allocate_select_chunk_sql( vtab->database_name, base_name, table,
+            resuming ),
+        &stmt );
+
+    if(status != SQLITE_OK) {
+        return status;
+    }
+
+    for(i = 0; resuming && status == SQLITE_OK && i < table->n_key; i++) {
+        status = sqlite3_bind_value( stmt, i + 1, vtab->optimize_position[i] );
+    }
+
+    if(status == SQLITE_OK) {
+        n_columns = sqlite3_column_count( stmt );
+        rows      = sqlite3_malloc64( sizeof(sqlite3_value *) * n_columns * OPTIMIZE_CHUNK_ROWS );
+
+        if(rows) {
+            memset( rows, 0, sizeof(sqlite3_value *) * n_columns * OPTIMIZE_CHUNK_ROWS );
+        } else {
+            status = SQLITE_NOMEM;
+        }
+    }
+
+    /* the chunk has to be read in full before it's deleted */
+    while(status == SQLITE_OK && ! full && (status = sqlite3_step( stmt )) == SQLITE_ROW) {
+        last   = rows + n_rows * n_columns;
+        status = SQLITE_OK;
+
+        for(i = 0; status == SQLITE_OK && i < n_columns; i++) {
+            last[i] = sqlite3_value_dup( sqlite3_column_value( stmt, i ) );
+            if(! last[i]) {
+                status = SQLITE_NOMEM;
+            } else if(sqlite3_value_type( last[i] ) == SQLITE_TEXT ||
+                sqlite3_value_type( last[i] ) == SQLITE_BLOB) {
+                n_bytes += sqlite3_value_bytes( last[i] );
+            }
+        }
+        n_rows++;
+        full = n_rows == OPTIMIZE_CHUNK_ROWS || n_bytes >= OPTIMIZE_CHUNK_BYTES;
+    }
+    sqlite3_finalize( stmt );
+    stmt = NULL;
+
+    if(status == SQLITE_DONE) {
+        status = SQLITE_OK;
+    }
+
+    if(status == SQLITE_OK && n_rows) {
+        status = _prepare_allocated_statement( vtab,
+            _allocate_delete_chunk_sql( vtab->database_name, base_name, table ),
+            &stmt );
+
+        for(i = 0; status == SQLITE_OK && i < table->n_key; i++) {
+            status = sqlite3_bind_value( stmt, i + 1, rows[i] );
+            if(status == SQLITE_OK) {
+                status = sqlite3_bind_value( stmt, table->n_key + i + 1, last[i] );
+            }
+        }
+
+        if(status == SQLITE_OK) {
+            status = sqlite3_step( stmt );
+            status = status == SQLITE_DONE ? SQLITE_OK : status;
+        }
+        sqlite3_finalize( stmt );
+        stmt = NULL;
+    }
+
+    if(status == SQLITE_OK && n_rows) {
+        status = _prepare_allocated_statement( vtab,
+            _allocate_insert_chunk_sql( vtab->database_name, base_name, table,
+                n_columns ),
+            &stmt );
+
+        for(i = 0; status == SQLITE_OK && i < n_rows * n_columns; i++) {
+            status = sqlite3_bind_value( stmt, i % n_columns + 1, rows[i] );
+
+            if(status == SQLITE_OK && i % n_columns == n_columns - 1) {
+                status = sqlite3_step( stmt );
+                sqlite3_reset( stmt );
+                status = status == SQLITE_DONE ? SQLITE_OK : status;
+            }
+        }
+        sqlite3_finalize( stmt );
+    }
+
+    if(status == SQLITE_OK && n_rows) {
+        _clear_optimize_position( vtab );
+
+        for(i = 0; i < table->n_key; i++) {
+            vtab->optimize_position[i] = last[i];
+            last[i] = NULL;
+        }
+    }
+
+    if(rows) {
+        for(i = 0; i < n_columns * OPTIMIZE_CHUNK_ROWS; i++) {
+            sqlite3_value_free( rows[i] );
+        }
+        sqlite3_free( rows );
+    }
+
+    *done = ! full;
+
+    return status;
+}
+
+/* runs ANALYZE over the shadow tables of every partition in partitions (or of
+ * the table itself, if partitions is NULL); when limited is set, ANALYZE only
+ * looks at OPTIMIZE_ANALYSIS_LIMIT rows of each index */
+static int _analyze_shadow_tables( struct attribute_vtab *vtab,
+    const sqlite3_int64 *partitions, int n_partitions, int limited )
+{
+    sqlite3_stmt *stmt;
+    int old_limit = 0;
+    int status;
+    int i, j;
+
+    if(limited) {
+        status = _prepare_statement( vtab, "PRAGMA analysis_limit", &stmt );
+        if(status != SQLITE_OK) {
+            return status;
+        }
+        if(sqlite3_step( stmt ) == SQLITE_ROW) {
+            old_limit = sqlite3_column_int( stmt, 0 );
+        }
+        sqlite3_finalize( stmt );
+
+        status = _execute_allocated_sql( vtab,
+            sqlite3_mprintf( "PRAGMA analysis_limit = %d", OPTIMIZE_ANALYSIS_LIMIT ) );
+        if(status != SQLITE_OK) {
+            return status;
+        }
+    }
+
+    status = SQLITE_OK;
+
+    for(i = 0; status == SQLITE_OK && i < n_partitions; i++) {
+        char *base_name = vtab->table_name;
+
+        if(partitions) {
+            base_name = _allocate_partition_name( vtab->table_name, partitions[i] );
+            if(! base_name) {
+                status = SQLITE_NOMEM;
+                break;
+            }
+        }
+
+        for(j = 0; status == SQLITE_OK && j < N_OPTIMIZE_TABLES; j++) {
+            status = _execute_allocated_sql( vtab,
+                _allocate_analyze_sql( vtab->database_name, base_name,
+                    OPTIMIZE_TABLES[j].suffix ) );
+        }
+
+        if(partitions) {
+            sqlite3_free( base_name );
+        }
+    }
+
+    if(status == SQLITE_OK && vtab->options.intern_values) {
+        status = _execute_allocated_sql( vtab,
+            _allocate_analyze_sql( vtab->database_name, vtab->table_name,
+                "Values" ) );
+    }
+
+    if(limited) {
+        int restore_status = _execute_allocated_sql( vtab,
+            sqlite3_mprintf( "PRAGMA analysis_limit = %d", old_limit ) );
+
+        if(status == SQLITE_OK) {
+            status = restore_status;
+        }
+    }
+
+    return status;
+}
+
+/* rewrites the shadow tables in key order (see OPTIMIZE_CHUNK_ROWS) and then
+ * gathers planner statistics on them.  if deadline (a _clock_ms time) isn't
+ * zero, this stops at the first chunk boundary past it, leaving *finished
+ * unset, and the next call picks up where this one stopped */
+static int _optimize( struct attribute_vtab *vtab, sqlite3_int64 deadline,
+    int *finished )
+{
+    sqlite3_int64 *partitions = NULL;
+    int n_partitions          = 1;
+    int paused                = 0;
+    int status                = SQLITE_OK;
+    int i;
+
+    *finished = 0;
+
+    if(vtab->options.partition_size) {
+        status = _read_partitions( vtab, 1, 0, &partitions, &n_partitions );
+        if(status != SQLITE_OK) {
+            return status;
+        }
+    }
+
+    if(! vtab->optimizing) {
+        _clear_optimize_position( vtab );
+        vtab->optimizing         = 1;
+        vtab->optimize_partition = partitions ? partitions[0] : 0;
+        vtab->optimize_table     = 0;
+    }
+
+    for(i = 0; status == SQLITE_OK && ! paused && i < n_partitions; i++) {
+        char *base_name = vtab->table_name;
+
+        if(partitions) {
+            /* partitions that were dropped or created since the last call
+             * are taken in stride */
+            if(partitions[i] < vtab->optimize_partition) {
+                continue;
+            }
+            if(partitions[i] != vtab->optimize_partition) {
+                _clear_optimize_position( vtab );
+                vtab->optimize_partition = partitions[i];
+                vtab->optimize_table     = 0;
+            }
+
+            base_name = _allocate_partition_name( vtab->table_name, partitions[i] );
+            if(! base_name) {
+                status = SQLITE_NOMEM;
+                break;
+            }
+        }
+
+        while(status == SQLITE_OK && vtab->optimize_table < N_OPTIMIZE_TABLES) {
+            int done;
+
+            status = _optimize_chunk( vtab, base_name,
+                OPTIMIZE_TABLES + vtab->optimize_table, &done );
+
+            if(status == SQLITE_OK && done) {
+                _clear_optimize_position( vtab );
+                vtab->optimize_table++;
+            }
+
+            if(status == SQLITE_OK && deadline && _clock_ms() >= deadline) {
+                paused = 1;
+                break;
+            }
+        }
+
+        if(partitions) {
+            sqlite3_free( base_name );
+        }
+    }
+
+    if(status == SQLITE_OK && ! paused) {
+        vtab->optimizing = 0;
+        _clear_optimize_position( vtab );
+
+        status = _analyze_shadow_tables( vtab, partitions, n_partitions,
+            deadline != 0 );
+        *finished = status == SQLITE_OK;
+    }
+    sqlite3_free( partitions );
+
+    /* a failed pass is rolled back, so the next one starts over */
+    if(status != SQLITE_OK) {
+        vtab->optimizing = 0;
+        _clear_optimize_position( vtab );
+    }
+
+    return status;
+}
+
+/* rebuilds the index (and the values dictionary and Bloom filters, for
+ * tables that have them) from the attribute strings in the sequence tables,
+ * then optimizes the table; *n_rows is set to the number of rows indexed */
+static int _rebuild( struct attribute_vtab *vtab, sqlite3_int64 *n_rows )
+{
+    sqlite3_int64 *partitions = NULL;
+    int n_partitions          = 1;
+    int finished;
+    int status;
+    int i;
+
+    *n_rows = 0;
+
+    status = _initialize_statements( vtab );
+
+    if(status == SQLITE_OK && vtab->options.partition_size) {
+        status = _read_partitions( vtab, 1, 0, &partitions, &n_partitions );
+    }
+
+    for(i = 0; status == SQLITE_OK && i < n_partitions; i++) {
+        char *base_name = partitions ?
+            _allocate_partition_name( vtab->table_name, partitions[i] ) :
+            vtab->table_name;
+
+        status = base_name ?
+            _execute_allocated_sql( vtab, sqlite3_mprintf( "DELETE FROM " ATTR_SCHEMA_NAME,
+                vtab->database_name, base_name ) ) :
+            SQLITE_NOMEM;
+
+        if(partitions) {
+            sqlite3_free( base_name );
+        }
+    }
+
+    if(status == SQLITE_OK && vtab->options.intern_values) {
+        status = _execute_allocated_sql( vtab, sqlite3_mprintf( "DELETE FROM " VALUES_SCHEMA_NAME,
+            vtab->database_name, vtab->table_name ) );
+    }
+
+    if(status == SQLITE_OK && vtab->options.bloom_bits) {
+        status = _execute_allocated_sql( vtab, sqlite3_mprintf( "DELETE FROM " BLOOM_SCHEMA_NAME,
+            vtab->database_name, vtab->table_name ) );
+
+        bloom_set_free( vtab->blooms );
+        vtab->blooms = NULL;
+
+        if(status == SQLITE_OK) {
+            status = _load_bloom_filters( vtab );
+        }
+    }
+
+    posting_cache_clear( vtab->cache );
+
+    for(i = 0; status == SQLITE_OK && i < n_partitions; i++) {
+        sqlite3_stmt *stmt;
+        char *base_name = partitions ?
+            _allocate_partition_name( vtab->table_name, partitions[i] ) :
+            vtab->table_name;
+
+        if(! base_name) {
+            status = SQLITE_NOMEM;
+            break;
+        }
+
+        status = _prepare_allocated_statement( vtab,
+            _allocate_select_export_sql( vtab->database_name, base_name ),
+            &stmt );
+
+        if(partitions) {
+            sqlite3_free( base_name );
+        }
+
+        while(status == SQLITE_OK && (status = sqlite3_step( stmt )) == SQLITE_ROW) {
+            sqlite3_int64 rowid    = sqlite3_column_int64( stmt, 0 );
+            const char *attributes = (const char *) sqlite3_column_text( stmt, 1 );
+            struct attribute_set set;
+            int merged;
+            int j;
+
+            status = _use_partition( vtab, rowid, 0 );
+
+            if(status == SQLITE_OK) {
+                status = attribute_set_parse( &set, attributes, vtab->options.merge, &merged );
+
+                for(j = 0; status == SQLITE_OK && j < set.n_pairs; j++) {
+                    status = _write_posting( vtab, set.pairs + j, rowid );
+                }
+                attribute_set_free( &set );
+            }
+
+            (*n_rows)++;
+        }
+        sqlite3_finalize( stmt );
+
+        if(status == SQLITE_DONE) {
+            status = SQLITE_OK;
+        }
+    }
+    sqlite3_free( partitions );
+
+    if(status == SQLITE_OK) {
+        status = _flush_bloom_filters( vtab );
+    }
+
+    if(status == SQLITE_OK) {
+        vtab->optimizing = 0;
+        status = _optimize( vtab, 0, &finished );
+    }
+
+    return status;
+}
+
+/* returns the SQL for comparing a promoted column against a constraint's
+ * right-hand side, or NULL if we can't push the constraint down */
+static const char *_constraint_sql( unsigned char op )
+{
+    switch(op) {
+        case SQLITE_INDEX_CONSTRAINT_EQ:        return "= ?";
+        case SQLITE_INDEX_CONSTRAINT_GT:        return "> ?";
+        case SQLITE_INDEX_CONSTRAINT_LE:        return "<= ?";
+        case SQLITE_INDEX_CONSTRAINT_LT:        return "< ?";
+        case SQLITE_INDEX_CONSTRAINT_GE:        return ">= ?";
+        case SQLITE_INDEX_CONSTRAINT_NE:        return "<> ?";
+        case SQLITE_INDEX_CONSTRAINT_IS:        return "IS ?";
+        case SQLITE_INDEX_CONSTRAINT_ISNOT:     return "IS NOT ?";
+        case SQLITE_INDEX_CONSTRAINT_ISNULL:    return "IS NULL";
+        case SQLITE_INDEX_CONSTRAINT_ISNOTNULL: return "IS NOT NULL";
+    }
+
+    return NULL;
+}
+
+static int _constraint_has_operand( unsigned char op )
+{
+    return op != SQLITE_INDEX_CONSTRAINT_ISNULL && op != SQLITE_INDEX_CONSTRAINT_ISNOTNULL;
+}
+
+/* snapshots only use comparisons that narrow the range of rows to read */
+static int _snapshot_constraint( unsigned char op )
+{
+    return op == SQLITE_INDEX_CONSTRAINT_EQ || op == SQLITE_INDEX_CONSTRAINT_GT ||
+        op == SQLITE_INDEX_CONSTRAINT_LE || op == SQLITE_INDEX_CONSTRAINT_LT ||
+        op == SQLITE_INDEX_CONSTRAINT_GE;
+}
+
+/* see ESTIMATE_ROWS_TMPL */
+static sqlite3_int64 _estimate_table_rows( struct attribute_vtab *vtab )
+{
+    sqlite3_int64 rows = DEFAULT_ROW_ESTIMATE;
+
+    if(vtab->snapshot) {
+        return (sqlite3_int64) vtab->snapshot->header->n_rows;
+    }
+
+    if(! vtab->row_estimate_stmt) {
+        char *sql = vtab->options.partition_size ?
+            sqlite3_mprintf( ESTIMATE_PARTITIONED_ROWS_TMPL,
+                (long long) vtab->options.partition_size,
+                vtab->database_name, vtab->table_name ) :
+            sqlite3_mprintf( ESTIMATE_ROWS_TMPL,
+                vtab->database_name, vtab->table_name,
+                vtab->database_name, vtab->table_name );
+
+        if(_prepare_allocated_statement( vtab, sql, &(vtab->row_estimate_stmt) ) != SQLITE_OK) {
+            sqlite3_finalize( vtab->row_estimate_stmt );
+            vtab->row_estimate_stmt = NULL;
+            return rows;
+        }
+    }
+
+    if(sqlite3_step( vtab->row_estimate_stmt ) == SQLITE_ROW) {
+        rows = sqlite3_column_int64( vtab->row_estimate_stmt, 0 );
+    }
+    sqlite3_reset( vtab->row_estimate_stmt );
+
+    return rows;
+}
+
+/* the MATCH constraint (if any) is always argv[0]; constraints on promoted
+ * columns follow it.  idxStr describes the plan for EXPLAIN QUERY PLAN, ex.
+ *
+ *   MATCH INDEX: attributes MATCH ? AND "score" > ? (~1 rows) {3:4}
+ *
+ * the braces at the end list the promoted constraints as column:op pairs
+ * for attributes_filter.  a sort_key constraint takes the place of MATCH */
+static int attributes_best_index( sqlite3_vtab *_vtab, sqlite3_index_info *index_info )
+{
+    struct attribute_vtab *vtab = (struct attribute_vtab *) _vtab;
+    int sort_key_col  = SCHEMA_SORT_KEY_COL( &(vtab->options) );
+    int sort_key_seen = 0;
+    int i;
+    int argv_index    = 1;
+    char *constraints = NULL;
+    char *desc        = NULL;
+    double cost       = 0;
+    sqlite3_int64 rows;
+
+    if(vtab->snapshot_error) {
+        vtab->vtab.zErrMsg = sqlite3_mprintf( "%s", vtab->snapshot_error );
+        return SQLITE_ERROR;
+    }
+
+    rows = _estimate_table_rows( vtab );
+
+    /* sort_key = ? reads the rows that have a key in order of its values.
+     * like a table-valued function's argument, it has to be given, since
+     * sort_key is NULL otherwise; MATCH and friends are then left to SQLite */
+    for(i = 0; i < index_info->nConstraint; i++) {
+        struct sqlite3_index_constraint *constraint = index_info->aConstraint + i;
+
+        if(constraint->iColumn != sort_key_col || constraint->op != SQLITE_INDEX_CONSTRAINT_EQ) {
+            continue;
+        }
+        sort_key_seen = 1;
+
+        if(constraint->usable) {
+            index_info->aConstraintUsage[i].argvIndex = argv_index++;
+            index_info->aConstraintUsage[i].omit      = 1;
+            index_info->idxNum                       |= SORT_INDEX;
+            cost                                      = 50;
+            rows                                     /= 10;
+            desc                                      = sqlite3_mprintf( "%s", "sort_key = ?" );
+            break;
+        }
+    }
+
+    if(sort_key_seen && ! cost) {
+        return SQLITE_CONSTRAINT;
+    }
+
+    for(i = 0; ! cost && i < index_info->nConstraint; i++) {
+        struct sqlite3_index_constraint *constraint = index_info->aConstraint + i;
+
+        if(constraint->usable && constraint->iColumn == SCHEMA_ATTR_COL && constraint->op == SQLITE_INDEX_CONSTRAINT_MATCH) {
+            index_info->aConstraintUsage[i].argvIndex = argv_index++;
+            index_info->aConstraintUsage[i].omit      = 1 ;
+            index_info->idxNum                       |= ATTR_NAME_INDEX;
+            cost                                      = 1; /* dummy value for now */
+            rows                                     /= 10;
+            desc                                      = sqlite3_mprintf( "%s", "attributes MATCH ?" );
+            break;
+        }
+    }
+
+    /* get_attr(attributes, key) can only be true for rows that have key, so
+     * the key's postings narrow the scan; SQLite still evaluates get_attr
+     * on each row to decide whether the value is true */
+    for(i = 0; ! cost && i < index_info->nConstraint; i++) {
+        struct sqlite3_index_constraint *constraint = index_info->aConstraint + i;
+
+        if(constraint->usable && constraint->iColumn == SCHEMA_ATTR_COL && constraint->op == GET_ATTR_CONSTRAINT) {
+            index_info->aConstraintUsage[i].argvIndex = argv_index++;
+            index_info->aConstraintUsage[i].omit      = 0;
+            index_info->idxNum                       |= ATTR_NAME_INDEX;
+            cost                                      = 1;
+            rows                                     /= 10;
+            desc                                      = sqlite3_mprintf( "%s", "get_attr(attributes, ?)" );
+        }
+    }
+
+    /* glob_attr(attributes, pattern) seeks on the literal prefixes of its
+     * key and value patterns; see _allocate_select_glob_sql */
+    for(i = 0; ! cost && i < index_info->nConstraint; i++) {
+        struct sqlite3_index_constraint *constraint = index_info->aConstraint + i;
+
+        if(constraint->usable && constraint->iColumn == SCHEMA_ATTR_COL && constraint->op == GLOB_ATTR_CONSTRAINT) {
+            index_info->aConstraintUsage[i].argvIndex = argv_index++;
+            index_info->aConstraintUsage[i].omit      = 1;
+            index_info->idxNum                       |= GLOB_INDEX;
+            cost                                      = 5;
+            rows                                     /= 4;
+            desc                                      = sqlite3_mprintf( "%s", "glob_attr(attributes, ?)" );
+        }
+    }
+
+    if(cost && ! desc) {
+        return SQLITE_NOMEM;
+    }
+
+    /* constraints on id (which is also the rowid) and on promoted columns
+     * are answered by the sequence table's indexes; for a partitioned table,
+     * id constraints also skip partitions */
+    for(i = 0; i < index_info->nConstraint; i++) {
+        struct sqlite3_index_constraint *constraint = index_info->aConstraint + i;
+        int column = constraint->iColumn < 0 ? SCHEMA_ID_COL : constraint->iColumn;
+        int sort_value = column == sort_key_col + 1;
+        int equality;
+
+        /* a sort_key plan reads its key's values off the index, so range
+         * and equality constraints on sort_value narrow that read (see
+         * _sort_value_pushed_down) */
+        if(sort_value && (!(index_info->idxNum & SORT_INDEX) || vtab->snapshot ||
+            ! _snapshot_constraint( constraint->op ))) {
+            continue;
+        }
+
+        if(! constraint->usable || column == SCHEMA_ATTR_COL ||
+            (column >= sort_key_col && ! sort_value) ||
+            ! _constraint_sql( constraint->op ) ||
+            (vtab->snapshot && ! _snapshot_constraint( constraint->op ))) {
+            continue;
+        }
+
+        constraints = sqlite3_mprintf( "%z%s%d:%d", constraints,
+            constraints ? "," : "", column, constraint->op );
+        desc        = sqlite3_mprintf( "%z%s\"%w\" %s", desc, desc ? " AND " : "",
+            column == SCHEMA_ID_COL ? "id" : sort_value ? "sort_value" :
+                vtab->options.promoted[column - SCHEMA_PROMOTED_COL].key,
+            _constraint_sql( constraint->op ) );
+        if(! constraints || ! desc) {
+            sqlite3_free( constraints );
+            sqlite3_free( desc );
+            return SQLITE_NOMEM;
+        }
+
+        /* a snapshot only narrows its scan to the ids in range, and leaves
+         * the comparison itself to SQLite */
+        index_info->aConstraintUsage[i].argvIndex = argv_index++;
+        index_info->aConstraintUsage[i].omit      = ! vtab->snapshot && ! sort_value;
+        index_info->idxNum                       |= column == SCHEMA_ID_COL ? ID_INDEX : PROMOTED_INDEX;
+
+        equality = constraint->op == SQLITE_INDEX_CONSTRAINT_EQ ||
+            constraint->op == SQLITE_INDEX_CONSTRAINT_IS ||
+            constraint->op == SQLITE_INDEX_CONSTRAINT_ISNULL;
+
+        if(column == SCHEMA_ID_COL && equality) {
+            cost = 1;
+            rows = 1;
+        } else if(equality) {
+            cost  = cost ? (cost < 10 ? cost : 10) : 10;
+            rows /= 10;
+        } else {
+            cost  = cost ? (cost < 100 ? cost : 100) : 100;
+            rows /= 4;
+        }
+    }
+
+    /* a sort_key plan's rows come out ordered by sort_value (unless values
+     * are interned; see SELECT_INTERNED_SORTED_CURS_TMPL), and rows can be
+     * read in the order of a promoted column's index; snapshots leave
+     * sorting to SQLite */
+    if(index_info->nOrderBy == 1 && ! vtab->snapshot) {
+        const struct sqlite3_index_orderby *order = index_info->aOrderBy;
+        int column = order->iColumn;
+
+        if((index_info->idxNum & SORT_INDEX) ?
+            column == sort_key_col + 1 && ! vtab->options.intern_values :
+            column >= SCHEMA_PROMOTED_COL && column < sort_key_col) {
+            index_info->orderByConsumed = 1;
+            index_info->idxNum         |= (order->desc ? ORDERED_DESC : ORDERED) |
+                (column << ORDER_COLUMN_SHIFT);
+
+            desc = sqlite3_mprintf( "%z%sORDER BY \"%w\"%s", desc, desc ? " " : "",
+                column == sort_key_col + 1 ? "sort_value" :
+                    vtab->options.promoted[column - SCHEMA_PROMOTED_COL].key,
+                order->desc ? " DESC" : "" );
+            if(! desc) {
+                sqlite3_free( constraints );
+                return SQLITE_NOMEM;
+            }
+        }
+    }
+
+    /* the row estimate starts from the table's size (see
+     * _estimate_table_rows) and shrinks with each constraint used: a key's
+     * postings or an equality keep a tenth of the rows, a range or a glob
+     * a quarter, and an id names a single row */
+    if(cost) {
+        index_info->estimatedCost = cost;
+    }
+    index_info->estimatedRows = rows > 0 ? rows : 1;
+
+    /* a query that never reads the attributes column (ex. one that only
+     * counts rows or selects ids) shouldn't drag every string out of the
+     * sequence table */
+    if(! vtab->snapshot &&
+        !(index_info->colUsed & (((sqlite3_uint64) 1) << SCHEMA_ATTR_COL))) {
+        index_info->idxNum |= NO_ATTRIBUTES;
+    }
+
+    index_info->idxStr = sqlite3_mprintf( "%s%s%s (~%lld rows)%s%s%s",
+        (index_info->idxNum & ATTR_NAME_INDEX) ? "MATCH INDEX" :
+        (index_info->idxNum & GLOB_INDEX)      ? "GLOB INDEX" :
+        (index_info->idxNum & SORT_INDEX)      ? "SORT INDEX" :
+        (index_info->idxNum & (PROMOTED_INDEX | ORDERED | ORDERED_DESC)) ? "PROMOTED INDEX" :
+        (index_info->idxNum & ID_INDEX)        ? "ID INDEX" : "SCAN",
+        desc ? ": " : "", desc ? desc : "",
+        (long long) index_info->estimatedRows,
+        constraints ? " {" : "", constraints ? constraints : "",
+        constraints ? "}" : "" );
+    sqlite3_free( constraints );
+    sqlite3_free( desc );
+
+    if(! index_info->idxStr) {
+        return SQLITE_NOMEM;
+    }
+    index_info->needToFreeIdxStr = 1;
+
+    return SQLITE_OK;
+}
+
+static int attributes_rename( sqlite3_vtab *_vtab, const char *new_name )
+{
+    struct attribute_vtab *vtab = (struct attribute_vtab *) _vtab;
+    return UNIMPLD(vtab);
+}
+
+/* hands cursor's statement (and its plan) over to its table as the last
+ * statement report, in place of the statement that the report held */
+static void _record_statement( struct attribute_cursor *cursor )
+{
+    struct attribute_vtab *vtab = (struct attribute_vtab *) cursor->cursor.pVtab;
+    struct statement_report *report = &(vtab->last_statement);
+
+    if(! cursor->stmt) {
+        return;
+    }
+
+    _clear_statement_report( report );
+
+    sqlite3_reset( cursor->stmt );
+    report->stmt   = cursor->stmt;
+    report->plan   = cursor->plan;
+    report->source = cursor->batch_stmt || cursor->batched ? "posting batches" :
+                     cursor->postings ? "posting cache" : "shadow tables";
+    cursor->stmt   = NULL;
+    cursor->plan   = NULL;
+}
+
+static int attributes_open_cursor( sqlite3_vtab *_vtab, sqlite3_vtab_cursor **cursor )
+{
+    struct attribute_vtab *vtab = (struct attribute_vtab *) _vtab;
+
+    *cursor = sqlite3_malloc( sizeof(struct attribute_cursor) );
+    if(! cursor) {
+        return SQLITE_NOMEM;
+    }
+    memset( *cursor, 0, sizeof(struct attribute_cursor) );
+
+    return SQLITE_OK;
+}
+
+static int attributes_close_cursor( sqlite3_vtab_cursor *_cursor )
+{
+    struct attribute_cursor *c = (struct attribute_cursor *) _cursor;
+
+    _record_statement( c );
+    posting_list_release( c->postings );
+    sqlite3_finalize( c->batch_stmt );
+    sqlite3_finalize( c->stmt );
+    sqlite3_blob_close( c->blob );
+    sqlite3_free( c->plan );
+    sqlite3_free( c->glob );
+    sqlite3_free( c->sort_key );
+    sqlite3_free( c );
+
+    return SQLITE_OK;
+}
+
+static int _compare_seq_ids( const void *a, const void *b )
+{
+    sqlite3_int64 left  = *((const sqlite3_int64 *) a);
+    sqlite3_int64 right = *((const sqlite3_int64 *) b);
+
+    return left < right ? -1 : left > right;
+}
+
+/* replaces cursor->postings with the next batch of postings from
+ * cursor->batch_stmt, sorted by seq_id so that the batch's rows are read in
+ * the order they're stored in */
+static int _read_posting_batch( struct attribute_cursor *cursor )
+{
+    struct posting_list *list = cursor->postings;
+    int status = SQLITE_OK;
+
+    list->n_seq_ids       = 0;
+    cursor->posting_index = 0;
+
+    while(list->n_seq_ids < POSTING_BATCH_SIZE &&
+        (status = sqlite3_step( cursor->batch_stmt )) == SQLITE_ROW) {
+        _count( (struct attribute_vtab *) cursor->cursor.pVtab, STAT_POSTINGS_READ, 1 );
+
+        status = posting_list_append( list,
+            sqlite3_column_int64( cursor->batch_stmt, POSTINGS_SEQ_COL ) );
+
+        if(status != SQLITE_OK) {
+            return status;
+        }
+    }
+
+    if(status == SQLITE_DONE) {
+        sqlite3_finalize( cursor->batch_stmt );
+        cursor->batch_stmt = NULL;
+    } else if(status != SQLITE_OK) {
+        return status;
+    }
+
+    qsort( list->seq_ids, list->n_seq_ids, sizeof(sqlite3_int64),
+        _compare_seq_ids );
+
+    return SQLITE_OK;
+}
+
+/* in posting list mode, cursor->stmt looks up a single row by seq_id; rows
+ * that have disappeared since the list was built are skipped.  if the list
+ * is a batch, the next batch is read once it runs out */
+static int _get_posting_row( struct attribute_cursor *cursor )
+{
+    int status = SQLITE_DONE;
+
+    for(;;) {
+        while(cursor->posting_index < cursor->postings->n_seq_ids) {
+            sqlite3_reset( cursor->stmt );
+
+            status = sqlite3_bind_int64( cursor->stmt, 1,
+                cursor->postings->seq_ids[cursor->posting_index++] );
+
+            if(status != SQLITE_OK) {
+                break;
+            }
+
+            status = sqlite3_step( cursor->stmt );
+
+            if(status == SQLITE_ROW) {
+                _count( (struct attribute_vtab *) cursor->cursor.pVtab, STAT_ROWS_READ, 1 );
+                return SQLITE_OK;
+            }
+            if(status != SQLITE_DONE) {
+                break;
+            }
+        }
+
+        if(status != SQLITE_DONE || ! cursor->batch_stmt) {
+            break;
+        }
+
+        status = _read_posting_batch( cursor );
+        if(status != SQLITE_OK) {
+            break;
+        }
+        status = SQLITE_DONE;
+    }
+
+    sqlite3_reset( cursor->stmt );
+    cursor->eof = 1;
+
+    if(status != SQLITE_DONE) {
+        return ERROR( (struct attribute_vtab *) cursor->cursor.pVtab, status );
+    }
+
+    return SQLITE_OK;
+}
+
+/* appends a condition matching column against a GLOB pattern to sql.  the
+ * pattern's literal prefix becomes a range on column, so the condition is
+ * answered by a range seek on the attribute index, and the GLOB itself only
+ * filters the rows in that range.  a pattern with no literal prefix scans
+ * the whole index.  see _bind_glob_condition */
+static char *_append_glob_condition( char *sql, const char *column,
+    const char *pattern, size_t pattern_len )
+{
+    size_t prefix_len = _glob_prefix_length( pattern, pattern_len );
+
+    if(! sql) {
+        return NULL;
+    }
+
+    if(prefix_len == pattern_len) {
+        return sqlite3_mprintf( "%z%s = ?", sql, column );
+    }
+
+    if(prefix_len) {
+        sql = sqlite3_mprintf( "%z%s >= ? AND ", sql, column );
+
+        if(sql && _glob_successor_length( pattern, prefix_len )) {
+            sql = sqlite3_mprintf( "%z%s < ? AND ", sql, column );
+        }
+
+        if(! sql) {
+            return NULL;
+        }
+    }
+
+    return sqlite3_mprintf( "%z%s GLOB ?", sql, column );
+}
+
+static int _bind_glob_condition( sqlite3_stmt *stmt, int *param,
+    const char *pattern, size_t pattern_len )
+{
+    size_t prefix_len = _glob_prefix_length( pattern, pattern_len );
+    size_t successor_len;
+    int status;
+
+    if(prefix_len == pattern_len) {
+        return sqlite3_bind_text( stmt, (*param)++, pattern, pattern_len,
+            SQLITE_TRANSIENT );
+    }
+
+    if(prefix_len) {
+        status = sqlite3_bind_text( stmt, (*param)++, pattern, prefix_len,
+            SQLITE_TRANSIENT );
+
+        if(status != SQLITE_OK) {
+            return status;
+        }
+
+        successor_len = _glob_successor_length( pattern, prefix_len );
+
+        if(successor_len) {
+            char *successor = sqlite3_mprintf( "%.*s", (int) successor_len, pattern );
+
+            if(! successor) {
+                return SQLITE_NOMEM;
+            }
+            successor[successor_len - 1]++;
+
+            status = sqlite3_bind_text( stmt, (*param)++, successor,
+                successor_len, sqlite3_free );
+
+            if(status != SQLITE_OK) {
+                return status;
+            }
+        }
+    }
+
+    return sqlite3_bind_text( stmt, (*param)++, pattern, pattern_len,
+        SQLITE_TRANSIENT );
+}
+
+/* builds the cursor query for glob_attr(attributes, pattern).  promoted keys
+ * aren't in the attribute index, so if the key pattern could match one, we
+ * read every row instead and set *residual; the cursor then checks each row
+ * against the pattern itself (see attributes_get_row) */
+static char *_allocate_select_glob_sql( struct attribute_vtab *vtab,
+    const char *pattern, const char *columns, int *residual )
+{
+    const char *value = strchr( pattern, RECORD_SEPARATOR );
+    size_t key_len    = value ? value - pattern : strlen( pattern );
+    char *key_pattern;
+    char *condition;
+    char *sql;
+    int i;
+
+    key_pattern = sqlite3_mprintf( "%.*s", (int) key_len, pattern );
+    if(! key_pattern) {
+        return NULL;
+    }
+
+    *residual = 0;
+    for(i = 0; i < vtab->options.n_promoted; i++) {
+        if(! sqlite3_strglob( key_pattern, vtab->options.promoted[i].key )) {
+            *residual = 1;
+        }
+    }
+    sqlite3_free( key_pattern );
+
+    /* the residual check needs each row's attributes, which are streamed
+     * through a blob for large_attributes tables */
+    if(*residual) {
+        return sqlite3_mprintf( SELECT_CURS_TMPL,
+            vtab->options.large_attributes ? vtab->lazy_select_columns :
+                vtab->select_columns,
+            vtab->database_name, vtab->table_name );
+    }
+
+    condition = _append_glob_condition( sqlite3_mprintf( "%s", "" ),
+        "a.attr_name", pattern, key_len );
+
+    if(condition && value && vtab->options.intern_values) {
+        char *value_condition = _append_glob_condition(
+            sqlite3_mprintf( "%s", "" ), "attr_value", value + 1,
+            strlen( value + 1 ) );
+
+        if(! value_condition) {
+            sqlite3_free( condition );
+            return NULL;
+        }
+
+        condition = sqlite3_mprintf( "%z AND " INTERNED_GLOB_TMPL, condition,
+            vtab->database_name, vtab->table_name, value_condition );
+        sqlite3_free( value_condition );
+    } else if(condition && value) {
+        condition = _append_glob_condition(
+            sqlite3_mprintf( "%z AND ", condition ), "a.attr_value", value + 1,
+            strlen( value + 1 ) );
+    }
+
+    if(! condition) {
+        return NULL;
+    }
+
+    sql = sqlite3_mprintf( SELECT_CURS_WITH_GLOB_TMPL, columns,
+        vtab->database_name, vtab->table_name, vtab->database_name,
+        vtab->table_name, condition );
+    sqlite3_free( condition );
+
+    return sql;
+}
+
+/* binds the parameters of a query built by _allocate_select_glob_sql, and
+ * sets *n_params to the number of parameters used */
+static int _bind_glob( sqlite3_stmt *stmt, const char *pattern, int *n_params )
+{
+    const char *value = strchr( pattern, RECORD_SEPARATOR );
+    int param = 1;
+    int status;
+
+    status = _bind_glob_condition( stmt, &param, pattern,
+        value ? value - pattern : strlen( pattern ) );
+
+    if(status == SQLITE_OK && value) {
+        status = _bind_glob_condition( stmt, &param, value + 1,
+            strlen( value + 1 ) );
+    }
+
+    *n_params = param - 1;
+
+    return status;
+}
+
+/* moves a snapshot cursor to its next row */
+static int _snapshot_get_row( struct attribute_cursor *cursor )
+{
+    const struct snapshot *snapshot =
+        ((struct attribute_vtab *) cursor->cursor.pVtab)->snapshot;
+
+    while(cursor->snapshot_position < cursor->snapshot_end) {
+        cursor->row = cursor->snapshot_postings ?
+            cursor->snapshot_postings[cursor->snapshot_position] :
+            cursor->snapshot_position;
+        cursor->snapshot_position++;
+
+        if(cursor->row >= cursor->last_row) {
+            break;
+        }
+
+        if(cursor->glob) {
+            int matched = glob_attr_matches( snapshot->strings +
+                snapshot->rows[cursor->row].attributes, cursor->glob );
+
+            if(matched < 0) {
+                return SQLITE_NOMEM;
+            }
+            if(! matched) {
+                continue;
+            }
+        }
+
+        _count( (struct attribute_vtab *) cursor->cursor.pVtab, STAT_ROWS_READ, 1 );
+        return SQLITE_OK;
+    }
+
+    cursor->eof = 1;
+
+    return SQLITE_OK;
+}
+
+static int attributes_get_row( struct attribute_cursor *cursor )
+{
+    struct attribute_vtab *vtab = (struct attribute_vtab *) cursor->cursor.pVtab;
+    int status;
+
+    if(cursor->eof) {
+        return SQLITE_OK;
+    }
+
+    if(vtab->snapshot) {
+        return _snapshot_get_row( cursor );
+    }
+
+    if(cursor->postings) {
+        return _get_posting_row( cursor );
+    }
+
+    while((status = sqlite3_step( cursor->stmt )) == SQLITE_ROW) {
+        if(cursor->glob && cursor->lazy_attributes) {
+            int matched;
+
+            status = _open_attributes_blob( vtab, &(cursor->blob),
+                &(cursor->blob_partition),
+                sqlite3_column_int64( cursor->stmt, CURS_SEQ_COL ) );
+            if(status == SQLITE_OK) {
+                status = glob_attr_blob_matches( cursor->blob, cursor->glob, &matched );
+            }
+            if(status != SQLITE_OK) {
+                break;
+            }
+            if(! matched) {
+                continue;
+            }
+        } else if(cursor->glob) {
+            int matched = glob_attr_matches( (const char *)
+                sqlite3_column_text( cursor->stmt, CURS_ATTR_COL ), cursor->glob );
+
+            if(matched < 0) {
+                status = SQLITE_NOMEM;
+                break;
+            }
+            if(! matched) {
+                continue;
+            }
+        }
+
+        _count( vtab, STAT_ROWS_READ, 1 );
+        return SQLITE_OK;
+    }
+
+    sqlite3_reset( cursor->stmt );
+    cursor->eof = 1;
+
+    if(status == SQLITE_NOMEM) {
+        return status;
+    }
+
+    if(status != SQLITE_DONE && status != SQLITE_OK) {
+        return ERROR( (struct attribute_vtab *) cursor->cursor.pVtab, status );
+    }
+
+    return SQLITE_OK;
+}
+
+/* binds a MATCH term (either a key or a key RS value pair) to the first
+ * parameters of stmt, and sets *n_params to the number of parameters used.
+ * terms on promoted keys only bind their value, since the key is implied by
+ * the column being queried */
+static int _bind_match_term( sqlite3_stmt *stmt, const char *match,
+    const struct promoted_column *promoted, int *n_params )
+{
+    int status;
+
+    if(promoted) {
+        const char *value = strchr(match, RECORD_SEPARATOR);
+
+        if(! value) {
+            *n_params = 0;
+            return SQLITE_OK;
+        }
+
+        *n_params = 1;
+        return sqlite3_bind_text( stmt, 1, value + 1, -1, SQLITE_TRANSIENT );
+    }
+
+    if(is_attribute_string(match)) {
+        const char *key;
+        const char *value;
+
+        key   = match;
+        value = strchr(match, RECORD_SEPARATOR);
+
+        status = sqlite3_bind_text( stmt, 1, key, value - key, SQLITE_TRANSIENT );
+
+        if(status != SQLITE_OK) {
+            return status;
+        }
+
+        value++;
+
+        *n_params = 2;
+        return sqlite3_bind_text( stmt, 2, value, -1, SQLITE_TRANSIENT );
+    } else {
+        *n_params = 1;
+        /* XXX bind_value? */
+        return sqlite3_bind_text( stmt, 1, match, -1, SQLITE_TRANSIENT );
+    }
+}
+
+/* reads the posting list for match from the attribute index.  *list is set
+ * to NULL if the list turns out to be too large to cache, in which case the
+ * caller should fall back to the join query */
+static int _load_posting_list( struct attribute_vtab *vtab, const char *match,
+    const struct promoted_column *promoted, struct posting_list **list )
+{
+    sqlite3_stmt *stmt;
+    char *sql;
+    int status;
+    int n_params;
+
+    *list = NULL;
+
+    sql = _allocate_select_postings_sql( vtab->database_name,
+        vtab->table_name, vtab->value_sql, match, promoted );
+
+    if(! sql) {
+        return SQLITE_NOMEM;
+    }
+
+    status = _prepare_statement( vtab, sql, &stmt );
+    sqlite3_free( sql );
+
+    if(status != SQLITE_OK) {
+        return ERROR( vtab, status );
+    }
+
+    status = _bind_match_term( stmt, match, promoted, &n_params );
+    if(status != SQLITE_OK) {
+        sqlite3_finalize( stmt );
+        return ERROR( vtab, status );
+    }
+
+    *list = posting_list_new( match, strlen( match ) );
+    if(! *list) {
+        sqlite3_finalize( stmt );
+        return SQLITE_NOMEM;
+    }
+
+    while((status = sqlite3_step( stmt )) == SQLITE_ROW) {
+        _count( vtab, STAT_POSTINGS_READ, 1 );
+
+        status = posting_list_append( *list,
+            sqlite3_column_int64( stmt, POSTINGS_SEQ_COL ) );
+
+        if(status != SQLITE_OK) {
+            break;
+        }
+
+        if(posting_list_size( *list ) > vtab->cache->budget) {
+            status = SQLITE_DONE;
+            posting_list_release( *list );
+            *list = NULL;
+            break;
+        }
+    }
+    sqlite3_finalize( stmt );
+
+    if(status != SQLITE_DONE) {
+        posting_list_release( *list );
+        *list = NULL;
+        return status == SQLITE_NOMEM ? status : ERROR( vtab, status );
+    }
+
+    if(*list) {
+        posting_cache_insert( vtab->cache, *list );
+    }
+
+    return SQLITE_OK;
+}
+
+/* returns the column:op list at the end of the plan that
+ * attributes_best_index built, or NULL if there isn't one */
+static const char *_plan_constraints( const char *plan )
+{
+    const char *constraints = plan ? strrchr( plan, '{' ) : NULL;
+
+    return constraints ? constraints + 1 : NULL;
+}
+
+/* a sort_value constraint only narrows the rows read off the index, and
+ * SQLite checks it against sort_value itself.  the index compares values
+ * as text, so a constraint on anything but text (which compares differently
+ * against text) is left to SQLite entirely, as is one on a promoted key,
+ * whose column has a type of its own */
+static int _sort_value_pushed_down( struct attribute_vtab *vtab, int column,
+    sqlite3_value *value, const struct promoted_column *promoted )
+{
+    if(column != SCHEMA_SORT_VALUE_COL( &(vtab->options) )) {
+        return 1;
+    }
+
+    return ! promoted && sqlite3_value_type( value ) == SQLITE_TEXT;
+}
+
+/* the expression that a sort_key query reads its value from; see
+ * _allocate_select_sorted_sql */
+static const char *_sort_value_sql( struct attribute_vtab *vtab )
+{
+    if(vtab->options.intern_values) {
+        return "v.attr_value";
+    }
+
+    return vtab->options.partition_size ? "s.attr_value" : "a.attr_value";
+}
+
+/* appends the id, promoted column and sort_value constraints described by
+ * idx_str (see _plan_constraints) to sql */
+static char *_append_promoted_constraints( struct attribute_vtab *vtab,
+    char *sql, int has_where, const char *idx_str, sqlite3_value **argv,
+    const struct promoted_column *promoted )
+{
+    while(sql && idx_str && *idx_str && *idx_str != '}') {
+        char *endp;
+        int column = strtol( idx_str, &endp, 10 );
+        int op     = strtol( endp + 1, &endp, 10 );
+
+        if(column == SCHEMA_SORT_VALUE_COL( &(vtab->options) )) {
+            if(_sort_value_pushed_down( vtab, column, *argv, promoted )) {
+                sql = sqlite3_mprintf( "%z" SORT_VALUE_CONSTRAINT_TMPL, sql,
+                    has_where ? "AND" : "WHERE", _sort_value_sql( vtab ),
+                    _constraint_sql( op ) );
+                has_where = 1;
+            }
+        } else {
+            sql = sqlite3_mprintf( "%z" PROMOTED_CONSTRAINT_TMPL, sql,
+                has_where ? "AND" : "WHERE",
+                column == SCHEMA_ID_COL ? "seq_id" :
+                    vtab->options.promoted[column - SCHEMA_PROMOTED_COL].key,
+                _constraint_sql( op ) );
+            has_where = 1;
+        }
+        argv++;
+
+        idx_str = *endp == ',' ? endp + 1 : endp;
+    }
+
+    return sql;
+}
+
+static int _bind_promoted_constraints( struct attribute_vtab *vtab,
+    sqlite3_stmt *stmt, int param, const char *idx_str, sqlite3_value **argv,
+    const struct promoted_column *promoted )
+{
+    int status;
+
+    while(idx_str && *idx_str && *idx_str != '}') {
+        char *endp;
+        int column;
+        int op;
+
+        column = strtol( idx_str, &endp, 10 );
+        op     = strtol( endp + 1, &endp, 10 );
+
+        if(_constraint_has_operand( op ) &&
+            _sort_value_pushed_down( vtab, column, *argv, promoted )) {
+            status = sqlite3_bind_value( stmt, param++, *argv );
+
+            if(status != SQLITE_OK) {
+                return status;
+            }
+        }
+        argv++;
+
+        idx_str = *endp == ',' ? endp + 1 : endp;
+    }
+
+    return SQLITE_OK;
+}
+
+/* narrows the range of rows a snapshot cursor reads to those whose ids can
+ * satisfy an id constraint.  non-integer operands are narrowed loosely, or
+ * not at all; SQLite checks the constraint on every row either way */
+static void _snapshot_narrow( struct attribute_cursor *cursor, int op,
+    sqlite3_value *operand )
+{
+    const struct snapshot *snapshot =
+        ((struct attribute_vtab *) cursor->cursor.pVtab)->snapshot;
+    sqlite3_int64 low;
+    sqlite3_int64 high;
+    sqlite3_int64 row;
+
+    if(sqlite3_value_type( operand ) == SQLITE_INTEGER) {
+        low = high = sqlite3_value_int64( operand );
+    } else if(sqlite3_value_type( operand ) == SQLITE_FLOAT) {
+        double d = sqlite3_value_double( operand );
+
+        if(!(d > -9e18 && d < 9e18)) {
+            return;
+        }
+        low  = (sqlite3_int64) d - 1;
+        high = (sqlite3_int64) d + 1;
+    } else {
+        return;
+    }
+
+    if(op == SQLITE_INDEX_CONSTRAINT_EQ || op == SQLITE_INDEX_CONSTRAINT_GT ||
+        op == SQLITE_INDEX_CONSTRAINT_GE) {
+        row = snapshot_find_row( snapshot, low, op == SQLITE_INDEX_CONSTRAINT_GT );
+
+        if(row > cursor->first_row) {
+            cursor->first_row = row;
+        }
+    }
+
+    if(op == SQLITE_INDEX_CONSTRAINT_EQ || op == SQLITE_INDEX_CONSTRAINT_LT ||
+        op == SQLITE_INDEX_CONSTRAINT_LE) {
+        row = snapshot_find_row( snapshot, high, op != SQLITE_INDEX_CONSTRAINT_LT );
+
+        if(row < cursor->last_row) {
+            cursor->last_row = row;
+        }
+    }
+}
+
+/* snapshots answer MATCH from their posting lists, and id constraints by
+ * binary search over their rows, which are ordered by id */
+static int _snapshot_filter( struct attribute_cursor *c, const char *match,
+    const char *idx_name, sqlite3_value **constraint_argv )
+{
+    const struct snapshot *snapshot =
+        ((struct attribute_vtab *) c->cursor.pVtab)->snapshot;
+    const char *constraints = _plan_constraints( idx_name );
+
+    c->snapshot_postings = NULL;
+    c->first_row         = 0;
+    c->last_row          = snapshot->header->n_rows;
+    c->eof               = 0;
+
+    while(constraints && *constraints && *constraints != '}') {
+        char *endp;
+        int op;
+
+        strtol( constraints, &endp, 10 );
+        op = strtol( endp + 1, &endp, 10 );
+
+        _snapshot_narrow( c, op, *constraint_argv++ );
+
+        constraints = *endp == ',' ? endp + 1 : endp;
+    }
+
+    if(match) {
+        const char *value = strchr( match, RECORD_SEPARATOR );
+        const struct snapshot_key *key;
+        uint64_t postings   = 0;
+        uint64_t n_postings = 0;
+        uint64_t low;
+        uint64_t high;
+
+        key = snapshot_find_key( snapshot, match,
+            value ? value - match : strlen( match ) );
+
+        if(key && value) {
+            const struct snapshot_value *found = snapshot_find_value( snapshot,
+                key, value + 1, strlen( value + 1 ) );
+
+            key = found ? key : NULL;
+            postings   = found ? found->postings : 0;
+            n_postings = found ? found->n_postings : 0;
+        } else if(key) {
+            postings   = key->postings;
+            n_postings = key->n_postings;
+        }
+
+        if(! key) {
+            c->eof = 1;
+            return SQLITE_OK;
+        }
+
+        c->snapshot_postings = snapshot->postings + postings;
+
+        /* skip the postings for rows before first_row */
+        low  = 0;
+        high = n_postings;
+        while(low < high) {
+            uint64_t mid = low + (high - low) / 2;
+
+            if(c->snapshot_postings[mid] < c->first_row) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+
+        c->snapshot_position = low;
+        c->snapshot_end      = n_postings;
+    } else {
+        c->snapshot_position = c->first_row;
+        c->snapshot_end      = c->last_row;
+    }
+
+    return _snapshot_get_row( c );
+}
+
+static int _start_posting_batches( struct attribute_vtab *vtab,
+    struct attribute_cursor *c, const char *key )
+{
+    int status;
+
+    status = _prepare_allocated_statement( vtab,
+        _allocate_select_posting_batches_sql( vtab->database_name,
+            vtab->table_name ),
+        &(c->batch_stmt) );
+
+    if(status == SQLITE_NOMEM) {
+        return status;
+    }
+
+    if(status == SQLITE_OK) {
+        status = sqlite3_bind_text( c->batch_stmt, 1, key, -1, SQLITE_TRANSIENT );
+    }
+
+    if(status != SQLITE_OK) {
+        return ERROR( vtab, status );
+    }
+
+    c->postings = posting_list_new( key, strlen( key ) );
+    if(! c->postings) {
+        return SQLITE_NOMEM;
+    }
+    c->batched = 1;
+
+    status = _read_posting_batch( c );
+
+    return status == SQLITE_NOMEM ? status :
+        status != SQLITE_OK ? ERROR( vtab, status ) : SQLITE_OK;
+}
+
+static int _filter( sqlite3_vtab_cursor *_cursor, int idx_num,
+    const char *idx_name, int argc, sqlite3_value **argv )
+{
+    struct attribute_vtab *vtab = (struct attribute_vtab *) _cursor->pVtab;
+    struct attribute_cursor *c  = (struct attribute_cursor *) _cursor;
+    const char *match           = NULL;
+    const char *glob            = NULL;
+    const char *sort_key        = NULL;
+    const struct promoted_column *promoted = NULL;
+    const char *columns;
+    int status;
+    int n_params = 0;
+    int residual = 0;
+    int lazy;
+    char *sql;
+
+    _count( vtab, STAT_FILTERS, 1 );
+
+    _record_statement( c );
+    sqlite3_finalize( c->stmt );
+    c->stmt = NULL;
+
+    sqlite3_free( c->plan );
+    c->plan = sqlite3_mprintf( "%s", idx_name ? idx_name : "" );
+
+    posting_list_release( c->postings );
+    c->postings      = NULL;
+    c->posting_index = 0;
+
+    sqlite3_finalize( c->batch_stmt );
+    c->batch_stmt = NULL;
+
+    sqlite3_blob_close( c->blob );
+    c->blob            = NULL;
+    c->lazy_attributes = 0;
+    c->batched    = 0;
+
+    sqlite3_free( c->glob );
+    c->glob = NULL;
+
+    sqlite3_free( c->sort_key );
+    c->sort_key = NULL;
+
+    /* keys can't contain the separator, so neither can a key with rows */
+    if(idx_num & SORT_INDEX) {
+        sort_key = sqlite3_value_text( argv[0] );
+
+        if(! sort_key || strchr( sort_key, RECORD_SEPARATOR )) {
+            c->eof = 1;
+            return SQLITE_OK;
+        }
+
+        c->sort_key = sqlite3_mprintf( "%s", sort_key );
+        if(! c->sort_key) {
+            return SQLITE_NOMEM;
+        }
+        sort_key = c->sort_key;
+        promoted = _promoted_column_for_term( &(vtab->options), sort_key );
+    }
+
+    if(idx_num & GLOB_INDEX) {
+        glob = sqlite3_value_text( argv[0] );
+
+        if(! glob) {
+            c->eof = 1;
+            return SQLITE_OK;
+        }
+    }
+
+    if(idx_num & ATTR_NAME_INDEX) {
+        match = sqlite3_value_text( argv[0] );
+
+        if(! match) { /* nothing matches NULL */
+            c->eof = 1;
+            return SQLITE_OK;
+        }
+        promoted = _promoted_column_for_term( &(vtab->options), match );
+    }
+
+    /* snapshots check glob_attr patterns against every row */
+    if(vtab->snapshot) {
+        if(glob) {
+            c->glob = sqlite3_mprintf( "%s", glob );
+
+            if(! c->glob) {
+                return SQLITE_NOMEM;
+            }
+        }
+
+        return _snapshot_filter( c, match ? match : sort_key, idx_name,
+            argv + ((match || glob || sort_key) ? 1 : 0) );
+    }
+
+    _discard_stale_state( vtab );
+
+    if(sort_key && !_bloom_may_match( vtab, sort_key )) {
+        _count( vtab, STAT_BLOOM_REJECTS, 1 );
+        c->eof = 1;
+        return SQLITE_OK;
+    }
+
+    if(match && !_bloom_may_match( vtab, match )) {
+        _count( vtab, STAT_BLOOM_REJECTS, 1 );
+        c->eof = 1;
+        return SQLITE_OK;
+    }
+
+    /* the posting cache only handles plain MATCH queries */
+    if(match && vtab->cache &&
+        !(idx_num & (PROMOTED_INDEX | ID_INDEX | ORDERED | ORDERED_DESC))) {
+        c->postings = posting_cache_lookup( vtab->cache, match, strlen( match ) );
+
+        if(! c->postings) {
+            status = _load_posting_list( vtab, match, promoted, &(c->postings) );
+
+            if(status != SQLITE_OK) {
+                return status;
+            }
+        }
+    }
+
+    /* a key's postings are ordered by value, so joining them to the sequence
+     * table in index order would jump all over it; read them in batches
+     * sorted by seq_id instead.  a key-value pair's postings are already in
+     * seq_id order */
+    if(match && ! c->postings && ! promoted && ! is_attribute_string( match ) &&
+        ! vtab->options.partition_size &&
+        !(idx_num & (PROMOTED_INDEX | ID_INDEX | ORDERED | ORDERED_DESC))) {
+        status = _start_posting_batches( vtab, c, match );
+
+        if(status != SQLITE_OK) {
+            return status;
+        }
+    }
+
+    /* attribute strings are read through a blob when the row's attributes
+     * are asked for, if they are at all */
+    lazy    = vtab->options.large_attributes || (idx_num & NO_ATTRIBUTES);
+    columns = lazy ? vtab->lazy_select_columns : vtab->select_columns;
+
+    if(c->postings) {
+        sql = _allocate_select_sequence_by_id_sql( vtab->database_name,
+            vtab->table_name, columns );
+    } else {
+        if(glob) {
+            sql = _allocate_select_glob_sql( vtab, glob, columns, &residual );
+        } else if(sort_key) {
+            sql = _allocate_select_sorted_sql( vtab->database_name,
+                vtab->table_name, columns, promoted,
+                vtab->options.intern_values, vtab->options.partition_size != 0 );
+        } else {
+            sql = _allocate_select_cursor_sql( vtab->database_name,
+                vtab->table_name, columns, vtab->value_sql, match,
+                promoted, vtab->options.partition_size != 0 );
+        }
+
+        if(idx_num & (PROMOTED_INDEX | ID_INDEX)) {
+            sql = _append_promoted_constraints( vtab, sql,
+                (match || glob || sort_key) && ! residual,
+                _plan_constraints( idx_name ),
+                argv + ((match || glob || sort_key) ? 1 : 0), promoted );
+        }
+
+        /* a sort_key query's value column comes right after the promoted
+         * columns, as sort_value does in the table's schema */
+        if(sql && (idx_num & (ORDERED | ORDERED_DESC))) {
+            int column = idx_num >> ORDER_COLUMN_SHIFT;
+
+            if(column == SCHEMA_SORT_VALUE_COL( &(vtab->options) )) {
+                column--;
+            }
+
+            sql = sqlite3_mprintf( "%z" ORDER_BY_TMPL, sql, column + 1,
+                (idx_num & ORDERED_DESC) ? " DESC" : "" );
+        }
+    }
+
+    c->lazy_attributes = lazy && (vtab->options.large_attributes || ! residual);
+
+    if(residual) {
+        c->glob = sqlite3_mprintf( "%s", glob );
+
+        if(! c->glob) {
+            sqlite3_free( sql );
+            return SQLITE_NOMEM;
+        }
+    }
+
+    if(! sql) {
+        return SQLITE_NOMEM;
+    }
+
+    status = _prepare_statement( vtab, sql, &(c->stmt) );
+    sqlite3_free( sql );
+
+    if(status != SQLITE_OK) {
+        return ERROR( vtab, status );
+    }
+    c->eof = 0;
+
+    if(match && !c->postings) {
+        status = _bind_match_term( c->stmt, match, promoted, &n_params );
+
+        if(status != SQLITE_OK) {
+            return ERROR( vtab, status );
+        }
+    }
+
+    if(glob && ! residual) {
+        status = _bind_glob( c->stmt, glob, &n_params );
+
+        if(status != SQLITE_OK) {
+            return ERROR( vtab, status );
+        }
+    }
+
+    if(sort_key && ! promoted) {
+        status = sqlite3_bind_text( c->stmt, ++n_params, sort_key, -1, SQLITE_STATIC );
+
+        if(status != SQLITE_OK) {
+            return ERROR( vtab, status );
+        }
+    }
+
+    if(idx_num & (PROMOTED_INDEX | ID_INDEX)) {
+        status = _bind_promoted_constraints( vtab, c->stmt, n_params + 1,
+            _plan_constraints( idx_name ),
+            argv + ((match || glob || sort_key) ? 1 : 0), promoted );
+
+        if(status != SQLITE_OK) {
+            return ERROR( vtab, status );
+        }
+    }
+
+    return attributes_get_row( c );
+}
+
+static int attributes_filter( sqlite3_vtab_cursor *_cursor, int idx_num,
+    const char *idx_name, int argc, sqlite3_value **argv )
+{
+    int status;
+    TIMER_START( start );
+
+    status = _filter( _cursor, idx_num, idx_name, argc, argv );
+
+    TIMER_STOP( (struct attribute_vtab *) _cursor->pVtab, STAT_FILTER_TIME, start );
+
+    return status;
+}
+
+static int attributes_next( sqlite3_vtab_cursor *_cursor )
+{
+    int status;
+    TIMER_START( start );
+
+    status = attributes_get_row( (struct attribute_cursor *) _cursor );
+
+    TIMER_STOP( (struct attribute_vtab *) _cursor->pVtab, STAT_NEXT_TIME, start );
+
+    return status;
+}
+
+static int attributes_eof( sqlite3_vtab_cursor *_cursor )
+{
+    struct attribute_cursor *c = (struct attribute_cursor *) _cursor;
+
+    return c->eof;
+}
+
+static int attributes_row_id( sqlite3_vtab_cursor *_cursor, sqlite_int64 *rowid )
+{
+    struct attribute_cursor *c = (struct attribute_cursor *) _cursor;
+    const struct snapshot *snapshot = ((struct attribute_vtab *) _cursor->pVtab)->snapshot;
+
+    if(snapshot) {
+        *rowid = snapshot->rows[c->row].id;
+        return SQLITE_OK;
+    }
+
+    *rowid = sqlite3_column_int64( c->stmt, CURS_SEQ_COL );
+
+    return SQLITE_OK;
+}
+
+static int attributes_column( sqlite3_vtab_cursor *_cursor, sqlite3_context *ctx,
+    int col_index )
+{
+    struct attribute_cursor *cursor = (struct attribute_cursor *) _cursor;
+    struct attribute_vtab *vtab     = (struct attribute_vtab *) _cursor->pVtab;
+    const struct snapshot *snapshot = vtab->snapshot;
+
+    /* the mapping outlives every statement that reads from the table, so
+     * attribute strings are handed to SQLite without copying them */
+    if(snapshot) {
+        const struct snapshot_row *row = snapshot->rows + cursor->row;
+
+        if(col_index == SCHEMA_ID_COL) {
+            sqlite3_result_int64( ctx, row->id );
+        } else if(col_index == SCHEMA_ATTR_COL) {
+            sqlite3_result_text( ctx, snapshot->strings + row->attributes,
+                row->attributes_len, SQLITE_STATIC );
+        } else if(col_index == SCHEMA_SORT_KEY_COL( &(vtab->options) ) && cursor->sort_key) {
+            sqlite3_result_text( ctx, cursor->sort_key, -1, SQLITE_TRANSIENT );
+        } else if(cursor->sort_key) {
+            size_t value_len;
+            const char *value = extract_attribute_value(
+                snapshot->strings + row->attributes, cursor->sort_key, &value_len );
+
+            if(value) {
+                sqlite3_result_text( ctx, value, value_len, SQLITE_STATIC );
+            }
+        }
+        return SQLITE_OK;
+    }
+
+    /* an UPDATE that leaves the derived columns alone doesn't need their
+     * values; see _check_derived_columns */
+    if(col_index >= SCHEMA_PROMOTED_COL && sqlite3_vtab_nochange( ctx )) {
+        return SQLITE_OK;
+    }
+
+    /* the sort columns are NULL unless sort_key was given, in which case the
+     * cursor's query ends with the value of sort_key */
+    if(col_index == SCHEMA_SORT_KEY_COL( &(vtab->options) )) {
+        if(cursor->sort_key) {
+            sqlite3_result_text( ctx, cursor->sort_key, -1, SQLITE_TRANSIENT );
+        }
+        return SQLITE_OK;
+    } else if(col_index == SCHEMA_SORT_VALUE_COL( &(vtab->options) )) {
+        if(cursor->sort_key) {
+            sqlite3_result_value( ctx, sqlite3_column_value( cursor->stmt, col_index - 1 ) );
+        }
+        return SQLITE_OK;
+    }
+
+    /* the string is read straight into the buffer handed to SQLite, so
+     * it's only copied once */
+    if(col_index == SCHEMA_ATTR_COL && cursor->lazy_attributes) {
+        char *attributes;
+        int n_bytes;
+        int status = _read_attributes_blob( vtab, &(cursor->blob),
+            &(cursor->blob_partition),
+            sqlite3_column_int64( cursor->stmt, CURS_SEQ_COL ), &attributes,
+            &n_bytes );
+
+        if(status != SQLITE_OK) {
+            return status == SQLITE_NOMEM ? status : ERROR( vtab, status );
+        }
+        sqlite3_result_text( ctx, attributes, n_bytes, sqlite3_free );
+
+        return SQLITE_OK;
+    }
+
+    sqlite3_result_value( ctx, sqlite3_column_value( cursor->stmt, col_index ) );
+
+    return SQLITE_OK;
+}
+
+static void _attribute_match_func(sqlite3_context *ctx, int nargs, sqlite3_value **values)
+{
+    struct attribute_vtab *vtab = sqlite3_user_data(ctx);
+    const char *query;
+    const char *attributes;
+    const char *rs_location;
+    const char *attr_value;
+    size_t value_len;
+
+    query      = sqlite3_value_text(values[0]);
+    attributes = sqlite3_value_text(values[1]);
+
+    if(vtab) {
+        _count( vtab, STAT_MATCH_CALLS, 1 );
+    }
+
+    if(vtab && vtab->blooms && !_bloom_may_match( vtab, query )) {
+        _count( vtab, STAT_BLOOM_REJECTS, 1 );
+        sqlite3_result_int( ctx, 0 );
+        return;
+    }
+
+    if(rs_location = strchr(query, RECORD_SEPARATOR)) { /* searching for a key value pair */
+        char *key = sqlite3_malloc( rs_location - query + 1 ); /* one for the NULL */
+        memcpy( key, query, rs_location - query );
+        key[rs_location - query] = '\0';
+
+        attr_value = extract_attribute_value( attributes, key, &value_len );
+
+        sqlite3_free( key );
+
+        sqlite3_result_int( ctx, attr_value &&
+            !strncmp( rs_location + 1, attr_value, value_len ) );
+    } else { /* searching for whether or not a key is present */
+        attr_value = extract_attribute_value( attributes, query, &value_len );
+
+        sqlite3_result_int( ctx, attr_value != NULL );
+    }
+}
+
+static int attributes_find_function(sqlite3_vtab *_vtab, int nArg,
+    const char *zName, void (**pxFunc)(sqlite3_context *, int, sqlite3_value **),
+    void **ppArg)
+{
+    struct attribute_vtab *vtab = (struct attribute_vtab *) _vtab;
+
+    if(! strcmp(zName, "get_attr") && nArg == 2) {
+        *pxFunc = sql_get_attr;
+        *ppArg  = NULL;
+
+        return GET_ATTR_CONSTRAINT;
+    }
+
+    if(! strcmp(zName, "glob_attr") && nArg == 2) {
+        *pxFunc = sql_glob_attr;
+        *ppArg  = NULL;
+
+        return GLOB_ATTR_CONSTRAINT;
+    }
+
+    if(strcmp(zName, "match")) {
+        *pxFunc = NULL;
+        return 0;
+    }
+
+    *pxFunc = _attribute_match_func;
+    *ppArg  = vtab;
+
+    return 1;
+}
+
+static int attributes_begin( sqlite3_vtab *_vtab )
+{
+    return SQLITE_OK;
+}
+
+static int attributes_sync( sqlite3_vtab *_vtab )
+{
+    struct attribute_vtab *vtab = (struct attribute_vtab *) _vtab;
+
+    return _flush_bloom_filters( vtab );
+}
+
+static int attributes_commit( sqlite3_vtab *_vtab )
+{
+    return SQLITE_OK;
+}
+
+/* the posting cache is patched as rows are written, so anything rolled back
+ * leaves it inconsistent with the shadow tables */
+static int attributes_rollback( sqlite3_vtab *_vtab )
+{
+    struct attribute_vtab *vtab = (struct attribute_vtab *) _vtab;
+
+    posting_cache_clear( vtab->cache );
+
+    /* the partition the row statements were prepared for may have been
+     * created in the transaction that was just rolled back */
+    if(vtab->options.partition_size) {
+        _finalize_row_statements( vtab );
+    }
+
+    return SQLITE_OK;
+}
+
+static int attributes_savepoint( sqlite3_vtab *_vtab, int savepoint )
+{
+    return SQLITE_OK;
+}
+
+static int attributes_release( sqlite3_vtab *_vtab, int savepoint )
+{
+    return SQLITE_OK;
+}
+
+static int attributes_rollback_to( sqlite3_vtab *_vtab, int savepoint )
+{
+    return attributes_rollback( _vtab );
+}
+
+/* a table isn't connected until a statement uses it, so this prepares one
+ * that does; returns SQLITE_ERROR if schema has no such table */
+static int _connect_table( sqlite3 *db, const char *schema,
+    const char *table_name )
 {
+    sqlite3_stmt *stmt = NULL;
     char *sql;
-    struct attribute_vtab *vtab;
-    sqlite3 *db;
-    char *database_name;
-    char *table_name;
     int status;
-    int return_status = SQLITE_OK;
 
-    vtab          = (struct attribute_vtab *) _vtab;
-    db            = vtab->db;
-    database_name = vtab->database_name;
-    table_name    = vtab->table_name;
+    sql = sqlite3_mprintf( CONNECT_TABLE_TMPL, schema, table_name );
+    if(! sql) {
+        return SQLITE_NOMEM;
+    }
 
-    sql = _allocate_drop_sequence_schema_sql( database_name, table_name );
+    status = sqlite3_prepare_v2( db, sql, -1, &stmt, NULL );
+    sqlite3_finalize( stmt );
+    sqlite3_free( sql );
 
-    if(! sql ) {
-        return_status = SQLITE_NOMEM;
-    } else {
-        status = sqlite3_exec( db, sql, NULL, NULL, NULL );
-        if(status != SQLITE_OK) {
-            return_status = status;
+    return status;
+}
+
+/* returns the connected attribute table schema.table_name, or NULL if it
+ * isn't one */
+static struct attribute_vtab *_connected_vtab( struct attribute_module *module,
+    const char *schema, const char *table_name )
+{
+    struct attribute_vtab *vtab;
+
+    for(vtab = module->vtabs; vtab; vtab = vtab->next) {
+        if(! sqlite3_stricmp( vtab->table_name, table_name ) &&
+            ! sqlite3_stricmp( vtab->database_name, schema )) {
+            return vtab;
         }
+    }
 
-        sqlite3_free( sql );
+    return NULL;
+}
+
+/* finds the attribute table named by name, which is either schema.table or
+ * a bare table name; like SQLite, we look for a bare name in temp, then main,
+ * then the attached databases, and the first table by that name wins */
+static struct attribute_vtab *_find_vtab( sqlite3 *db,
+    struct attribute_module *module, const char *name )
+{
+    struct attribute_vtab *vtab = NULL;
+    const char *dot = strchr( name, '.' );
+    sqlite3_stmt *stmt;
+    int status;
 
-        sql = _allocate_drop_attribute_schema_sql( database_name, table_name );
+    if(dot) {
+        char *schema = sqlite3_mprintf( "%.*s", (int) (dot - name), name );
 
-        if(! sql) {
-            return_status = SQLITE_NOMEM;
-        } else {
-            status = sqlite3_exec( db, sql, NULL, NULL, NULL );
-            if(status != SQLITE_OK) {
-                return_status = status;
-            }
+        if(! schema) {
+            return NULL;
+        }
+        if(_connect_table( db, schema, dot + 1 ) == SQLITE_OK) {
+            vtab = _connected_vtab( module, schema, dot + 1 );
+        }
+        sqlite3_free( schema );
 
-            sqlite3_free( sql );
+        if(vtab) {
+            return vtab;
         }
     }
 
-    status = attributes_disconnect( _vtab );
+    status = sqlite3_prepare_v2( db, SELECT_SCHEMAS_SQL, -1, &stmt, NULL );
     if(status != SQLITE_OK) {
-        return_status = status;
+        return NULL;
     }
 
-    return return_status;
-}
+    while(sqlite3_step( stmt ) == SQLITE_ROW) {
+        const char *schema = (const char *) sqlite3_column_text( stmt, 0 );
 
-struct _insert_attribute_info {
-    sqlite3_stmt *stmt;
-    sqlite3_int64 rowid;
-    int error_code;
-};
+        if(_connect_table( db, schema, name ) == SQLITE_OK) {
+            vtab = _connected_vtab( module, schema, name );
+            break;
+        }
+    }
+    sqlite3_finalize( stmt );
 
-static int _insert_attributes( const char *key, size_t key_len,
-    const char *value, size_t value_len, void *udata )
+    return vtab;
+}
+
+/* attributes_cache_stat(table_name, stat) returns one of the posting cache's
+ * counters: 'hits', 'misses', 'entries', 'bytes' or 'budget' */
+static void sql_cache_stat( sqlite3_context *ctx, int nargs,
+    sqlite3_value **values )
 {
-    struct _insert_attribute_info *info = (struct _insert_attribute_info *) udata;
-    int status;
+    struct attribute_module *module = sqlite3_user_data( ctx );
+    struct attribute_vtab *vtab;
+    struct posting_list *list;
+    const char *table_name;
+    const char *stat;
+    sqlite3_int64 entries = 0;
 
-    info->error_code = sqlite3_bind_int64( info->stmt, INSERT_ATTR_SEQ_COL, info->rowid );
-    if(info->error_code != SQLITE_OK) {
-        return BREAK;
+    table_name = sqlite3_value_text( values[0] );
+    stat       = sqlite3_value_text( values[1] );
+
+    if(! table_name || ! stat) {
+        sqlite3_result_error( ctx, "table name and statistic must not be NULL", -1 );
+        return;
     }
-    info->error_code = sqlite3_bind_text(  info->stmt, INSERT_ATTR_KEY_COL, key,   key_len,   SQLITE_TRANSIENT );
-    if(info->error_code != SQLITE_OK) {
-        return BREAK;
+
+    vtab = _find_vtab( sqlite3_context_db_handle( ctx ), module,
+        table_name );
+
+    if(! vtab) {
+        sqlite3_result_error( ctx, "no such attribute table", -1 );
+        return;
     }
-    info->error_code = sqlite3_bind_text(  info->stmt, INSERT_ATTR_VAL_COL, value, value_len, SQLITE_TRANSIENT );
-    if(info->error_code != SQLITE_OK) {
-        return BREAK;
+
+    if(! vtab->cache) {
+        sqlite3_result_null( ctx );
+        return;
     }
 
-    info->error_code = sqlite3_step( info->stmt );
-    sqlite3_reset( info->stmt );
+    if(! strcmp( stat, "hits" )) {
+        sqlite3_result_int64( ctx, vtab->cache->hits );
+    } else if(! strcmp( stat, "misses" )) {
+        sqlite3_result_int64( ctx, vtab->cache->misses );
+    } else if(! strcmp( stat, "entries" )) {
+        for(list = vtab->cache->lru_head; list; list = list->lru_next) {
+            entries++;
+        }
+        sqlite3_result_int64( ctx, entries );
+    } else if(! strcmp( stat, "bytes" )) {
+        sqlite3_result_int64( ctx, vtab->cache->used );
+    } else if(! strcmp( stat, "budget" )) {
+        sqlite3_result_int64( ctx, vtab->cache->budget );
+    } else {
+        sqlite3_result_error( ctx, "unknown cache statistic", -1 );
+    }
+}
 
-    if(info->error_code == SQLITE_DONE) {
-        return CONTINUE;
+/* reports why one of the maintenance functions failed.  they change (and
+ * drop) shadow tables, which SQLite doesn't allow while another statement,
+ * or the statement calling them, is reading a table; SQLite's own message
+ * for that doesn't say which table, or what to do about it */
+static void _result_maintenance_error( sqlite3_context *ctx,
+    struct attribute_vtab *vtab, const char *function, int status )
+{
+    if((status & 0xff) == SQLITE_LOCKED) {
+        char *message = sqlite3_mprintf( "%s must be called in a SELECT of "
+            "its own, not in one that reads from a table (%s)", function,
+            sqlite3_errmsg( vtab->db ) );
+
+        if(! message) {
+            sqlite3_result_error_nomem( ctx );
+            return;
+        }
+        sqlite3_result_error( ctx, message, -1 );
+        sqlite3_free( message );
+    } else if(status == SQLITE_NOMEM) {
+        sqlite3_result_error_nomem( ctx );
+        return;
     } else {
-        return BREAK;
+        sqlite3_result_error( ctx, sqlite3_errmsg( vtab->db ), -1 );
     }
+    sqlite3_result_error_code( ctx, status );
 }
 
-static int _perform_insert( struct attribute_vtab *vtab, int argc, sqlite3_value **argv, sqlite_int64 *rowid )
+/* attributes_drop_partitions(table_name, id) drops every partition of a
+ * partitioned table whose ids are all below id, along with their rows, and
+ * returns the number of partitions dropped */
+static void sql_drop_partitions( sqlite3_context *ctx, int nargs,
+    sqlite3_value **values )
 {
+    struct attribute_module *module = sqlite3_user_data( ctx );
+    struct attribute_vtab *vtab;
+    const char *table_name;
+    int n_dropped = 0;
     int status;
-    const char *attributes;
-    const char *key_endp;
-    struct _insert_attribute_info info;
 
-    if(sqlite3_value_type( argv[UPDATE_ARG_ATTRS] ) != SQLITE_TEXT) {
-        vtab->vtab.zErrMsg = sqlite3_mprintf( "%s", "attributes must be an attribute string" );
-        return SQLITE_ERROR;
+    table_name = sqlite3_value_text( values[0] );
+
+    if(! table_name || sqlite3_value_type( values[1] ) == SQLITE_NULL) {
+        sqlite3_result_error( ctx, "table name and id must not be NULL", -1 );
+        return;
     }
 
-    attributes = sqlite3_value_text( argv[UPDATE_ARG_ATTRS] );
+    vtab = _find_vtab( sqlite3_context_db_handle( ctx ), module,
+        table_name );
 
-    if(! is_attribute_string( attributes )) {
-        vtab->vtab.zErrMsg = sqlite3_mprintf( "%s", "attributes must be an attribute string" );
-        return SQLITE_ERROR;
+    if(! vtab) {
+        sqlite3_result_error( ctx, "no such attribute table", -1 );
+        return;
     }
 
-    if(*rowid == 0) { /* we provide our own ROWID */
-        status = sqlite3_bind_null( vtab->insert_seq_stmt, INSERT_SEQ_ID_COL );
-    } else {
-        status = sqlite3_bind_int64( vtab->insert_seq_stmt, INSERT_SEQ_ID_COL,
-            *rowid );
+    if(! vtab->options.partition_size) {
+        sqlite3_result_error( ctx, "attribute table is not partitioned", -1 );
+        return;
     }
 
-    if(status != SQLITE_OK) {
-        return ERROR( vtab, status );
+    status = sqlite3_exec( vtab->db, "SAVEPOINT attributes_drop_partitions",
+        NULL, NULL, NULL );
+
+    if(status == SQLITE_OK) {
+        status = _drop_partitions( vtab, 0,
+            _partition_for( vtab, sqlite3_value_int64( values[1] ) ),
+            &n_dropped );
     }
 
-    /* XXX bind_value? */
-    status = sqlite3_bind_text( vtab->insert_seq_stmt, INSERT_SEQ_ATTR_COL,
-        attributes, -1, SQLITE_TRANSIENT );
-    if(status != SQLITE_OK) {
-        return ERROR( vtab, status );
+    if(status == SQLITE_OK) {
+        status = sqlite3_exec( vtab->db, "RELEASE attributes_drop_partitions",
+            NULL, NULL, NULL );
     }
-    status = sqlite3_step( vtab->insert_seq_stmt );
 
-    if(status != SQLITE_DONE) {
-        sqlite3_reset( vtab->insert_seq_stmt );
-        return ERROR( vtab, status );
+    if(status != SQLITE_OK) {
+        _result_maintenance_error( ctx, vtab, "attributes_drop_partitions", status );
+        sqlite3_exec( vtab->db, "ROLLBACK TO attributes_drop_partitions; "
+            "RELEASE attributes_drop_partitions", NULL, NULL, NULL );
+        return;
     }
-    *rowid = sqlite3_last_insert_rowid( vtab->db );
-    sqlite3_reset( vtab->insert_seq_stmt );
 
-    info.stmt       = vtab->insert_attr_stmt;
-    info.rowid      = *rowid;
-    info.error_code = SQLITE_OK;
+    sqlite3_result_int( ctx, n_dropped );
+}
+
+/* attributes_optimize(table_name [, milliseconds]) rewrites table_name's
+ * shadow tables in key order and gathers planner statistics on them.  with
+ * milliseconds, it stops after about that long and returns 0 if there's
+ * more to do, and the next call carries on from there; it returns 1 once a
+ * pass is complete */
+static void sql_optimize( sqlite3_context *ctx, int nargs,
+    sqlite3_value **values )
+{
+    struct attribute_module *module = sqlite3_user_data( ctx );
+    struct attribute_vtab *vtab;
+    const char *table_name;
+    sqlite3_int64 deadline = 0;
+    int finished           = 0;
+    int status;
 
-    iterate_over_kv_pairs( attributes, _insert_attributes, &info );
+    table_name = sqlite3_value_text( values[0] );
 
-    if(info.error_code == SQLITE_DONE) {
-        return SQLITE_OK;
+    if(! table_name) {
+        sqlite3_result_error( ctx, "table name must not be NULL", -1 );
+        return;
     }
-    if(info.error_code != SQLITE_OK) {
-        if(info.error_code == SQLITE_CONSTRAINT) {
-            /* we're going to assume it's a duplicate attribute name */
-            vtab->vtab.zErrMsg = sqlite3_mprintf( "%s", "duplicate attributes are forbidden" );
-            return info.error_code;
+
+    if(nargs > 1) {
+        if(sqlite3_value_numeric_type( values[1] ) != SQLITE_INTEGER ||
+            sqlite3_value_int64( values[1] ) <= 0) {
+
+            sqlite3_result_error( ctx, "milliseconds must be a positive integer", -1 );
+            return;
         }
-        return ERROR( vtab, info.error_code );
+        deadline = _clock_ms() + sqlite3_value_int64( values[1] );
+    }
+
+    vtab = _find_vtab( sqlite3_context_db_handle( ctx ), module,
+        table_name );
+
+    if(! vtab) {
+        sqlite3_result_error( ctx, "no such attribute table", -1 );
+        return;
+    }
+
+    if(vtab->options.snapshot) {
+        sqlite3_result_error( ctx, "attribute table is a read-only snapshot", -1 );
+        return;
+    }
+
+    if(vtab->layout_version < LAYOUT_VERSION) {
+        sqlite3_result_error( ctx, _old_layout_error( vtab ), -1 );
+        return;
+    }
+
+    status = sqlite3_exec( vtab->db, "SAVEPOINT attributes_optimize",
+        NULL, NULL, NULL );
+
+    if(status == SQLITE_OK) {
+        status = _optimize( vtab, deadline, &finished );
+    }
+
+    if(status == SQLITE_OK) {
+        status = sqlite3_exec( vtab->db, "RELEASE attributes_optimize",
+            NULL, NULL, NULL );
+    }
+
+    if(status != SQLITE_OK) {
+        _result_maintenance_error( ctx, vtab, "attributes_optimize", status );
+        sqlite3_exec( vtab->db, "ROLLBACK TO attributes_optimize; "
+            "RELEASE attributes_optimize", NULL, NULL, NULL );
+        return;
     }
-    return info.error_code;
+
+    sqlite3_result_int( ctx, finished );
 }
 
-static int _perform_delete( struct attribute_vtab *vtab, sqlite3_int64 rowid )
+/* attributes_rebuild(table_name) rebuilds table_name's index from its
+ * attribute strings, optimizes the table, and returns the number of rows
+ * indexed */
+static void sql_rebuild( sqlite3_context *ctx, int nargs,
+    sqlite3_value **values )
 {
-    char *sql;
-    sqlite3_stmt *stmt;
+    struct attribute_module *module = sqlite3_user_data( ctx );
+    struct attribute_vtab *vtab;
+    const char *table_name;
+    sqlite3_int64 n_rows = 0;
     int status;
 
-    sql = _allocate_delete_sequence_sql( vtab->database_name,
-        vtab->table_name );
+    table_name = sqlite3_value_text( values[0] );
 
-    if(! sql) {
-        return SQLITE_NOMEM;
+    if(! table_name) {
+        sqlite3_result_error( ctx, "table name must not be NULL", -1 );
+        return;
+    }
+
+    vtab = _find_vtab( sqlite3_context_db_handle( ctx ), module,
+        table_name );
+
+    if(! vtab) {
+        sqlite3_result_error( ctx, "no such attribute table", -1 );
+        return;
+    }
+
+    if(vtab->options.snapshot) {
+        sqlite3_result_error( ctx, "attribute table is a read-only snapshot", -1 );
+        return;
+    }
+
+    if(vtab->layout_version < LAYOUT_VERSION) {
+        sqlite3_result_error( ctx, _old_layout_error( vtab ), -1 );
+        return;
+    }
+
+    status = sqlite3_exec( vtab->db, "SAVEPOINT attributes_rebuild",
+        NULL, NULL, NULL );
+
+    if(status == SQLITE_OK) {
+        status = _rebuild( vtab, &n_rows );
+    }
+
+    if(status == SQLITE_OK) {
+        status = sqlite3_exec( vtab->db, "RELEASE attributes_rebuild",
+            NULL, NULL, NULL );
+    }
+
+    if(status != SQLITE_OK) {
+        _result_maintenance_error( ctx, vtab, "attributes_rebuild", status );
+        sqlite3_exec( vtab->db, "ROLLBACK TO attributes_rebuild; "
+            "RELEASE attributes_rebuild", NULL, NULL, NULL );
+
+        /* the rollback undid whatever the rebuild did to the Bloom filters */
+        bloom_set_free( vtab->blooms );
+        vtab->blooms = NULL;
+        posting_cache_clear( vtab->cache );
+        return;
+    }
+
+    sqlite3_result_int64( ctx, n_rows );
+}
+
+/* attributes_export(table_name, filename) writes every row of table_name to
+ * a snapshot file that a read-only table can be created over (see the
+ * snapshot option), and returns the number of rows written */
+static void sql_export( sqlite3_context *ctx, int nargs,
+    sqlite3_value **values )
+{
+    struct attribute_module *module = sqlite3_user_data( ctx );
+    struct attribute_vtab *vtab;
+    struct snapshot_builder builder;
+    sqlite3_stmt *stmt = NULL;
+    const char *table_name;
+    const char *filename;
+    char *errMsg = NULL;
+    int status   = SQLITE_OK;
+
+    table_name = sqlite3_value_text( values[0] );
+    filename   = sqlite3_value_text( values[1] );
+
+    if(! table_name || ! filename) {
+        sqlite3_result_error( ctx, "table name and file name must not be NULL", -1 );
+        return;
     }
 
-    status = sqlite3_prepare_v2( vtab->db, sql, -1, &stmt, NULL );
-
-    sqlite3_free( sql );
+    vtab = _find_vtab( sqlite3_context_db_handle( ctx ), module,
+        table_name );
 
-    if(status != SQLITE_OK) {
-        return ERROR( vtab, status );
+    if(! vtab) {
+        sqlite3_result_error( ctx, "no such attribute table", -1 );
+        return;
     }
 
-    status = sqlite3_bind_int64( stmt, DELETE_SEQ_ARG_ROWID, rowid );
-
-    if(status != SQLITE_OK) {
-        return ERROR( vtab, status );
+    if(vtab->snapshot_error) {
+        sqlite3_result_error( ctx, vtab->snapshot_error, -1 );
+        return;
     }
 
-    status = sqlite3_step( stmt );
+    memset( &builder, 0, sizeof(struct snapshot_builder) );
 
-    sqlite3_finalize( stmt );
+    if(vtab->snapshot) {
+        const struct snapshot *snapshot = vtab->snapshot;
+        uint64_t i;
 
-    if(status != SQLITE_DONE) {
-        return ERROR( vtab, status );
+        for(i = 0; status == SQLITE_OK && i < snapshot->header->n_rows; i++) {
+            status = snapshot_builder_add( &builder, snapshot->rows[i].id,
+                snapshot->strings + snapshot->rows[i].attributes,
+                snapshot->rows[i].attributes_len );
+        }
+    } else {
+        status = _prepare_allocated_statement( vtab,
+            _allocate_select_export_sql( vtab->database_name, vtab->table_name ),
+            &stmt );
+
+        while(status == SQLITE_OK && (status = sqlite3_step( stmt )) == SQLITE_ROW) {
+            status = snapshot_builder_add( &builder,
+                sqlite3_column_int64( stmt, 0 ),
+                (const char *) sqlite3_column_text( stmt, 1 ),
+                sqlite3_column_bytes( stmt, 1 ) );
+        }
+
+        if(status == SQLITE_DONE) {
+            status = SQLITE_OK;
+        } else if(status != SQLITE_NOMEM && status != SQLITE_TOOBIG) {
+            errMsg = sqlite3_mprintf( "%s", sqlite3_errmsg( vtab->db ) );
+        }
+        sqlite3_finalize( stmt );
     }
 
-    sql = _allocate_delete_attribute_sql( vtab->database_name,
-        vtab->table_name );
+    if(status == SQLITE_OK) {
+        status = snapshot_builder_write( &builder, filename, &errMsg );
+    }
 
-    if(! sql) {
-        return SQLITE_NOMEM;
+    if(status == SQLITE_OK) {
+        sqlite3_result_int64( ctx, builder.n_rows );
+    } else if(status == SQLITE_NOMEM) {
+        sqlite3_result_error_nomem( ctx );
+    } else if(status == SQLITE_TOOBIG) {
+        sqlite3_result_error_toobig( ctx );
+    } else {
+        sqlite3_result_error( ctx, errMsg ? errMsg : sqlite3_errstr( status ), -1 );
+        sqlite3_result_error_code( ctx, status );
     }
 
-    status = sqlite3_prepare_v2( vtab->db, sql, -1, &stmt, NULL );
+    sqlite3_free( errMsg );
+    snapshot_builder_free( &builder );
+}
 
-    sqlite3_free( sql );
+#define EXPLAIN_DETAIL_COL 3
 
-    if(status != SQLITE_OK) {
-        return ERROR( vtab, status );
-    }
+/* attributes_explain(table_name) describes the last statement that a cursor
+ * on table_name ran: its plan from attributes_best_index, the SQL it ran
+ * against the shadow tables and that SQL's query plan, and the counters
+ * from sqlite3_stmt_status.  returns NULL if no cursor has finished yet */
+static void sql_explain( sqlite3_context *ctx, int nargs,
+    sqlite3_value **values )
+{
+    struct attribute_module *module = sqlite3_user_data( ctx );
+    struct attribute_vtab *vtab;
+    struct statement_report *report;
+    const char *table_name;
+    sqlite3_stmt *stmt;
+    char *sql;
+    char *result;
 
-    status = sqlite3_bind_int64( stmt, DELETE_ATTR_ARG_ROWID, rowid );
+    table_name = sqlite3_value_text( values[0] );
 
-    if(status != SQLITE_OK) {
-        return ERROR( vtab, status );
+    if(! table_name) {
+        sqlite3_result_error( ctx, "table name must not be NULL", -1 );
+        return;
     }
 
-    status = sqlite3_step( stmt );
-
-    sqlite3_finalize( stmt );
+    vtab = _find_vtab( sqlite3_context_db_handle( ctx ), module,
+        table_name );
 
-    if(status != SQLITE_DONE) {
-        return ERROR( vtab, status );
+    if(! vtab) {
+        sqlite3_result_error( ctx, "no such attribute table", -1 );
+        return;
     }
 
-    return SQLITE_OK;
-}
+    report = &(vtab->last_statement);
 
-static int attributes_update( sqlite3_vtab *_vtab, int argc, sqlite3_value **argv, sqlite_int64 *rowid )
-{
-    struct attribute_vtab *vtab = (struct attribute_vtab *) _vtab;
+    if(! report->stmt) {
+        sqlite3_result_null( ctx );
+        return;
+    }
 
-    if(argc == 1) { /* DELETE */
-        return _perform_delete( vtab, sqlite3_value_int64( argv[0] ) );
-    } else if(sqlite3_value_type(argv[0]) == SQLITE_NULL) { /* INSERT */
-        int type_rowid;
-        int type_id;
+    result = sqlite3_mprintf( "plan: %s\nsource: %s\nsql: %s\nquery plan:",
+        report->plan ? report->plan : "",
+        report->source,
+        sqlite3_sql( report->stmt ) );
 
-        type_rowid = sqlite3_value_type(argv[UPDATE_ARG_ROWID]);
-        type_id    = sqlite3_value_type(argv[UPDATE_ARG_ID]);
+    sql = sqlite3_mprintf( "EXPLAIN QUERY PLAN %s", sqlite3_sql( report->stmt ) );
 
-        if(type_rowid == SQLITE_NULL && type_id == SQLITE_NULL) {
-            *rowid = 0;
-        } else if(type_rowid != SQLITE_NULL) {
-            *rowid = sqlite3_value_int64( argv[UPDATE_ARG_ROWID] );
-            if(*rowid == 0) { /* uh-oh */
-                return SQLITE_MISMATCH;
-            }
-        } else { /* type_id != SQLITE_NULL */
-            *rowid = sqlite3_value_int64( argv[UPDATE_ARG_ID] );
-            if(*rowid == 0) { /* uh-oh */
-                return SQLITE_MISMATCH;
-            }
+    if(sql && sqlite3_prepare_v2( vtab->db, sql, -1, &stmt, NULL ) == SQLITE_OK) {
+        while(result && sqlite3_step( stmt ) == SQLITE_ROW) {
+            result = sqlite3_mprintf( "%z\n  %s", result,
+                sqlite3_column_text( stmt, EXPLAIN_DETAIL_COL ) );
         }
+        sqlite3_finalize( stmt );
+    }
+    sqlite3_free( sql );
 
-        return _perform_insert( vtab, argc, argv, rowid );
-    } else { /* UPDATE */
-        int status;
+    if(result) {
+        result = sqlite3_mprintf( "%z\nfullscan_steps: %d\nsorts: %d\n"
+            "autoindexes: %d\nvm_steps: %d", result,
+            sqlite3_stmt_status( report->stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 0 ),
+            sqlite3_stmt_status( report->stmt, SQLITE_STMTSTATUS_SORT, 0 ),
+            sqlite3_stmt_status( report->stmt, SQLITE_STMTSTATUS_AUTOINDEX, 0 ),
+            sqlite3_stmt_status( report->stmt, SQLITE_STMTSTATUS_VM_STEP, 0 ) );
+    }
 
-        *rowid = sqlite3_value_int64( argv[0] );
-        status = _perform_delete( vtab, *rowid );
-        if(status != SQLITE_OK) {
-            /* XXX rollback transaction? */
-            return ERROR( vtab, status );
-        }
-        return _perform_insert( vtab, argc, argv, rowid );
+    if(! result) {
+        sqlite3_result_error_nomem( ctx );
+        return;
     }
 
-    return SQLITE_ERROR;
+    sqlite3_result_text( ctx, result, -1, sqlite3_free );
 }
 
-static int attributes_best_index( sqlite3_vtab *_vtab, sqlite3_index_info *index_info )
-{
-    int i;
+/* attributes_stats is an eponymous table with a row for each counter of each
+ * attribute table on this connection, plus a row for each connection-wide
+ * total (with NULL schema and table_name).  deleting a row resets its counter */
+#define STATS_SCHEMA\
+    "CREATE TABLE x (schema TEXT, table_name TEXT, stat TEXT, value INTEGER)"
 
-    for(i = 0; i < index_info->nConstraint; i++) {
-        struct sqlite3_index_constraint *constraint = index_info->aConstraint + i;
+#define STATS_SCHEMA_COL     0
+#define STATS_TABLE_NAME_COL 1
+#define STATS_STAT_COL       2
+#define STATS_VALUE_COL      3
 
-        if(constraint->iColumn == SCHEMA_ATTR_COL && constraint->op == SQLITE_INDEX_CONSTRAINT_MATCH) {
-            index_info->aConstraintUsage[i].argvIndex = 1;
-            index_info->aConstraintUsage[i].omit      = 1 ;
-            index_info->idxNum                        = ATTR_NAME_INDEX;
-            index_info->estimatedCost                 = 1; /* dummy value for now */
-            break;
-        }
-    }
+struct stats_vtab {
+    sqlite3_vtab vtab;
+    struct attribute_module *module;
+};
 
-    return SQLITE_OK;
-}
+/* row is (table index * N_STATS + stat), where table index 0 is the totals
+ * and table index n is the nth table in the module's list */
+struct stats_cursor {
+    sqlite3_vtab_cursor cursor;
+    sqlite3_int64 row;
+};
 
-static int attributes_rename( sqlite3_vtab *_vtab, const char *new_name )
+static int stats_connect( sqlite3 *db, void *udp, int argc,
+    char const * const *argv, sqlite3_vtab **vtab, char **errMsg )
 {
-    struct attribute_vtab *vtab = (struct attribute_vtab *) _vtab;
-    return UNIMPLD(vtab);
-}
+    struct stats_vtab *svtab;
+    int status;
 
-static int attributes_open_cursor( sqlite3_vtab *_vtab, sqlite3_vtab_cursor **cursor )
-{
-    struct attribute_vtab *vtab = (struct attribute_vtab *) _vtab;
+    status = sqlite3_declare_vtab( db, STATS_SCHEMA );
+    if(status != SQLITE_OK) {
+        return status;
+    }
 
-    *cursor = sqlite3_malloc( sizeof(struct attribute_cursor) );
-    if(! cursor) {
+    svtab = sqlite3_malloc( sizeof(struct stats_vtab) );
+    if(! svtab) {
         return SQLITE_NOMEM;
     }
-    memset( *cursor, 0, sizeof(struct attribute_cursor) );
+    memset( svtab, 0, sizeof(struct stats_vtab) );
+    svtab->module = (struct attribute_module *) udp;
+
+    *vtab = (sqlite3_vtab *) svtab;
 
     return SQLITE_OK;
 }
 
-static int attributes_close_cursor( sqlite3_vtab_cursor *_cursor )
+static int stats_disconnect( sqlite3_vtab *vtab )
 {
-    struct attribute_cursor *c = (struct attribute_cursor *) _cursor;
-
-    sqlite3_finalize( c->stmt );
-    sqlite3_free( c );
+    sqlite3_free( vtab );
 
     return SQLITE_OK;
 }
 
-static int attributes_get_row( struct attribute_cursor *cursor )
+static int stats_best_index( sqlite3_vtab *vtab, sqlite3_index_info *index_info )
 {
-    int status;
-
-    if(cursor->eof) {
-        return SQLITE_OK;
-    }
+    index_info->estimatedCost = N_STATS;
 
-    status = sqlite3_step( cursor->stmt );
+    return SQLITE_OK;
+}
 
-    if(status == SQLITE_ROW) {
-        return SQLITE_OK;
+static int stats_open_cursor( sqlite3_vtab *vtab, sqlite3_vtab_cursor **cursor )
+{
+    *cursor = sqlite3_malloc( sizeof(struct stats_cursor) );
+    if(! *cursor) {
+        return SQLITE_NOMEM;
     }
+    memset( *cursor, 0, sizeof(struct stats_cursor) );
 
-    sqlite3_reset( cursor->stmt );
-    cursor->eof = 1;
+    return SQLITE_OK;
+}
 
-    if(status != SQLITE_DONE && status != SQLITE_OK) {
-        return ERROR( (struct attribute_vtab *) cursor->cursor.pVtab, status );
-    }
+static int stats_close_cursor( sqlite3_vtab_cursor *cursor )
+{
+    sqlite3_free( cursor );
 
     return SQLITE_OK;
 }
 
-static int attributes_filter( sqlite3_vtab_cursor *_cursor, int idx_num,
-    const char *idx_name, int argc, sqlite3_value **argv )
+/* returns the counters for row, and sets *vtab to the table they belong to
+ * (or NULL for the totals).  returns NULL if row is past the last table */
+static sqlite3_int64 *_stats_for_row( struct attribute_module *module,
+    sqlite3_int64 row, struct attribute_vtab **vtab )
 {
-    struct attribute_vtab *vtab = (struct attribute_vtab *) _cursor->pVtab;
-    struct attribute_cursor *c  = (struct attribute_cursor *) _cursor;
-    int status;
-    char *sql;
-
-    if(idx_num == ATTR_NAME_INDEX) {
-        const char *match = sqlite3_value_text( argv[0] );
+    sqlite3_int64 table_index = row / N_STATS;
+    struct attribute_vtab *v;
 
-        sql = _allocate_select_cursor_sql( vtab->database_name,
-            vtab->table_name, match);
-    } else {
-        sql = _allocate_select_cursor_sql( vtab->database_name,
-            vtab->table_name, NULL );
-    }
+    *vtab = NULL;
 
-    if(! sql) {
-        return SQLITE_NOMEM;
+    if(row < 0) {
+        return NULL;
     }
-
-    sqlite3_finalize( c->stmt );
-    status = sqlite3_prepare_v2( vtab->db, sql, -1, &(c->stmt), NULL );
-    sqlite3_free( sql );
-
-    if(status != SQLITE_OK) {
-        return ERROR( vtab, status );
+    if(table_index == 0) {
+        return module->stats;
     }
-    c->eof = 0;
-
-    if(idx_num == ATTR_NAME_INDEX) {
-        const char *match = sqlite3_value_text( argv[0] );
-
-        if(is_attribute_string(match)) {
-            const char *key;
-            const char *value;
-
-            key   = match;
-            value = strchr(match, RECORD_SEPARATOR);
-
-            status = sqlite3_bind_text( c->stmt, 1, key, value - key, SQLITE_TRANSIENT );
-
-            if(status != SQLITE_OK) {
-                return ERROR( vtab, status );
-            }
 
-            value++;
+    for(v = module->vtabs; v && --table_index; v = v->next);
 
-            status = sqlite3_bind_text( c->stmt, 2, value, -1, SQLITE_TRANSIENT );
+    *vtab = v;
 
-            if(status != SQLITE_OK) {
-                return ERROR( vtab, status );
-            }
-        } else {
-            /* XXX bind_value? */
-            status = sqlite3_bind_text( c->stmt, 1, match, -1, SQLITE_TRANSIENT );
+    return v ? v->stats : NULL;
+}
 
-            if(status != SQLITE_OK) {
-                return ERROR( vtab, status );
-            }
-        }
-    }
+static int stats_filter( sqlite3_vtab_cursor *cursor, int idx_num,
+    const char *idx_name, int argc, sqlite3_value **argv )
+{
+    ((struct stats_cursor *) cursor)->row = 0;
 
-    return attributes_get_row( c );
+    return SQLITE_OK;
 }
 
-static int attributes_next( sqlite3_vtab_cursor *_cursor )
+static int stats_next( sqlite3_vtab_cursor *cursor )
 {
-    return attributes_get_row( (struct attribute_cursor *) _cursor );
+    ((struct stats_cursor *) cursor)->row++;
+
+    return SQLITE_OK;
 }
 
-static int attributes_eof( sqlite3_vtab_cursor *_cursor )
+static int stats_eof( sqlite3_vtab_cursor *_cursor )
 {
-    struct attribute_cursor *c = (struct attribute_cursor *) _cursor;
+    struct stats_cursor *cursor = (struct stats_cursor *) _cursor;
+    struct stats_vtab *svtab    = (struct stats_vtab *) _cursor->pVtab;
+    struct attribute_vtab *vtab;
 
-    return c->eof;
+    return _stats_for_row( svtab->module, cursor->row, &vtab ) == NULL;
 }
 
-static int attributes_row_id( sqlite3_vtab_cursor *_cursor, sqlite_int64 *rowid )
+static int stats_row_id( sqlite3_vtab_cursor *cursor, sqlite_int64 *rowid )
 {
-    struct attribute_cursor *c = (struct attribute_cursor *) _cursor;
-
-    *rowid = sqlite3_column_int64( c->stmt, CURS_SEQ_COL );
+    *rowid = ((struct stats_cursor *) cursor)->row;
 
     return SQLITE_OK;
 }
 
-static int attributes_column( sqlite3_vtab_cursor *_cursor, sqlite3_context *ctx,
+static int stats_column( sqlite3_vtab_cursor *_cursor, sqlite3_context *ctx,
     int col_index )
 {
-    struct attribute_cursor *cursor = (struct attribute_cursor *) _cursor;
+    struct stats_cursor *cursor = (struct stats_cursor *) _cursor;
+    struct stats_vtab *svtab    = (struct stats_vtab *) _cursor->pVtab;
+    struct attribute_vtab *vtab;
+    sqlite3_int64 *stats;
+    int stat = cursor->row % N_STATS;
 
-    sqlite3_result_value( ctx, sqlite3_column_value( cursor->stmt, col_index ) );
+    stats = _stats_for_row( svtab->module, cursor->row, &vtab );
+    if(! stats) {
+        return SQLITE_OK;
+    }
+
+    switch(col_index) {
+        case STATS_SCHEMA_COL:
+            if(vtab) {
+                sqlite3_result_text( ctx, vtab->database_name, -1, SQLITE_TRANSIENT );
+            }
+            break;
+        case STATS_TABLE_NAME_COL:
+            if(vtab) {
+                sqlite3_result_text( ctx, vtab->table_name, -1, SQLITE_TRANSIENT );
+            }
+            break;
+        case STATS_STAT_COL:
+            sqlite3_result_text( ctx, stat_names[stat], -1, SQLITE_STATIC );
+            break;
+        case STATS_VALUE_COL:
+            sqlite3_result_int64( ctx, stats[stat] );
+            break;
+    }
 
     return SQLITE_OK;
 }
 
-static void _attribute_match_func(sqlite3_context *ctx, int nargs, sqlite3_value **values)
+static int stats_update( sqlite3_vtab *_vtab, int argc, sqlite3_value **argv,
+    sqlite_int64 *rowid )
 {
-    const char *query;
-    const char *attributes;
-    const char *rs_location;
-    const char *attr_value;
-    size_t value_len;
-
-    query      = sqlite3_value_text(values[0]);
-    attributes = sqlite3_value_text(values[1]);
-
-    if(rs_location = strchr(query, RECORD_SEPARATOR)) { /* searching for a key value pair */
-        char *key = sqlite3_malloc( rs_location - query + 1 ); /* one for the NULL */
-        memcpy( key, query, rs_location - query );
-        key[rs_location - query] = '\0';
-
-        attr_value = extract_attribute_value( attributes, key, &value_len );
-
-        sqlite3_free( key );
-
-        sqlite3_result_int( ctx, attr_value &&
-            !strncmp( rs_location + 1, attr_value, value_len ) );
-    } else { /* searching for whether or not a key is present */
-        attr_value = extract_attribute_value( attributes, query, &value_len );
+    struct stats_vtab *svtab = (struct stats_vtab *) _vtab;
+    struct attribute_vtab *vtab;
+    sqlite3_int64 row;
+    sqlite3_int64 *stats;
 
-        sqlite3_result_int( ctx, attr_value != NULL );
+    if(argc != 1) {
+        svtab->vtab.zErrMsg = sqlite3_mprintf( "%s", "attributes_stats only supports DELETE" );
+        return SQLITE_READONLY;
     }
-}
 
-static int attributes_find_function(sqlite3_vtab *_vtab, int nArg,
-    const char *zName, void (**pxFunc)(sqlite3_context *, int, sqlite3_value **),
-    void **ppArg)
-{
-    struct attribute_vtab *vtab = (struct attribute_vtab *) _vtab;
+    row   = sqlite3_value_int64( argv[0] );
+    stats = _stats_for_row( svtab->module, row, &vtab );
 
-    if(strcmp(zName, "match")) {
-        *pxFunc = NULL;
-        return 0;
+    if(stats) {
+        stats[row % N_STATS] = 0;
     }
 
-    *pxFunc = _attribute_match_func;
-    *ppArg  = NULL;
-
-    return 1;
+    return SQLITE_OK;
 }
 
+static sqlite3_module stats_module_definition = {
+    .iVersion    = 1,
+    .xConnect    = stats_connect,
+    .xDisconnect = stats_disconnect,
+    .xBestIndex  = stats_best_index,
+    .xOpen       = stats_open_cursor,
+    .xClose      = stats_close_cursor,
+    .xFilter     = stats_filter,
+    .xNext       = stats_next,
+    .xEof        = stats_eof,
+    .xRowid      = stats_row_id,
+    .xColumn     = stats_column,
+    .xUpdate     = stats_update
+};
+
 static sqlite3_module module_definition = {
     .iVersion      = MODULE_VERSION,
     .xCreate       = attributes_create,
@@ -1047,18 +8304,64 @@ static sqlite3_module module_definition = {
     .xEof          = attributes_eof,
     .xRowid        = attributes_row_id,
     .xColumn       = attributes_column,
-    .xFindFunction = attributes_find_function
+    .xBegin        = attributes_begin,
+    .xSync         = attributes_sync,
+    .xCommit       = attributes_commit,
+    .xRollback     = attributes_rollback,
+    .xFindFunction = attributes_find_function,
+    .xSavepoint    = attributes_savepoint,
+    .xRelease      = attributes_release,
+    .xRollbackTo   = attributes_rollback_to
 };
 
 int sql_attr_init( sqlite3 *db, char **error,
     const sqlite3_api_routines *api )
 {
+    struct attribute_module *module;
+
     SQLITE_EXTENSION_INIT2(api);
 
+    module = sqlite3_malloc( sizeof(struct attribute_module) );
+    if(! module) {
+        return SQLITE_NOMEM;
+    }
+    memset( module, 0, sizeof(struct attribute_module) );
+
     sqlite3_create_function( db, "get_attr", 2, SQLITE_UTF8, NULL,
         sql_get_attr, NULL, NULL );
 
-    sqlite3_create_module( db, MODULE_NAME, &module_definition, NULL );
+    sqlite3_create_function( db, "glob_attr", 2, SQLITE_UTF8, NULL,
+        sql_glob_attr, NULL, NULL );
+
+    sqlite3_create_function( db, "attributes_cache_stat", 2, SQLITE_UTF8,
+        module, sql_cache_stat, NULL, NULL );
+
+    sqlite3_create_function( db, "attributes_explain", 1, SQLITE_UTF8,
+        module, sql_explain, NULL, NULL );
+
+    /* functions that write files or change data can't be called from the
+     * triggers and views of a database file we didn't create */
+    sqlite3_create_function( db, "attributes_drop_partitions", 2,
+        SQLITE_UTF8 | SQLITE_DIRECTONLY, module, sql_drop_partitions, NULL, NULL );
+
+    sqlite3_create_function( db, "attributes_export", 2,
+        SQLITE_UTF8 | SQLITE_DIRECTONLY, module, sql_export, NULL, NULL );
+
+    sqlite3_create_function( db, "attributes_optimize", 1,
+        SQLITE_UTF8 | SQLITE_DIRECTONLY, module, sql_optimize, NULL, NULL );
+
+    sqlite3_create_function( db, "attributes_optimize", 2,
+        SQLITE_UTF8 | SQLITE_DIRECTONLY, module, sql_optimize, NULL, NULL );
+
+    sqlite3_create_function( db, "attributes_rebuild", 1,
+        SQLITE_UTF8 | SQLITE_DIRECTONLY, module, sql_rebuild, NULL, NULL );
+
+    sqlite3_create_module_v2( db, MODULE_NAME, &module_definition, module,
+        sqlite3_free );
+
+    /* the attributes module owns module, and both go away when db is closed */
+    sqlite3_create_module( db, STATS_MODULE_NAME, &stats_module_definition,
+        module );
 
     return SQLITE_OK;
 }
@@ -0,0 +1,60 @@
+#!/usr/bin/env perl
+
+use strict;
+use warnings;
+use lib 't/lib';
+use charnames ':full';
+
+use Benchmark ':hireswallclock';
+use DBI;
+use SQLite::TestUtils;
+
+# how long it takes a short-lived client to open a database, read from one
+# attribute table and disconnect, as the number of attribute tables in the
+# database grows; ideally that doesn't depend on the number of tables
+
+my $RS = "\N{INFORMATION SEPARATOR ONE}";
+
+sub create_database {
+    my ( $filename, $n_tables ) = @_;
+
+    unlink $filename;
+    my $dbh = create_dbh(filename => $filename);
+
+    $dbh->begin_work;
+    foreach my $i ( 1 .. $n_tables ) {
+        $dbh->do(qq{CREATE VIRTUAL TABLE attrs_$i USING attributes});
+
+        my $sth = $dbh->prepare(qq{INSERT INTO attrs_$i (attributes) VALUES (?)});
+        foreach my $value ( 1 .. 10 ) {
+            $sth->execute(form_attr_string(foo => $value, bar => $i));
+        }
+    }
+    $dbh->commit;
+
+    $dbh->disconnect;
+}
+
+foreach my $n_tables ( 10, 100, 1_000 ) {
+    my $filename = "connect-$n_tables.db";
+
+    create_database($filename, $n_tables);
+
+    timethis(1_000, sub {
+        my $dbh = create_dbh(filename => $filename);
+
+        $dbh->selectall_arrayref(qq{SELECT id FROM attrs_1 WHERE attributes MATCH 'foo${RS}1'});
+        $dbh->disconnect;
+    }, "Connect and read ($n_tables tables)");
+
+    timethis(1_000, sub {
+        my $dbh = create_dbh(filename => $filename);
+
+        $dbh->selectall_arrayref(q{SELECT COUNT(1) FROM attrs_1});
+        $dbh->selectall_arrayref(q{SELECT COUNT(1) FROM attrs_2});
+        $dbh->selectall_arrayref(q{SELECT COUNT(1) FROM attrs_3});
+        $dbh->disconnect;
+    }, "Connect and read three tables ($n_tables tables)");
+
+    unlink $filename;
+}
@@ -0,0 +1,132 @@
+use strict;
+use warnings;
+use lib 't/lib';
+
+use Test::More tests => 10;
+use SQLite::TestUtils;
+
+check_deps;
+
+my $RS = get_record_separator();
+
+my $dbh = create_dbh;
+
+create_attribute_table(
+    dbh     => $dbh,
+    name    => 'attributes',
+    options => 'cache_size=65536',
+);
+
+insert_rows $dbh, 'attributes', ({
+    attributes => {
+        foo => 17,
+    },
+}, {
+    attributes => {
+        foo => 18,
+        bar => 1,
+    },
+}, {
+    attributes => {
+        bar => 2,
+    },
+});
+
+CACHE_MISS_THEN_HIT: {
+    foreach ( 1 .. 2 ) {
+        check_sql(
+            dbh  => $dbh,
+            sql  => q{SELECT id FROM attributes WHERE attributes MATCH 'foo'},
+            rows => [
+                [ 1 ],
+                [ 2 ],
+            ],
+        );
+    }
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT attributes_cache_stat('attributes', 'hits'), attributes_cache_stat('attributes', 'misses')},
+        rows => [
+            [ 1, 1 ],
+        ],
+    );
+}
+
+INSERT_PATCHES_CACHE: {
+    insert_rows $dbh, 'attributes', ({
+        attributes => {
+            foo => 19,
+        },
+    });
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT id FROM attributes WHERE attributes MATCH 'foo'},
+        rows => [
+            [ 1 ],
+            [ 2 ],
+            [ 4 ],
+        ],
+    );
+}
+
+DELETE_PATCHES_CACHE: {
+    check_sql(
+        dbh  => $dbh,
+        sql  => qq{SELECT id FROM attributes WHERE attributes MATCH 'foo${RS}18'},
+        rows => [
+            [ 2 ],
+        ],
+    );
+
+    $dbh->do('DELETE FROM attributes WHERE id = 2');
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => qq{SELECT COUNT(1) FROM attributes WHERE attributes MATCH 'foo${RS}18'},
+        rows => [
+            [ 0 ],
+        ],
+    );
+}
+
+ROLLBACK_INVALIDATES_CACHE: {
+    $dbh->begin_work;
+    insert_rows $dbh, 'attributes', ({
+        attributes => {
+            foo => 20,
+        },
+    });
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT COUNT(1) FROM attributes WHERE attributes MATCH 'foo'},
+        rows => [
+            [ 3 ],
+        ],
+    );
+    $dbh->rollback;
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT COUNT(1) FROM attributes WHERE attributes MATCH 'foo'},
+        rows => [
+            [ 2 ],
+        ],
+    );
+}
+
+BAD_OPTIONS: {
+    check_sql(
+        dbh   => $dbh,
+        sql   => q{CREATE VIRTUAL TABLE bad USING attributes(cache_size=lots)},
+        error => qr/cache_size must be a non-negative integer/,
+    );
+
+    check_sql(
+        dbh   => $dbh,
+        sql   => q{CREATE VIRTUAL TABLE bad USING attributes(bogus=1)},
+        error => qr/unknown option 'bogus'/,
+    );
+}
@@ -0,0 +1,146 @@
+use strict;
+use warnings;
+use lib 't/lib';
+
+use File::Temp;
+use Test::More tests => 11;
+use SQLite::TestUtils;
+
+check_deps;
+
+my $RS = get_record_separator();
+
+my $tempfile = File::Temp->new(SUFFIX => '.db');
+my $dbh      = create_dbh(filename => $tempfile->filename);
+
+create_attribute_table(
+    dbh     => $dbh,
+    name    => 'attributes',
+    options => 'bloom_bits=1024',
+);
+
+insert_rows $dbh, 'attributes', ({
+    attributes => {
+        foo => 17,
+    },
+}, {
+    attributes => {
+        foo => 18,
+        bar => 1,
+    },
+});
+
+PRESENT_TERMS: {
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT id FROM attributes WHERE attributes MATCH 'foo'},
+        rows => [
+            [ 1 ],
+            [ 2 ],
+        ],
+    );
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => qq{SELECT id FROM attributes WHERE attributes MATCH 'foo${RS}18'},
+        rows => [
+            [ 2 ],
+        ],
+    );
+}
+
+ABSENT_TERMS: {
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT COUNT(1) FROM attributes WHERE attributes MATCH 'baz'},
+        rows => [
+            [ 0 ],
+        ],
+    );
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => qq{SELECT COUNT(1) FROM attributes WHERE attributes MATCH 'foo${RS}99'},
+        rows => [
+            [ 0 ],
+        ],
+    );
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT attributes MATCH 'baz' FROM attributes},
+        rows => [
+            [ 0 ],
+            [ 0 ],
+        ],
+    );
+}
+
+FILTERS_ARE_PERSISTED: {
+    check_sql(
+        dbh     => $dbh,
+        sql     => q{SELECT attr_name, LENGTH(filter) FROM attributes_Bloom},
+        ordered => 0,
+        rows    => [
+            [ 'bar', 128 ],
+            [ 'foo', 128 ],
+        ],
+    );
+
+    insert_rows $dbh, 'attributes', ({
+        attributes => {
+            baz => 3,
+        },
+    });
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => qq{SELECT id FROM attributes WHERE attributes MATCH 'baz${RS}3'},
+        rows => [
+            [ 3 ],
+        ],
+    );
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT COUNT(1) FROM attributes_Bloom WHERE attr_name = 'baz'},
+        rows => [
+            [ 1 ],
+        ],
+    );
+}
+
+TWO_CONNECTIONS: {
+    my $other = create_dbh(filename => $tempfile->filename);
+
+    # both connections load the filters before either writes
+    $other->selectall_arrayref(qq{SELECT id FROM attributes WHERE attributes MATCH 'foo${RS}17'});
+
+    insert_rows $dbh, 'attributes', ({
+        attributes => {
+            foo => 19,
+        },
+    });
+
+    # the other connection's filter for foo doesn't have 19 in it, and
+    # writing it back shouldn't erase the bit that was just set
+    insert_rows $other, 'attributes', ({
+        attributes => {
+            foo => 20,
+        },
+    });
+
+    foreach my $value (19, 20) {
+        my ( $count ) = $dbh->selectrow_array(qq{SELECT COUNT(1) FROM attributes WHERE attributes MATCH 'foo${RS}$value'});
+
+        is $count, 1, "foo=$value should survive writes from both connections";
+    }
+}
+
+BAD_OPTION: {
+    check_sql(
+        dbh   => $dbh,
+        sql   => q{CREATE VIRTUAL TABLE huge USING attributes(bloom_bits=34359738368)},
+        error => qr/bloom_bits must be at most 16777216/,
+    );
+}
@@ -0,0 +1,192 @@
+use strict;
+use warnings;
+use lib 't/lib';
+
+use Test::More tests => 18;
+use SQLite::TestUtils;
+
+check_deps;
+
+my $RS = get_record_separator();
+
+my $dbh = create_dbh;
+
+create_attribute_table(
+    dbh     => $dbh,
+    name    => 'attributes',
+    options => q{promote='status,score:INTEGER'},
+);
+
+check_schema $dbh, 'attributes', {
+    id         => 1,
+    attributes => 1,
+};
+
+insert_rows $dbh, 'attributes', ({
+    attributes => [
+        status => 'ok',
+        score  => 17,
+        foo    => 1,
+    ],
+}, {
+    attributes => [
+        status => 'bad',
+        score  => 9,
+    ],
+}, {
+    attributes => {
+        foo => 2,
+    },
+});
+
+PROMOTED_COLUMNS: {
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT id, status, score FROM attributes},
+        rows => [
+            [ 1, 'ok',  17 ],
+            [ 2, 'bad', 9 ],
+            [ 3, undef, undef ],
+        ],
+    );
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT id FROM attributes WHERE score > 10},
+        rows => [
+            [ 1 ],
+        ],
+    );
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT id FROM attributes WHERE status = 'bad' AND score >= 9},
+        rows => [
+            [ 2 ],
+        ],
+    );
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT id FROM attributes WHERE status IS NULL},
+        rows => [
+            [ 3 ],
+        ],
+    );
+}
+
+MATCH_ON_PROMOTED_KEYS: {
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT id FROM attributes WHERE attributes MATCH 'status'},
+        rows => [
+            [ 1 ],
+            [ 2 ],
+        ],
+    );
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => qq{SELECT id FROM attributes WHERE attributes MATCH 'status${RS}ok'},
+        rows => [
+            [ 1 ],
+        ],
+    );
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT id FROM attributes WHERE attributes MATCH 'foo' AND score = 17},
+        rows => [
+            [ 1 ],
+        ],
+    );
+}
+
+DUPLICATE_PROMOTED_KEYS: {
+    my $ok = insert_rows $dbh, 'attributes', ({
+        attributes => [
+            status => 'a',
+            status => 'b',
+        ],
+    });
+
+    ok !$ok, 'inserting duplicate promoted attributes should fail';
+    like $dbh->errstr, qr/duplicate attributes are forbidden/;
+}
+
+WRITES_TO_PROMOTED_COLUMNS: {
+    check_sql(
+        dbh   => $dbh,
+        sql   => qq{INSERT INTO attributes (id, attributes, score) VALUES (10, 'score${RS}1', 2)},
+        error => qr/attributes\.score can't be written/,
+    );
+
+    check_sql(
+        dbh   => $dbh,
+        sql   => q{UPDATE attributes SET status = 'good' WHERE id = 1},
+        error => qr/attributes\.status can't be written/,
+    );
+
+    # promoted columns may still be read while the attributes are rewritten
+    $dbh->do(qq{UPDATE attributes SET attributes = 'status${RS}fine${RS}score' || char(31) || (score + 1) WHERE score IS NOT NULL});
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT id, status, score FROM attributes ORDER BY id},
+        rows => [
+            [ 1, 'fine', 18 ],
+            [ 2, 'fine', 10 ],
+            [ 3, undef, undef ],
+        ],
+    );
+}
+
+NUMERIC_MATCH: {
+    insert_rows $dbh, 'attributes', ({
+        id         => 4,
+        attributes => [
+            score => '010',
+        ],
+    });
+
+    # MATCH compares values as text, as it does for keys that aren't promoted
+    check_sql(
+        dbh  => $dbh,
+        sql  => qq{SELECT id FROM attributes WHERE attributes MATCH 'score${RS}10' ORDER BY id},
+        rows => [
+            [ 2 ],
+        ],
+    );
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => qq{SELECT id FROM attributes WHERE attributes MATCH 'score${RS}010' ORDER BY id},
+        rows => [
+            [ 4 ],
+        ],
+    );
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT id FROM attributes WHERE score = 10 ORDER BY id},
+        rows => [
+            [ 2 ],
+            [ 4 ],
+        ],
+    );
+}
+
+RESERVED_NAMES: {
+    check_sql(
+        dbh   => $dbh,
+        sql   => q{CREATE VIRTUAL TABLE bad USING attributes(promote='rowid')},
+        error => qr/can't promote key 'rowid'/,
+    );
+
+    # column names are case-insensitive
+    check_sql(
+        dbh   => $dbh,
+        sql   => q{CREATE VIRTUAL TABLE bad USING attributes(promote='k,K')},
+        error => qr/can't promote key 'K'/,
+    );
+}
@@ -0,0 +1,169 @@
+use strict;
+use warnings;
+use lib 't/lib';
+
+use File::Temp;
+use Test::More tests => 12;
+use SQLite::TestUtils;
+
+check_deps;
+
+my $RS = get_record_separator();
+
+my $tempfile = File::Temp->new(SUFFIX => '.db');
+my $dbh      = create_dbh(filename => $tempfile->filename);
+
+create_attribute_table(
+    dbh  => $dbh,
+    name => 'attributes',
+);
+
+insert_rows $dbh, 'attributes', ({
+    attributes => [
+        foo => 1,
+        bar => 2,
+    ],
+}, {
+    attributes => [
+        foo => 1,
+        bar => 3,
+    ],
+});
+
+LAYOUT: {
+    my ( $sql ) = $dbh->selectrow_array(q{SELECT sql FROM sqlite_master WHERE name = 'attributes_Attributes'});
+
+    like $sql, qr/WITHOUT ROWID/, 'postings should be clustered by key and value';
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT value FROM attributes_Config WHERE name = 'version'},
+        rows => [
+            [ 2 ],
+        ],
+    );
+}
+
+DELETE: {
+    $dbh->do(q{DELETE FROM attributes WHERE id = 1});
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT attr_name, attr_value, seq_id FROM attributes_Attributes},
+        rows => [
+            [ 'bar', 3, 2 ],
+            [ 'foo', 1, 2 ],
+        ],
+    );
+}
+
+MIGRATION: {
+    # rebuild the shadow tables the way version 1 of the extension laid them out
+    $dbh->do(q{DROP TABLE attributes_Config});
+    $dbh->do(q{DROP TABLE attributes_Attributes});
+    $dbh->do(<<'END_SQL');
+CREATE TABLE attributes_Attributes (
+  attr_name  TEXT NOT NULL,
+  seq_id     INTEGER REFERENCES attributes_Sequence (seq_id) ON DELETE CASCADE,
+  attr_value TEXT NOT NULL
+)
+END_SQL
+    $dbh->do(q{CREATE UNIQUE INDEX attributes_attr_index ON attributes_Attributes (attr_name, seq_id)});
+    $dbh->do(q{INSERT INTO attributes_Attributes VALUES ('foo', 2, '1'), ('bar', 2, '3')});
+    $dbh->disconnect;
+
+    $dbh = create_dbh(filename => $tempfile->filename);
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => qq{SELECT id FROM attributes WHERE attributes MATCH 'bar${RS}3'},
+        rows => [
+            [ 2 ],
+        ],
+    );
+
+    my ( $sql ) = $dbh->selectrow_array(q{SELECT sql FROM sqlite_master WHERE name = 'attributes_Attributes'});
+
+    like $sql, qr/WITHOUT ROWID/, 'connecting should migrate the old layout';
+
+    my ( $index ) = $dbh->selectrow_array(q{SELECT name FROM sqlite_master WHERE name = 'attributes_attr_index'});
+
+    ok !defined($index), 'the old index should be gone';
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT attr_name, attr_value, seq_id FROM attributes_Attributes},
+        rows => [
+            [ 'bar', 3, 2 ],
+            [ 'foo', 1, 2 ],
+        ],
+    );
+
+    insert_rows $dbh, 'attributes', {
+        attributes => [
+            foo => 1,
+        ],
+    };
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => qq{SELECT id FROM attributes WHERE attributes MATCH 'foo${RS}1'},
+        rows => [
+            [ 2 ],
+            [ 3 ],
+        ],
+    );
+
+    check_sql(
+        dbh   => $dbh,
+        sql   => qq{INSERT INTO attributes (attributes) VALUES ('foo${RS}1${RS}foo${RS}2')},
+        error => qr/duplicate attributes are forbidden/,
+    );
+}
+
+UPGRADE_FAILURE: {
+    create_attribute_table(
+        dbh  => $dbh,
+        name => 'locked',
+    );
+    $dbh->do(q{DROP TABLE locked_Config});
+    $dbh->do(q{DROP TABLE locked_Attributes});
+    $dbh->do(q{CREATE TABLE locked_Attributes (attr_name TEXT NOT NULL, seq_id INTEGER, attr_value TEXT NOT NULL)});
+    $dbh->disconnect;
+
+    # another connection holding the write lock keeps the upgrade from running
+    my $writer = create_dbh(filename => $tempfile->filename, no_load => 1);
+    $writer->do(q{BEGIN IMMEDIATE});
+
+    $dbh = create_dbh(filename => $tempfile->filename);
+    $dbh->do(q{PRAGMA busy_timeout = 0});
+
+    # ...but the table can still be read with the old layout
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT id FROM locked},
+        rows => [],
+    );
+
+    check_sql(
+        dbh   => $dbh,
+        sql   => q{SELECT attributes_optimize('locked')},
+        error => qr/layout hasn't been upgraded/,
+    );
+
+    # the upgrade is tried again the next time the table is connected
+    $writer->do(q{ROLLBACK});
+    $writer->disconnect;
+    $dbh->disconnect;
+
+    $dbh = create_dbh(filename => $tempfile->filename);
+    $dbh->selectall_arrayref(q{SELECT id FROM locked});
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT value FROM locked_Config WHERE name = 'version'},
+        rows => [
+            [ 2 ],
+        ],
+    );
+}
@@ -0,0 +1,103 @@
+use strict;
+use warnings;
+use lib 't/lib';
+
+use Test::More tests => 7;
+use SQLite::TestUtils;
+
+check_deps;
+
+my $RS = get_record_separator();
+
+my $dbh = create_dbh;
+
+create_attribute_table(
+    dbh     => $dbh,
+    name    => 'attributes',
+    options => 'intern_values=1',
+);
+
+insert_rows $dbh, 'attributes', ({
+    attributes => [
+        color => 'red',
+        size  => 'small',
+    ],
+}, {
+    attributes => [
+        color => 'red',
+        size  => 'large',
+    ],
+}, {
+    attributes => [
+        color => 'blue',
+        shape => 'small',
+    ],
+});
+
+DICTIONARY: {
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT attr_value FROM attributes_Values ORDER BY value_id},
+        rows => [
+            [ 'red' ],
+            [ 'small' ],
+            [ 'large' ],
+            [ 'blue' ],
+        ],
+    );
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT COUNT(1) FROM attributes_Attributes WHERE typeof(attr_value) <> 'integer'},
+        rows => [
+            [ 0 ],
+        ],
+    );
+}
+
+MATCH: {
+    check_sql(
+        dbh  => $dbh,
+        sql  => qq{SELECT id FROM attributes WHERE attributes MATCH 'color${RS}red'},
+        rows => [
+            [ 1 ],
+            [ 2 ],
+        ],
+    );
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => qq{SELECT id FROM attributes WHERE attributes MATCH 'shape${RS}small'},
+        rows => [
+            [ 3 ],
+        ],
+    );
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => qq{SELECT COUNT(1) FROM attributes WHERE attributes MATCH 'color${RS}green'},
+        rows => [
+            [ 0 ],
+        ],
+    );
+}
+
+DELETE: {
+    $dbh->do(q{DELETE FROM attributes WHERE id = 1});
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => qq{SELECT id FROM attributes WHERE attributes MATCH 'color${RS}red'},
+        rows => [
+            [ 2 ],
+        ],
+    );
+}
+
+BAD_OPTION: {
+    check_sql(
+        dbh   => $dbh,
+        sql   => q{CREATE VIRTUAL TABLE bad USING attributes(intern_values=yes)},
+        error => qr/intern_values must be 0 or 1/,
+    );
+}
@@ -0,0 +1,113 @@
+use strict;
+use warnings;
+use lib 't/lib';
+
+use Test::More tests => 13;
+use SQLite::TestUtils;
+
+check_deps;
+
+my $dbh = create_dbh;
+
+create_attribute_table(
+    dbh  => $dbh,
+    name => 'attributes',
+);
+
+insert_rows $dbh, 'attributes', ({
+    attributes => [
+        foo => 1,
+        bar => 2,
+    ],
+}, {
+    attributes => [
+        foo => 0,
+        bar => 3,
+    ],
+}, {
+    attributes => [
+        foo => 'abc',
+    ],
+}, {
+    attributes => [
+        bar => 5,
+    ],
+});
+
+QUERY_PLAN: {
+    my $plan = join("\n", map { $_->[-1] } @{ $dbh->selectall_arrayref(q{EXPLAIN QUERY PLAN SELECT id FROM attributes WHERE get_attr(attributes, 'foo')}) });
+
+    like $plan, qr/VIRTUAL TABLE INDEX 1:/, 'get_attr in a WHERE clause should use the index';
+}
+
+RESULTS: {
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT id FROM attributes WHERE get_attr(attributes, 'foo')},
+        rows => [
+            [ 1 ],
+        ],
+    );
+
+    check_sql(
+        dbh     => $dbh,
+        sql     => q{SELECT id FROM attributes WHERE get_attr(attributes, 'bar')},
+        ordered => 0,
+        rows    => [
+            [ 1 ],
+            [ 2 ],
+            [ 4 ],
+        ],
+    );
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT COUNT(1) FROM attributes WHERE get_attr(attributes, 'baz')},
+        rows => [
+            [ 0 ],
+        ],
+    );
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT id, get_attr(attributes, 'foo') FROM attributes},
+        rows => [
+            [ 1, 1 ],
+            [ 2, 0 ],
+            [ 3, 'abc' ],
+            [ 4, undef ],
+        ],
+    );
+}
+
+# sort_key/sort_value is the indexed form of comparing get_attr's result,
+# and has to agree with the unindexed comparison row for row
+COMPARISONS: {
+    my @comparisons = (
+        q{= '1'},
+        q{= 1},
+        q{> '0'},
+        q{< 'b'},
+        q{IN ('0', 'abc')},
+        q{IS NOT NULL},
+    );
+
+    foreach my $op (@comparisons) {
+        my $unindexed = $dbh->selectcol_arrayref(qq{SELECT id FROM attributes WHERE get_attr(attributes, 'foo') $op ORDER BY id});
+        my $indexed   = $dbh->selectcol_arrayref(qq{SELECT id FROM attributes WHERE sort_key = 'foo' AND sort_value $op ORDER BY id});
+
+        is_deeply $indexed, $unindexed, "sort_value $op should agree with get_attr";
+    }
+
+    # a bare get_attr is true or false the way SQLite decides, index or not
+    my $truthy   = $dbh->selectcol_arrayref(q{SELECT id FROM attributes WHERE get_attr(attributes, 'foo') ORDER BY id});
+    my $unscoped = $dbh->selectcol_arrayref(q{SELECT id FROM attributes WHERE +get_attr(attributes, 'foo') ORDER BY id});
+
+    is_deeply $truthy, $unscoped, 'the indexed truthy form should agree with the unindexed one';
+
+    $dbh->selectall_arrayref(q{SELECT id FROM attributes WHERE sort_key = 'foo' AND sort_value = '0'});
+
+    my ( $explain ) = $dbh->selectrow_array(q{SELECT attributes_explain('attributes')});
+
+    like $explain, qr/attr_name = \? AND a\.attr_value = \?/, 'sort_value comparisons should seek on the index';
+}
@@ -0,0 +1,71 @@
+use strict;
+use warnings;
+use lib 't/lib';
+
+use Test::More tests => 8;
+use SQLite::TestUtils;
+
+check_deps;
+
+my $dbh = create_dbh;
+
+create_attribute_table(
+    dbh  => $dbh,
+    name => 'attributes',
+);
+
+insert_rows $dbh, 'attributes', ({
+    attributes => [
+        foo => 1,
+        bar => 2,
+    ],
+}, {
+    attributes => [
+        foo => 2,
+    ],
+});
+
+$dbh->do(q{SELECT id FROM attributes WHERE attributes MATCH 'foo'});
+$dbh->do(q{DELETE FROM attributes WHERE id = 2});
+
+sub stat_value {
+    my ( $table_name, $stat ) = @_;
+
+    my ( $value ) = $dbh->selectrow_array(q{SELECT value FROM attributes_stats WHERE table_name IS ? AND stat = ?}, undef, $table_name, $stat);
+
+    return $value;
+}
+
+PER_TABLE: {
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT stat, value FROM attributes_stats WHERE table_name = 'attributes' AND stat IN ('rows_inserted', 'rows_deleted', 'postings_written', 'postings_deleted')},
+        rows => [
+            [ 'rows_inserted',    2 ],
+            [ 'rows_deleted',     1 ],
+            [ 'postings_written', 3 ],
+            [ 'postings_deleted', 1 ],
+        ],
+    );
+
+    ok stat_value('attributes', 'filters') >= 1, 'filters should be counted';
+    ok stat_value('attributes', 'statements_prepared') >= 1, 'prepared statements should be counted';
+    is stat_value('attributes', 'filter_time'), 0, 'timing is off unless built with ATTRIBUTES_TIMING';
+}
+
+TOTALS: {
+    is stat_value(undef, 'rows_inserted'), 2, 'totals should cover every table';
+}
+
+RESET: {
+    $dbh->do(q{DELETE FROM attributes_stats WHERE table_name = 'attributes' AND stat = 'rows_inserted'});
+
+    is stat_value('attributes', 'rows_inserted'), 0, 'deleting a row should reset its counter';
+    is stat_value(undef, 'rows_inserted'), 2, 'resetting a table counter should leave the totals alone';
+
+    check_sql(
+        dbh   => $dbh,
+        sql   => q{UPDATE attributes_stats SET value = 1},
+        error => qr/attributes_stats only supports DELETE/,
+    );
+}
@@ -0,0 +1,77 @@
+use strict;
+use warnings;
+use lib 't/lib';
+
+use Test::More tests => 10;
+use SQLite::TestUtils;
+
+check_deps;
+
+my $RS = get_record_separator();
+
+my $dbh = create_dbh;
+
+create_attribute_table(
+    dbh     => $dbh,
+    name    => 'attributes',
+    options => q{promote='status'},
+);
+
+insert_rows $dbh, 'attributes', ({
+    attributes => [
+        foo    => 1,
+        status => 'ok',
+    ],
+}, {
+    attributes => [
+        foo => 2,
+    ],
+});
+
+sub query_plan {
+    my ( $sql ) = @_;
+
+    return join("\n", map { $_->[-1] } @{ $dbh->selectall_arrayref("EXPLAIN QUERY PLAN $sql") });
+}
+
+IDX_STR: {
+    like query_plan(q{SELECT id FROM attributes}), qr/INDEX 128:SCAN \(~\d+ rows\)/;
+
+    like query_plan(q{SELECT id FROM attributes WHERE attributes MATCH 'foo'}),
+        qr/INDEX 1:MATCH INDEX: attributes MATCH \? \(~\d+ rows\)/;
+
+    like query_plan(q{SELECT id FROM attributes WHERE attributes MATCH 'foo' AND status = 'ok'}),
+        qr/INDEX 3:MATCH INDEX: attributes MATCH \? AND "status" = \? \(~\d+ rows\) \{2:2\}/;
+
+    like query_plan(q{SELECT id FROM attributes WHERE status IS NULL}),
+        qr/INDEX 130:PROMOTED INDEX: "status" IS NULL/;
+
+    # row estimates start from the span of the table's ids
+    like query_plan(q{SELECT attributes FROM attributes}), qr/SCAN \(~2 rows\)/;
+
+    like query_plan(q{SELECT attributes FROM attributes WHERE id = 2}), qr/ID INDEX: "id" = \? \(~1 rows\)/;
+}
+
+EXPLAIN: {
+    my ( $explain ) = $dbh->selectrow_array(q{SELECT attributes_explain('attributes')});
+
+    ok !defined($explain), 'attributes_explain should return NULL before any cursor has run';
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => qq{SELECT id FROM attributes WHERE attributes MATCH 'foo${RS}2'},
+        rows => [
+            [ 2 ],
+        ],
+    );
+
+    ( $explain ) = $dbh->selectrow_array(q{SELECT attributes_explain('attributes')});
+
+    like $explain, qr/^plan: MATCH INDEX: attributes MATCH \?.*\nsql: SELECT .*\nquery plan:\n  SEARCH a USING PRIMARY KEY.*\nfullscan_steps: 0\n/s;
+
+    check_sql(
+        dbh   => $dbh,
+        sql   => q{SELECT attributes_explain('no_such_table')},
+        error => qr/no such attribute table/,
+    );
+}
@@ -0,0 +1,128 @@
+use strict;
+use warnings;
+use lib 't/lib';
+
+use Test::More tests => 10;
+use SQLite::TestUtils;
+
+check_deps;
+
+my $RS = get_record_separator();
+
+my $dbh = create_dbh;
+
+create_attribute_table(
+    dbh  => $dbh,
+    name => 'attributes',
+);
+
+create_attribute_table(
+    dbh     => $dbh,
+    name    => 'merged',
+    options => 'merge=1',
+);
+
+insert_rows $dbh, 'attributes', {
+    attributes => [
+        color => 'red',
+        size  => 'small',
+    ],
+};
+
+CONFLICTS: {
+    check_sql(
+        dbh   => $dbh,
+        sql   => qq{INSERT INTO attributes (id, attributes) VALUES (1, 'color${RS}blue')},
+        error => qr/UNIQUE constraint failed/,
+    );
+
+    $dbh->do(qq{INSERT OR IGNORE INTO attributes (id, attributes) VALUES (1, 'color${RS}blue'), (2, 'color${RS}blue')});
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT id, attributes FROM attributes},
+        rows => [
+            [ 1, "color${RS}red${RS}size${RS}small" ],
+            [ 2, "color${RS}blue" ],
+        ],
+    );
+}
+
+REPLACE: {
+    $dbh->do(q{DELETE FROM attributes_stats});
+    $dbh->do(qq{INSERT OR REPLACE INTO attributes (id, attributes) VALUES (1, 'color${RS}blue${RS}size${RS}small')});
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => qq{SELECT id FROM attributes WHERE attributes MATCH 'color${RS}blue'},
+        rows => [
+            [ 1 ],
+            [ 2 ],
+        ],
+    );
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => qq{SELECT id FROM attributes WHERE attributes MATCH 'color${RS}red'},
+        rows => [],
+    );
+
+    # only the color posting changed, so size's is left alone
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT stat, value FROM attributes_stats WHERE table_name = 'attributes' AND stat IN ('rows_inserted', 'rows_updated', 'postings_written', 'postings_deleted')},
+        rows => [
+            [ 'rows_inserted',    0 ],
+            [ 'rows_updated',     1 ],
+            [ 'postings_written', 1 ],
+            [ 'postings_deleted', 1 ],
+        ],
+    );
+}
+
+MERGE: {
+    $dbh->do(qq{INSERT INTO merged (id, attributes) VALUES (1, 'color${RS}red${RS}size${RS}small${RS}color${RS}green')});
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT attributes FROM merged},
+        rows => [
+            [ "color${RS}green${RS}size${RS}small" ],
+        ],
+    );
+
+    $dbh->do(qq{INSERT OR REPLACE INTO merged (id, attributes) VALUES (1, 'shape${RS}round${RS}size${RS}large')});
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT attributes FROM merged},
+        rows => [
+            [ "color${RS}green${RS}size${RS}large${RS}shape${RS}round" ],
+        ],
+    );
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => qq{SELECT id FROM merged WHERE attributes MATCH 'size${RS}small'},
+        rows => [],
+    );
+
+    # an UPDATE sets the attributes outright
+    $dbh->do(qq{UPDATE merged SET attributes = 'shape${RS}square' WHERE id = 1});
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT attributes FROM merged},
+        rows => [
+            [ "shape${RS}square" ],
+        ],
+    );
+}
+
+BAD_OPTION: {
+    check_sql(
+        dbh   => $dbh,
+        sql   => q{CREATE VIRTUAL TABLE bad USING attributes(merge=yes)},
+        error => qr/merge must be 0 or 1/,
+    );
+}
@@ -0,0 +1,181 @@
+use strict;
+use warnings;
+use lib 't/lib';
+
+use File::Temp;
+use Test::More tests => 15;
+use SQLite::TestUtils;
+
+check_deps;
+
+my $RS = get_record_separator();
+
+my $tempfile = File::Temp->new(SUFFIX => '.db');
+my $dbh      = create_dbh(filename => $tempfile->filename);
+
+create_attribute_table(
+    dbh     => $dbh,
+    name    => 'attributes',
+    options => 'partition_size=10',
+);
+
+insert_rows $dbh, 'attributes', ({
+    id         => 1,
+    attributes => [
+        color => 'red',
+    ],
+}, {
+    id         => 5,
+    attributes => [
+        color => 'blue',
+    ],
+}, {
+    id         => 12,
+    attributes => [
+        color => 'red',
+    ],
+}, {
+    id         => 25,
+    attributes => [
+        color => 'red',
+    ],
+});
+
+insert_rows $dbh, 'attributes', {
+    attributes => [
+        color => 'green',
+    ],
+};
+
+LAYOUT: {
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT partition_id FROM attributes_Partitions},
+        rows => [
+            [ 0 ],
+            [ 1 ],
+            [ 2 ],
+        ],
+    );
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT seq_id FROM attributes_p2_Sequence},
+        rows => [
+            [ 25 ],
+            [ 26 ],
+        ],
+    );
+}
+
+MATCH: {
+    check_sql(
+        dbh  => $dbh,
+        sql  => qq{SELECT id FROM attributes WHERE attributes MATCH 'color${RS}red'},
+        rows => [
+            [ 1 ],
+            [ 12 ],
+            [ 25 ],
+        ],
+    );
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT id FROM attributes WHERE id BETWEEN 5 AND 20},
+        rows => [
+            [ 5 ],
+            [ 12 ],
+        ],
+    );
+}
+
+UPDATE: {
+    $dbh->do(qq{UPDATE attributes SET attributes = 'color${RS}blue' WHERE id = 12});
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => qq{SELECT id FROM attributes WHERE attributes MATCH 'color${RS}blue'},
+        rows => [
+            [ 5 ],
+            [ 12 ],
+        ],
+    );
+}
+
+DROP_PARTITIONS: {
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT attributes_drop_partitions('attributes', 20)},
+        rows => [
+            [ 2 ],
+        ],
+    );
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => qq{SELECT id FROM attributes WHERE attributes MATCH 'color${RS}red'},
+        rows => [
+            [ 25 ],
+        ],
+    );
+
+    my ( $count ) = $dbh->selectrow_array(q{SELECT COUNT(1) FROM sqlite_master WHERE name LIKE 'attributes_p0_%'});
+
+    is $count, 0, 'dropping a partition should drop its tables';
+}
+
+FRESH_CONNECTION: {
+    my $other = create_dbh(filename => $tempfile->filename);
+
+    # nothing on this connection has touched the table yet
+    check_sql(
+        dbh  => $other,
+        sql  => q{SELECT attributes_drop_partitions('main.attributes', 20)},
+        rows => [
+            [ 0 ],
+        ],
+    );
+
+    check_sql(
+        dbh   => $other,
+        sql   => q{SELECT attributes_drop_partitions('missing', 20)},
+        error => qr/no such attribute table/,
+    );
+}
+
+OWN_STATEMENT: {
+    check_sql(
+        dbh   => $dbh,
+        sql   => q{SELECT attributes_drop_partitions(name, 1000) FROM sqlite_master WHERE name = 'attributes'},
+        error => qr/attributes_drop_partitions must be called in a SELECT of its own/,
+    );
+}
+
+DIRECT_ONLY: {
+    $dbh->do(q{CREATE VIEW drop_view AS SELECT attributes_drop_partitions('attributes', 30)});
+
+    {
+        local $dbh->{'RaiseError'} = 0;
+
+        ok ! $dbh->prepare(q{SELECT * FROM drop_view}), 'views should not be able to call attributes_drop_partitions';
+    }
+    like $dbh->errstr, qr/unsafe use of attributes_drop_partitions/;
+
+    $dbh->do(q{DROP VIEW drop_view});
+}
+
+DROP_TABLE: {
+    $dbh->do(q{DROP TABLE attributes});
+
+    my ( $count ) = $dbh->selectrow_array(q{SELECT COUNT(1) FROM sqlite_master WHERE name LIKE 'attributes_%'});
+
+    is $count, 0, 'dropping the table should drop every partition';
+}
+
+BAD_OPTION: {
+    check_sql(
+        dbh   => $dbh,
+        sql   => q{CREATE VIRTUAL TABLE bad USING attributes(partition_size=-1)},
+        error => qr/partition_size must be a non-negative integer/,
+    );
+}
@@ -0,0 +1,194 @@
+use strict;
+use warnings;
+use lib 't/lib';
+
+use File::Temp;
+use Test::More tests => 18;
+use SQLite::TestUtils;
+
+check_deps;
+
+my $RS = get_record_separator();
+
+my $dbh      = create_dbh;
+my $tempdir  = File::Temp->newdir;
+my $snapshot = "$tempdir/attributes.snapshot";
+
+create_attribute_table(
+    dbh  => $dbh,
+    name => 'attributes',
+);
+
+insert_rows $dbh, 'attributes', ({
+    id         => 1,
+    attributes => [
+        color => 'red',
+        size  => 'small',
+    ],
+}, {
+    id         => 3,
+    attributes => [
+        color => 'blue',
+    ],
+}, {
+    id         => 7,
+    attributes => [
+        color => 'red',
+        shape => 'round',
+    ],
+}, {
+    id         => 10,
+    attributes => [
+        size => 'large',
+    ],
+});
+
+EXPORT: {
+    check_sql(
+        dbh  => $dbh,
+        sql  => qq{SELECT attributes_export('attributes', '$snapshot')},
+        rows => [
+            [ 4 ],
+        ],
+    );
+
+    $dbh->do(qq{CREATE VIRTUAL TABLE snapshot USING attributes(snapshot='$snapshot')});
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT id, attributes FROM snapshot EXCEPT SELECT id, attributes FROM attributes},
+        rows => [],
+    );
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT COUNT(1) FROM snapshot},
+        rows => [
+            [ 4 ],
+        ],
+    );
+}
+
+MATCH: {
+    check_sql(
+        dbh  => $dbh,
+        sql  => qq{SELECT id FROM snapshot WHERE attributes MATCH 'color${RS}red'},
+        rows => [
+            [ 1 ],
+            [ 7 ],
+        ],
+    );
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT id, get_attr(attributes, 'size') FROM snapshot WHERE attributes MATCH 'size'},
+        rows => [
+            [ 1, 'small' ],
+            [ 10, 'large' ],
+        ],
+    );
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => qq{SELECT COUNT(1) FROM snapshot WHERE attributes MATCH 'color${RS}green'},
+        rows => [
+            [ 0 ],
+        ],
+    );
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT id FROM snapshot WHERE attributes MATCH 'color' AND id > 1 AND id <= 7},
+        rows => [
+            [ 3 ],
+            [ 7 ],
+        ],
+    );
+}
+
+READ_ONLY: {
+    check_sql(
+        dbh   => $dbh,
+        sql   => qq{INSERT INTO snapshot (attributes) VALUES ('color${RS}green')},
+        error => qr/read-only snapshot/,
+    );
+}
+
+CORRUPTION: {
+    open my $fh, '+<', $snapshot or die $!;
+    binmode $fh;
+    seek $fh, 4096, 0;
+    print {$fh} "\xff" x 8;
+    close $fh;
+
+    check_sql(
+        dbh   => $dbh,
+        sql   => qq{CREATE VIRTUAL TABLE corrupt USING attributes(snapshot='$snapshot')},
+        error => qr/checksum mismatch/,
+    );
+
+    check_sql(
+        dbh   => $dbh,
+        sql   => qq{CREATE VIRTUAL TABLE missing USING attributes(snapshot='$tempdir/missing')},
+        error => qr/unable to open snapshot/,
+    );
+}
+
+BAD_AFTER_CREATE: {
+    my $copy     = "$tempdir/copy.snapshot";
+    my $filename = "$tempdir/copy.db";
+
+    $dbh->do(qq{SELECT attributes_export('attributes', '$copy')});
+
+    my $creator = create_dbh(filename => $filename);
+    $creator->do(qq{CREATE VIRTUAL TABLE copied USING attributes(snapshot='$copy')});
+    $creator->disconnect;
+
+    unlink $copy or die $!;
+    open my $fh, '>', $copy or die $!;
+    print {$fh} "x" x 8192;
+    close $fh;
+
+    my $reader = create_dbh(filename => $filename);
+
+    {
+        local $reader->{'RaiseError'} = 0;
+
+        ok ! $reader->prepare(q{SELECT id FROM copied}), 'querying a table whose snapshot has gone bad should fail';
+    }
+    like $reader->errstr, qr/not an attribute snapshot/;
+
+    ok eval { $reader->do(q{DROP TABLE copied}); 1 }, 'a table whose snapshot has gone bad should still be droppable';
+    $reader->disconnect;
+}
+
+WRITE: {
+    my @temp_files = glob "$tempdir/*.tmp";
+
+    is scalar(@temp_files), 0, 'exporting should leave no temporary files behind';
+}
+
+BAD_OPTION: {
+    check_sql(
+        dbh   => $dbh,
+        sql   => qq{CREATE VIRTUAL TABLE bad USING attributes(snapshot='$snapshot', cache_size=1024)},
+        error => qr/snapshot can't be combined with other options/,
+    );
+}
+
+DIRECT_ONLY: {
+    $dbh->do(qq{CREATE VIEW export_view AS SELECT attributes_export('attributes', '$tempdir/view.snapshot')});
+
+    {
+        local $dbh->{'RaiseError'} = 0;
+
+        ok ! $dbh->prepare(q{SELECT * FROM export_view}), 'views should not be able to call attributes_export';
+    }
+    like $dbh->errstr, qr/unsafe use of attributes_export/;
+}
+
+DROP_TABLE: {
+    $dbh->do(q{DROP TABLE snapshot});
+
+    ok -e $snapshot, 'dropping a snapshot table should leave the snapshot file alone';
+}
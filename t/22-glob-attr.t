@@ -0,0 +1,129 @@
+use strict;
+use warnings;
+use lib 't/lib';
+
+use Test::More tests => 10;
+use SQLite::TestUtils;
+
+check_deps;
+
+my $RS = get_record_separator();
+
+my $dbh = create_dbh;
+
+create_attribute_table(
+    dbh  => $dbh,
+    name => 'attributes',
+);
+
+create_attribute_table(
+    dbh     => $dbh,
+    name    => 'promoted',
+    options => q{promote='http.response.status'},
+);
+
+my @rows = ({
+    attributes => [
+        'http.request.method'  => 'GET',
+        'http.response.status' => '200',
+        'net.ip'               => '10.0.0.1',
+    ],
+}, {
+    attributes => [
+        'http.request.method'  => 'POST',
+        'http.response.status' => '404',
+        'net.ip'               => '10.1.0.1',
+    ],
+}, {
+    attributes => [
+        'net.ip' => '10.0.3.7',
+    ],
+});
+
+insert_rows $dbh, 'attributes', @rows;
+insert_rows $dbh, 'promoted', @rows;
+
+KEYS: {
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT id FROM attributes WHERE glob_attr(attributes, 'http.response.*')},
+        rows => [
+            [ 1 ],
+            [ 2 ],
+        ],
+    );
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT id FROM attributes WHERE glob_attr(attributes, '*.ip')},
+        rows => [
+            [ 1 ],
+            [ 2 ],
+            [ 3 ],
+        ],
+    );
+}
+
+VALUES: {
+    check_sql(
+        dbh  => $dbh,
+        sql  => qq{SELECT id FROM attributes WHERE glob_attr(attributes, 'net.ip${RS}10.0.*')},
+        rows => [
+            [ 1 ],
+            [ 3 ],
+        ],
+    );
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => qq{SELECT id FROM attributes WHERE glob_attr(attributes, 'http.*${RS}[24]0?') AND id > 1},
+        rows => [
+            [ 2 ],
+        ],
+    );
+
+    # the key and value have to match within the same pair
+    check_sql(
+        dbh  => $dbh,
+        sql  => qq{SELECT id FROM attributes WHERE glob_attr(attributes, 'net.ip${RS}GET')},
+        rows => [],
+    );
+}
+
+PLAN: {
+    my ( undef, undef, undef, $detail ) = $dbh->selectrow_array(q{EXPLAIN QUERY PLAN SELECT id FROM attributes WHERE glob_attr(attributes, 'http.*')});
+
+    like $detail, qr/GLOB INDEX/;
+
+    $dbh->selectall_arrayref(q{SELECT id FROM attributes WHERE glob_attr(attributes, 'http.*')});
+
+    my ( $explain ) = $dbh->selectrow_array(q{SELECT attributes_explain('attributes')});
+
+    like $explain, qr/attr_name>\? AND attr_name<\?/, 'key prefixes should become range seeks';
+}
+
+PROMOTED: {
+    check_sql(
+        dbh  => $dbh,
+        sql  => qq{SELECT id FROM promoted WHERE glob_attr(attributes, 'http.response.*${RS}4*')},
+        rows => [
+            [ 2 ],
+        ],
+    );
+}
+
+FUNCTION: {
+    check_sql(
+        dbh  => $dbh,
+        sql  => qq{SELECT glob_attr('color${RS}red${RS}size${RS}small', 'si*${RS}sm*'), glob_attr('color${RS}red', 'size')},
+        rows => [
+            [ 1, 0 ],
+        ],
+    );
+
+    check_sql(
+        dbh   => $dbh,
+        sql   => q{SELECT glob_attr(NULL, 'size')},
+        error => qr/attribute operand must be a string/,
+    );
+}
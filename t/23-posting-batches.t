@@ -0,0 +1,62 @@
+use strict;
+use warnings;
+use lib 't/lib';
+
+use Test::More tests => 5;
+use SQLite::TestUtils;
+
+check_deps;
+
+my $RS = get_record_separator();
+
+my $dbh = create_dbh;
+
+create_attribute_table(
+    dbh  => $dbh,
+    name => 'attributes',
+);
+
+# more rows than fit in a single batch, with values that don't follow the ids
+$dbh->do(qq{
+    WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 2500)
+    INSERT INTO attributes (id, attributes)
+    SELECT i, 'color${RS}' || (i * 7919 % 13) || '${RS}parity${RS}' || (i % 2) FROM n
+});
+
+ORDER: {
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT COUNT(1), SUM(id), MIN(id), MAX(id) FROM attributes WHERE attributes MATCH 'color'},
+        rows => [
+            [ 2500, 3126250, 1, 2500 ],
+        ],
+    );
+
+    my $ids = $dbh->selectcol_arrayref(q{SELECT id FROM attributes WHERE attributes MATCH 'color' LIMIT 10});
+
+    is_deeply $ids, [ sort { $a <=> $b } @$ids ], 'rows within a batch should come back in id order';
+
+    my ( $explain ) = $dbh->selectrow_array(q{SELECT attributes_explain('attributes')});
+
+    like $explain, qr/source: posting batches/;
+}
+
+KEY_VALUE: {
+    check_sql(
+        dbh  => $dbh,
+        sql  => qq{SELECT COUNT(1) FROM attributes WHERE attributes MATCH 'parity' AND attributes MATCH 'color${RS}3'},
+        rows => [
+            [ 192 ],
+        ],
+    );
+}
+
+GET_ATTR: {
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT COUNT(1) FROM attributes WHERE get_attr(attributes, 'parity') AND id > 2000},
+        rows => [
+            [ 250 ],
+        ],
+    );
+}
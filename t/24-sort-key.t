@@ -0,0 +1,147 @@
+use strict;
+use warnings;
+use lib 't/lib';
+
+use Test::More tests => 11;
+use SQLite::TestUtils;
+
+check_deps;
+
+my $RS = get_record_separator();
+
+my $dbh = create_dbh;
+
+create_attribute_table(
+    dbh     => $dbh,
+    name    => 'attributes',
+    options => q{promote='score:INTEGER'},
+);
+
+insert_rows $dbh, 'attributes', ({
+    id         => 1,
+    attributes => [
+        name   => 'carol',
+        level  => '07',
+        score  => '9',
+        region => 'eu',
+    ],
+}, {
+    id         => 2,
+    attributes => [
+        name  => 'alice',
+        level => '12',
+        score => '100',
+    ],
+}, {
+    id         => 3,
+    attributes => [
+        name   => 'bob',
+        score  => '42',
+        region => 'eu',
+    ],
+}, {
+    id         => 4,
+    attributes => [
+        name  => 'dave',
+        level => '03',
+    ],
+});
+
+SORT_KEY: {
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT id, sort_value FROM attributes WHERE sort_key = 'level' ORDER BY sort_value DESC LIMIT 2},
+        rows => [
+            [ 2, '12' ],
+            [ 1, '07' ],
+        ],
+    );
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => qq{SELECT id, sort_key FROM attributes WHERE sort_key = 'name' AND attributes MATCH 'region${RS}eu' ORDER BY sort_value},
+        rows => [
+            [ 3, 'name' ],
+            [ 1, 'name' ],
+        ],
+    );
+
+    # sort_key is a parameter rather than a column to filter on
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT sort_key, sort_value FROM attributes WHERE id = 1},
+        rows => [
+            [ undef, undef ],
+        ],
+    );
+
+    my ( undef, undef, undef, $detail ) = $dbh->selectrow_array(q{EXPLAIN QUERY PLAN SELECT id FROM attributes WHERE sort_key = 'level' ORDER BY sort_value DESC LIMIT 2});
+
+    like $detail, qr/SORT INDEX: sort_key = \? ORDER BY "sort_value" DESC/;
+
+    $dbh->selectall_arrayref(q{SELECT id FROM attributes WHERE sort_key = 'level' ORDER BY sort_value DESC LIMIT 2});
+
+    my ( $explain ) = $dbh->selectrow_array(q{SELECT attributes_explain('attributes')});
+
+    like $explain, qr/sorts: 0/, 'rows should come out of the index already sorted';
+}
+
+PROMOTED: {
+    # promoted columns sort by their type
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT id FROM attributes WHERE score IS NOT NULL ORDER BY score DESC LIMIT 2},
+        rows => [
+            [ 2 ],
+            [ 3 ],
+        ],
+    );
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT id, sort_value FROM attributes WHERE sort_key = 'score' ORDER BY sort_value},
+        rows => [
+            [ 1, 9 ],
+            [ 3, 42 ],
+            [ 2, 100 ],
+        ],
+    );
+}
+
+INTERNED: {
+    create_attribute_table(
+        dbh     => $dbh,
+        name    => 'interned',
+        options => 'intern_values=1',
+    );
+
+    $dbh->do(q{INSERT INTO interned (id, attributes) SELECT id, attributes FROM attributes});
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT id, sort_value FROM interned WHERE sort_key = 'level' ORDER BY sort_value DESC LIMIT 2},
+        rows => [
+            [ 2, '12' ],
+            [ 1, '07' ],
+        ],
+        ordered => 1,
+    );
+
+    my ( undef, undef, undef, $detail ) = $dbh->selectrow_array(q{EXPLAIN QUERY PLAN SELECT id FROM interned WHERE sort_key = 'level' ORDER BY sort_value DESC LIMIT 2});
+
+    unlike $detail, qr/ORDER BY/, "interned values aren't stored in order, so SQLite sorts them";
+
+    $dbh->selectall_arrayref(q{SELECT id FROM interned WHERE sort_key = 'level' ORDER BY sort_value DESC LIMIT 2});
+
+    my ( $explain ) = $dbh->selectrow_array(q{SELECT attributes_explain('interned')});
+
+    like $explain, qr/fullscan_steps: 0/, "the values dictionary shouldn't be walked";
+}
+
+BAD_OPTION: {
+    check_sql(
+        dbh   => $dbh,
+        sql   => q{CREATE VIRTUAL TABLE bad USING attributes(promote='sort_value')},
+        error => qr/can't promote key 'sort_value'/,
+    );
+}
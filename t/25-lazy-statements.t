@@ -0,0 +1,79 @@
+use strict;
+use warnings;
+use lib 't/lib';
+
+use File::Temp;
+use Test::More tests => 5;
+use SQLite::TestUtils;
+
+check_deps;
+
+my $RS = get_record_separator();
+
+my $tempdir  = File::Temp->newdir;
+my $filename = "$tempdir/lazy.db";
+
+my $dbh = create_dbh(filename => $filename);
+
+$dbh->begin_work;
+foreach my $i ( 1 .. 20 ) {
+    create_attribute_table(
+        dbh  => $dbh,
+        name => "attributes_$i",
+    );
+
+    insert_rows $dbh, "attributes_$i", {
+        attributes => [
+            table => $i,
+        ],
+    };
+}
+$dbh->commit;
+$dbh->disconnect;
+
+$dbh = create_dbh(filename => $filename);
+
+sub statements_prepared {
+    my ( $table_name ) = @_;
+
+    my ( $value ) = $dbh->selectrow_array(q{SELECT value FROM attributes_stats WHERE table_name = ? AND stat = 'statements_prepared'}, undef, $table_name);
+
+    return $value;
+}
+
+READ: {
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT attributes FROM attributes_7},
+        rows => [
+            [ "table${RS}7" ],
+        ],
+    );
+
+    my ( $n_tables ) = $dbh->selectrow_array(q{SELECT COUNT(DISTINCT table_name) FROM attributes_stats});
+
+    is $n_tables, 1, 'only the table that was read should be connected';
+
+    # the statement that reads the rows, and the one that estimates how many there are
+    cmp_ok statements_prepared('attributes_7'), '<=', 3, 'reading should only prepare what it reads with';
+}
+
+WRITE: {
+    my $before = statements_prepared('attributes_7');
+
+    insert_rows $dbh, 'attributes_7', {
+        attributes => [
+            table => 'seven',
+        ],
+    };
+
+    cmp_ok statements_prepared('attributes_7'), '>', $before, 'the first write should prepare the write statements';
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT COUNT(1) FROM attributes_7},
+        rows => [
+            [ 2 ],
+        ],
+    );
+}
@@ -0,0 +1,130 @@
+use strict;
+use warnings;
+use lib 't/lib';
+
+use Test::More tests => 14;
+use SQLite::TestUtils;
+
+check_deps;
+
+my $RS = get_record_separator();
+
+my $dbh = create_dbh;
+
+create_attribute_table(
+    dbh  => $dbh,
+    name => 'attributes',
+);
+
+create_attribute_table(
+    dbh     => $dbh,
+    name    => 'partitioned',
+    options => 'partition_size=1000, intern_values=1',
+);
+
+foreach my $table (qw/attributes partitioned/) {
+    $dbh->do(qq{
+        WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 2999)
+        INSERT INTO $table (id, attributes)
+        SELECT i, 'color' || char(31) || (i % 10) || char(31) || 'size' || char(31) || (i % 7) FROM n
+    });
+
+    # leave holes all over the shadow tables
+    $dbh->do(qq{DELETE FROM $table WHERE id % 3 = 0});
+}
+
+sub count_matches {
+    my ( $table, $match ) = @_;
+
+    my ( $count ) = $dbh->selectrow_array(qq{SELECT COUNT(1) FROM $table WHERE attributes MATCH ?}, undef, $match);
+
+    return $count;
+}
+
+OPTIMIZE: {
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT attributes_optimize('attributes')},
+        rows => [
+            [ 1 ],
+        ],
+    );
+
+    is count_matches('attributes', "color${RS}4"), 200, 'optimizing should leave the index intact';
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT tbl FROM sqlite_stat1 WHERE tbl LIKE 'attributes\_%' ESCAPE '\' GROUP BY tbl},
+        rows => [
+            [ 'attributes_Attributes' ],
+            [ 'attributes_Sequence' ],
+        ],
+    );
+}
+
+INCREMENTAL: {
+    my $finished;
+    my $calls = 0;
+
+    until($finished || $calls >= 1000) {
+        ( $finished ) = $dbh->selectrow_array(q{SELECT attributes_optimize('partitioned', 1)});
+        $calls++;
+    }
+
+    ok $finished, 'time-boxed optimization should eventually finish';
+
+    is count_matches('partitioned', "color${RS}4"), 200, 'optimizing in steps should leave the index intact';
+
+    my ( $n_tables ) = $dbh->selectrow_array(q{SELECT COUNT(DISTINCT tbl) FROM sqlite_stat1 WHERE tbl LIKE 'partitioned\_p%' ESCAPE '\'});
+
+    is $n_tables, 6, 'every partition should be analyzed';
+}
+
+REBUILD: {
+    $dbh->do(q{DELETE FROM attributes_Attributes WHERE attr_name = 'color'});
+
+    is count_matches('attributes', "color${RS}4"), 0;
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT attributes_rebuild('attributes')},
+        rows => [
+            [ 2000 ],
+        ],
+    );
+
+    is count_matches('attributes', "color${RS}4"), 200, 'rebuilding should restore the index';
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT attributes_rebuild('partitioned')},
+        rows => [
+            [ 2000 ],
+        ],
+    );
+}
+
+DIRECT_ONLY: {
+    $dbh->do(q{CREATE VIEW maintenance_view AS SELECT attributes_optimize('attributes'), attributes_rebuild('attributes')});
+
+    {
+        local $dbh->{'RaiseError'} = 0;
+
+        ok ! $dbh->prepare(q{SELECT * FROM maintenance_view}), 'views should not be able to call maintenance functions';
+    }
+    like $dbh->errstr, qr/unsafe use of attributes_(?:optimize|rebuild)/;
+}
+
+ERRORS: {
+    check_sql(
+        dbh   => $dbh,
+        sql   => q{SELECT attributes_optimize('missing')},
+        error => qr/no such attribute table/,
+    );
+
+    check_sql(
+        dbh   => $dbh,
+        sql   => q{SELECT attributes_optimize('attributes', 0)},
+        error => qr/milliseconds must be a positive integer/,
+    );
+}
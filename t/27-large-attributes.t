@@ -0,0 +1,168 @@
+use strict;
+use warnings;
+use lib 't/lib';
+
+use Test::More tests => 12;
+use SQLite::TestUtils;
+
+check_deps;
+
+my $RS = get_record_separator();
+
+my $dbh = create_dbh;
+
+create_attribute_table(
+    dbh     => $dbh,
+    name    => 'attributes',
+    options => q{promote='size'},
+);
+
+create_attribute_table(
+    dbh     => $dbh,
+    name    => 'large',
+    options => q{promote='size', large_attributes=1},
+);
+
+create_attribute_table(
+    dbh     => $dbh,
+    name    => 'partitioned',
+    options => 'partition_size=2, intern_values=1, large_attributes=1',
+);
+
+# every other row carries a value long enough to span many blob windows
+foreach my $table (qw/attributes large partitioned/) {
+    $dbh->do(qq{
+        WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 6)
+        INSERT INTO $table (id, attributes)
+        SELECT i, 'color' || char(31) || (i % 3) || char(31) || 'size' || char(31) || (i % 2) ||
+            char(31) || 'payload' || char(31) || CASE WHEN i % 2 THEN hex(zeroblob(100000)) ELSE 'x' END ||
+            char(31) || 'tail' || char(31) || 't' || i
+        FROM n
+    });
+}
+
+READ: {
+    foreach my $table (qw/large partitioned/) {
+        check_sql(
+            dbh  => $dbh,
+            sql  => qq{SELECT id, attributes FROM attributes EXCEPT SELECT id, attributes FROM $table},
+            rows => [],
+        );
+    }
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => qq{SELECT id, get_attr(attributes, 'tail') FROM large WHERE attributes MATCH 'color${RS}0' ORDER BY id},
+        rows => [
+            [ 3, 't3' ],
+            [ 6, 't6' ],
+        ],
+    );
+}
+
+GLOB: {
+    # size is promoted, so this is checked against each row's string
+    check_sql(
+        dbh  => $dbh,
+        sql  => qq{SELECT id FROM large WHERE glob_attr(attributes, 'si*${RS}1') ORDER BY id},
+        rows => [
+            [ 1 ],
+            [ 3 ],
+            [ 5 ],
+        ],
+    );
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => qq{SELECT id FROM partitioned WHERE glob_attr(attributes, 'tail${RS}t[35]') ORDER BY id},
+        rows => [
+            [ 3 ],
+            [ 5 ],
+        ],
+    );
+}
+
+WRITE: {
+    $dbh->do(q{DELETE FROM large WHERE id = 3});
+    $dbh->do(q{DELETE FROM partitioned WHERE id IN (1, 4)});
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT id FROM large WHERE attributes MATCH 'payload' ORDER BY id},
+        rows => [
+            [ 1 ],
+            [ 2 ],
+            [ 4 ],
+            [ 5 ],
+            [ 6 ],
+        ],
+    );
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT id FROM partitioned WHERE attributes MATCH 'payload' ORDER BY id},
+        rows => [
+            [ 2 ],
+            [ 3 ],
+            [ 5 ],
+            [ 6 ],
+        ],
+    );
+
+    # rewriting rows while the cursor reads them expires its blob handle
+    $dbh->do(qq{UPDATE large SET attributes = attributes || char(31) || 'extra' || char(31) || id WHERE glob_attr(attributes, 'size${RS}*')});
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT id FROM large WHERE attributes MATCH 'extra' ORDER BY id},
+        rows => [
+            [ 1 ],
+            [ 2 ],
+            [ 4 ],
+            [ 5 ],
+            [ 6 ],
+        ],
+    );
+}
+
+UNREAD_COLUMN: {
+    $dbh->selectall_arrayref(q{SELECT id FROM attributes WHERE id > 2});
+
+    my ( $explain ) = $dbh->selectrow_array(q{SELECT attributes_explain('attributes')});
+
+    like $explain, qr/SELECT s\.seq_id, NULL/, "queries that don't read the attributes column shouldn't load it";
+}
+
+OPTIMIZE: {
+    # more than one optimize chunk's worth of bytes
+    $dbh->do(q{
+        WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 40)
+        INSERT INTO large (id, attributes)
+        SELECT 100 + i, 'size' || char(31) || 'big' || char(31) || 'payload' || char(31) || hex(zeroblob(100000))
+        FROM n
+    });
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT attributes_optimize('large')},
+        rows => [
+            [ 1 ],
+        ],
+    );
+
+    check_sql(
+        dbh  => $dbh,
+        sql  => q{SELECT COUNT(1), SUM(length(attributes)) FROM large WHERE size = 'big'},
+        rows => [
+            [ 40, 40 * 200017 ],
+        ],
+    );
+}
+
+BAD_OPTION: {
+    check_sql(
+        dbh   => $dbh,
+        sql   => q{CREATE VIRTUAL TABLE bad USING attributes(large_attributes=2)},
+        error => qr/large_attributes must be 0 or 1/,
+    );
+}
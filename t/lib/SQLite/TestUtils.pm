@@ -165,11 +165,14 @@ sub dump_tables {
 sub create_attribute_table {
     my %options = @_;
 
-    my $dbh  = $options{'dbh'};
-    my $name = $options{'name'};
+    my $dbh     = $options{'dbh'};
+    my $name    = $options{'name'};
+    my $options = $options{'options'};
+
+    my $args = $options ? "($options)" : '';
 
     $dbh->do(<<"END_SQL");
-CREATE VIRTUAL TABLE $name USING attributes
+CREATE VIRTUAL TABLE $name USING attributes$args
 END_SQL
 }
 